@@ -0,0 +1,218 @@
+/*
+ * HostMain.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host test and benchmark driver. SocketServer.cpp, Connection.cpp and Listener.cpp run unchanged against a
+ * simulated SAM (SimSam.cpp, through SimHSPI.cpp) and a loopback lwIP (SimNet.cpp).
+ *
+ *   HostMain [--test] [--bench] [--sockets N] [--bytes N] [--block N] [--verbose]
+ *
+ * With neither --test nor --bench it does both.
+ */
+
+#include "HostTest.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+unsigned int testsRun = 0;
+unsigned int testsFailed = 0;
+
+// Echo benchmark. Each client sends a block of data, which the SAM reads and writes back to it in blocks of up to blockSize
+// bytes, the way RepRapFirmware polls its sockets. We report transactions per second, throughput per socket and the latency of each command.
+// The command times are host times, so compare them between builds rather than with the hardware. The bus time is
+// what the SPI transfers would take on the hardware at the clock rate the firmware has set.
+void RunBenchmarks(unsigned int numSockets, size_t bytesPerSocket, size_t blockSize)
+{
+	SimSam::Init();
+	if (blockSize > MaxDataLength)
+	{
+		blockSize = std::min<size_t>(blockSize, SamNegotiateBlockSize(blockSize));
+	}
+	blockSize = std::max<size_t>(blockSize, MaxDataLength);
+	if (!SamListen(80, protocolHTTP, numSockets))
+	{
+		printf("benchmark: listen failed\n");
+		++testsFailed;
+		return;
+	}
+
+	struct Stream
+	{
+		int client;
+		int socket;
+		std::string pending;					// read by the SAM and not yet written back
+		size_t echoed;							// received back by the client
+		double finishSeconds;
+	};
+
+	std::vector<Stream> streams(numSockets);
+	std::vector<uint8_t> buffer(blockSize);
+	for (unsigned int i = 0; i < numSockets; ++i)
+	{
+		Stream& st = streams[i];
+		st.client = SimNet::Connect(80, 0x0A01A8C0, 41000 + i);
+		st.socket = FindSocket(41000 + i);
+		st.echoed = 0;
+		st.finishSeconds = 0.0;
+		std::string data(bytesPerSocket, 0);
+		for (size_t j = 0; j < bytesPerSocket; ++j)
+		{
+			data[j] = (char)(j * 7 + i);
+		}
+		SimNet::Send(st.client, data.data(), data.size());
+	}
+	SimSam::ClearStats();
+
+	const auto startTime = std::chrono::steady_clock::now();
+	uint64_t transactions = 0;
+	unsigned int finished = 0;
+	bool stalled = false;
+	for (unsigned int idlePasses = 0; finished < numSockets && !stalled; )
+	{
+		bool progress = false;
+		for (Stream& st : streams)
+		{
+			if (st.socket < 0 || st.echoed == bytesPerSocket)
+			{
+				continue;
+			}
+
+			ConnStatusResponse resp;
+			if (!SamGetConnStatus(st.socket, resp))
+			{
+				stalled = true;
+				break;
+			}
+			++transactions;
+			if (resp.bytesAvailable != 0)
+			{
+				const int32_t amount = SamRead(st.socket, buffer.data(), buffer.size());
+				++transactions;
+				if (amount > 0)
+				{
+					st.pending.append(reinterpret_cast<const char*>(buffer.data()), amount);
+					progress = true;
+				}
+			}
+			if (!st.pending.empty() && resp.writeBufferSpace != 0)
+			{
+				const int32_t accepted = SamWrite(st.socket, st.pending.data(), std::min<size_t>(st.pending.size(), blockSize), MessageHeaderSamToEsp::FlagPush);
+				++transactions;
+				if (accepted > 0)
+				{
+					st.pending.erase(0, accepted);
+					progress = true;
+				}
+			}
+
+			const size_t received = SimNet::Available(st.client);
+			if (received != 0)
+			{
+				std::vector<char> discard(received);
+				SimNet::Receive(st.client, discard.data(), received);
+				st.echoed += received;
+				progress = true;
+				if (st.echoed == bytesPerSocket)
+				{
+					st.finishSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+					++finished;
+				}
+			}
+		}
+
+		idlePasses = (progress) ? 0 : idlePasses + 1;
+		stalled = stalled || idlePasses > 1000;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	printf("Echo benchmark: %u sockets, %zu bytes each, %zu byte blocks\n", numSockets, bytesPerSocket, blockSize);
+	if (stalled)
+	{
+		printf("  STALLED after %u of %u sockets finished\n", finished, numSockets);
+		++testsFailed;
+	}
+	printf("  %llu transactions in %.3f s, %.0f transactions/s\n", (unsigned long long)transactions, seconds, transactions/seconds);
+	for (unsigned int i = 0; i < numSockets; ++i)
+	{
+		const Stream& st = streams[i];
+		printf("  socket %d: %zu bytes echoed, %.0f bytes/s\n", st.socket, st.echoed, (st.finishSeconds > 0.0) ? st.echoed/st.finishSeconds : st.echoed/seconds);
+	}
+	uint64_t busNanos = 0;
+	for (unsigned int cmd = 0; cmd < 256; ++cmd)
+	{
+		busNanos += SimSam::GetStats((NetworkCommand)cmd).busNanos;
+	}
+	printf("  SPI clock %.2f MHz, bus busy for %.3f s, so at most %.0f bytes/s per socket on the hardware\n",
+			SimSam::GetSpiClockHz()/1.0e6, busNanos/1.0e9, bytesPerSocket/(busNanos/1.0e9));
+	printf("  %-28s %10s %10s %10s %10s %10s\n", "command", "count", "min us", "mean us", "max us", "bus us");
+	for (unsigned int cmd = 0; cmd < 256; ++cmd)
+	{
+		const SimSam::CommandStats& cs = SimSam::GetStats((NetworkCommand)cmd);
+		if (cs.count != 0)
+		{
+			printf("  %-28s %10u %10.2f %10.2f %10.2f %10.2f\n", CommandName((NetworkCommand)cmd), cs.count,
+					cs.minNanos/1000.0, cs.totalNanos/(1000.0 * cs.count), cs.maxNanos/1000.0, cs.busNanos/(1000.0 * cs.count));
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	bool runTests = false, runBenchmarks = false;
+	unsigned int numSockets = 4;
+	size_t bytesPerSocket = 1024 * 1024;
+	size_t blockSize = MaxDataLength;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		if (arg == "--test")
+		{
+			runTests = true;
+		}
+		else if (arg == "--bench")
+		{
+			runBenchmarks = true;
+		}
+		else if (arg == "--sockets" && i + 1 < argc)
+		{
+			numSockets = std::min<unsigned int>(std::max<int>(atoi(argv[++i]), 1), MaxConnections);
+		}
+		else if (arg == "--bytes" && i + 1 < argc)
+		{
+			bytesPerSocket = std::max<long>(atol(argv[++i]), 1);
+		}
+		else if (arg == "--block" && i + 1 < argc)
+		{
+			blockSize = std::max<long>(atol(argv[++i]), 1);
+		}
+		else if (arg == "--verbose")
+		{
+			SimCore::SetVerbose(true);
+		}
+		else
+		{
+			printf("usage: %s [--test] [--bench] [--sockets N] [--bytes N] [--block N] [--verbose]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!runTests && !runBenchmarks)
+	{
+		runTests = runBenchmarks = true;
+	}
+
+	SimFlash::EraseAll();
+	if (runTests)
+	{
+		RunTests();
+		printf("%u checks, %u failed\n", testsRun, testsFailed);
+	}
+	if (runBenchmarks && testsFailed == 0)
+	{
+		RunBenchmarks(numSockets, bytesPerSocket, blockSize);
+	}
+	return (testsFailed == 0) ? 0 : 1;
+}
+
+// End
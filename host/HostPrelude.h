@@ -0,0 +1,30 @@
+/*
+ * HostPrelude.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Included ahead of every source file in the host build.
+ * SocketServer.cpp includes ecv.h first, which turns words such as "in", "out" and "value" into macros, so we pull in
+ * every standard header that the stubs need before that can happen.
+ */
+
+#ifndef HOST_HOSTPRELUDE_H_
+#define HOST_HOSTPRELUDE_H_
+
+#ifdef __cplusplus
+# include <algorithm>
+# include <cmath>
+# include <cstdarg>
+# include <cstddef>
+# include <cstdint>
+# include <cstdio>
+# include <cstdlib>
+# include <cstring>
+# include <functional>
+# include <memory>
+# include <new>
+# include <string>
+# include <vector>
+#endif
+
+#endif /* HOST_HOSTPRELUDE_H_ */
@@ -0,0 +1,34 @@
+/*
+ * HostTest.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Shared declarations for the host test and benchmark driver
+ */
+
+#ifndef HOST_HOSTTEST_H_
+#define HOST_HOSTTEST_H_
+
+#include <cstdio>
+#include "SimSam.h"
+#include "SimNet.h"
+#include "SimCore.h"
+
+extern unsigned int testsRun;
+extern unsigned int testsFailed;
+
+#define CHECK(_cond)	do { ++testsRun; if (!(_cond)) { ++testsFailed; printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #_cond); } } while (0)
+
+// What the SAM does to use a socket
+bool SamListen(uint16_t port, uint8_t protocol, uint16_t maxConnections);
+bool SamGetConnStatus(uint8_t socket, ConnStatusResponse& resp);
+int FindSocket(uint16_t remotePort);			// find the connected socket for a client, or -1 if there isn't one
+int32_t SamRead(uint8_t socket, void *buffer, size_t length);
+int32_t SamWrite(uint8_t socket, const void *data, size_t length, uint8_t flags);
+size_t SamNegotiateBlockSize(size_t maxDataLength);
+const char *CommandName(NetworkCommand cmd);
+
+void RunTests();
+void RunBenchmarks(unsigned int numSockets, size_t bytesPerSocket, size_t blockSize);
+
+#endif /* HOST_HOSTTEST_H_ */
@@ -0,0 +1,1363 @@
+/*
+ * HostTests.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Tests that drive the firmware through the simulated SAM and network
+ */
+
+#include "HostTest.h"
+#include <vector>
+#include <string>
+#include <esp8266_peri.h>
+#include "Crc32.h"
+#include "Config.h"
+#include "SsidIndex.h"
+
+extern "C"
+{
+	#include "user_interface.h"
+	#include "lwip/memp.h"
+	#include "lwip/tcp.h"
+}
+
+// SAM operations
+
+bool SamListen(uint16_t port, uint8_t protocol, uint16_t maxConnections)
+{
+	ListenOrConnectData lcData;
+	memset(&lcData, 0, sizeof(lcData));
+	lcData.remoteIp = AnyIp;
+	lcData.protocol = protocol;
+	lcData.port = port;
+	lcData.maxConnections = maxConnections;
+	return SimSam::Transaction(NetworkCommand::networkListen, 0, 0, 0, &lcData, sizeof(lcData), nullptr, 0) == ResponseEmpty;
+}
+
+bool SamGetConnStatus(uint8_t socket, ConnStatusResponse& resp)
+{
+	return SimSam::Transaction(NetworkCommand::connGetStatus, socket, 0, 0, nullptr, 0, &resp, sizeof(resp)) == (int32_t)sizeof(resp);
+}
+
+int FindSocket(uint16_t remotePort)
+{
+	for (unsigned int i = 0; i < MaxConnections; ++i)
+	{
+		ConnStatusResponse resp;
+		if (SamGetConnStatus(i, resp) && resp.state != ConnState::free && resp.remotePort == remotePort)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+int32_t SamRead(uint8_t socket, void *buffer, size_t length)
+{
+	return SimSam::Transaction(NetworkCommand::connRead, socket, 0, 0, nullptr, 0, buffer, length);
+}
+
+int32_t SamWrite(uint8_t socket, const void *data, size_t length, uint8_t flags)
+{
+	return SimSam::Transaction(NetworkCommand::connWrite, socket, flags, 0, data, length, nullptr, 0);
+}
+
+// Negotiate the maximum data length and return the one the ESP offered, or 0 if the command failed
+size_t SamNegotiateBlockSize(size_t maxDataLength)
+{
+	BlockSizeData ours, theirs;
+	ours.maxDataLength = maxDataLength;
+	return (SimSam::Transaction(NetworkCommand::networkNegotiateBlockSize, 0, 0, 0, &ours, sizeof(ours), &theirs, sizeof(theirs)) == (int32_t)sizeof(theirs))
+			? theirs.maxDataLength : 0;
+}
+
+const char *CommandName(NetworkCommand cmd)
+{
+	static const char * const names[] =
+	{
+		"nullCommand", "connAbort", "connClose", "connCreate", "connRead", "connWrite", "connGetStatus",
+		"networkListen", "unused_networkStopListening", "networkGetStatus", "networkAddSsid", "networkDeleteSsid",
+		"networkListSsids_deprecated", "networkConfigureAccessPoint", "networkStartClient", "networkStartAccessPoint",
+		"networkStop", "networkFactoryReset", "networkSetHostName", "networkGetLastError", "diagnostics",
+		"networkRetrieveSsidData", "networkSetTxPower", "networkSetClockControl", "connReadMulti",
+		"connWriteMulti", "networkNegotiateBlockSize", "networkGetCapabilities", "connGetAllStatus", "networkGetEvents", "networkRetransmit", "networkCalibrateClock", "networkGetStatistics", "networkGetDiagnostics",
+		"networkScan", "networkGetConnectLog", "networkSetFastBoot", "networkGetBootTimes"
+	};
+	return ((size_t)cmd < sizeof(names)/sizeof(names[0])) ? names[(size_t)cmd] : "unknown";
+}
+
+// Tests
+
+static void TestRequestHeaders()
+{
+	SimSam::Init();
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	CHECK(SimSam::GetReplyFormatVersion() == MyFormatVersion);
+	CHECK(SimSam::GetReplyState() == WiFiState::idle);
+
+	NetworkStatusResponse status;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetStatus, 0, 0, 0, nullptr, 0, &status, sizeof(status)) == (int32_t)sizeof(status));
+	CHECK(status.freeHeap == SimNet::FreeHeap());
+	CHECK(status.flashSize == SimFlash::FlashSize);
+
+	CapabilitiesResponse caps;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetCapabilities, 0, 0, 0, nullptr, 0, &caps, sizeof(caps)) == (int32_t)sizeof(caps));
+	CHECK((caps.features & (FeatureReadMulti | FeatureWriteMulti | FeatureNegotiableBlockSize)) == (FeatureReadMulti | FeatureWriteMulti | FeatureNegotiableBlockSize));
+	CHECK((caps.features & FeaturePipelinedSpi) == 0);										// off by default
+	CHECK(caps.numSockets == MaxConnections && caps.negotiatedDataLength == MaxDataLength && caps.maxDataLength == MaxExtendedDataLength);
+	CHECK(caps.clockReg == SPI1CLK);
+
+	CHECK(SimSam::Transaction(NetworkCommand::connCreate, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseUnknownCommand);
+	CHECK(SimSam::Transaction(NetworkCommand::connRead, MaxConnections, 0, 0, nullptr, 0, nullptr, 0) == ResponseBadParameter);
+
+	SimSam::SetFormatVersion(InvalidFormatVersion);
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseBadRequestFormatVersion);
+	SimSam::SetFormatVersion(MyFormatVersion);
+
+	std::vector<uint8_t> tooLong(MaxDataLength + 4);
+	CHECK(SimSam::Transaction(NetworkCommand::connWrite, 0, 0, 0, tooLong.data(), tooLong.size(), nullptr, 0) == ResponseBadDataLength);
+	CHECK(!SimSam::GetOverrun());
+}
+
+static void TestEcho()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 2));
+
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40000);
+	CHECK(SimNet::IsConnected(client));
+	const int socket = FindSocket(40000);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+
+	ConnStatusResponse resp;
+	CHECK(SamGetConnStatus(socket, resp));
+	CHECK(resp.state == ConnState::connected);
+	CHECK(resp.localPort == 80);
+	CHECK(resp.remoteIp == 0x0A01A8C0);
+	CHECK((resp.connectedSockets & (1u << socket)) != 0);
+
+	// Send more than the receive window so that the firmware has to open it again as the SAM reads
+	std::string sent;
+	for (unsigned int i = 0; i < 20000; ++i)
+	{
+		sent += (char)('a' + i % 23);
+	}
+	SimNet::Send(client, sent.data(), sent.size());
+
+	std::string readBack, echoed;
+	std::vector<uint8_t> buffer(MaxDataLength);
+	for (unsigned int i = 0; i < 1000 && echoed.size() < sent.size(); ++i)
+	{
+		const int32_t amount = SamRead(socket, buffer.data(), buffer.size());
+		CHECK(amount >= 0);
+		if (amount > 0)
+		{
+			readBack.append(reinterpret_cast<const char*>(buffer.data()), amount);
+		}
+		if (readBack.size() > echoed.size())
+		{
+			const size_t length = std::min<size_t>(readBack.size() - echoed.size(), MaxDataLength);
+			const int32_t accepted = SamWrite(socket, readBack.data() + echoed.size(), length, MessageHeaderSamToEsp::FlagPush);
+			CHECK(accepted >= 0 && (size_t)accepted <= length);
+			if (accepted > 0)
+			{
+				echoed.append(readBack, echoed.size(), accepted);
+			}
+		}
+	}
+	SimSam::Idle(5);
+
+	std::string received(SimNet::Available(client), 0);
+	SimNet::Receive(client, &received[0], received.size());
+	CHECK(readBack == sent);
+	CHECK(received == sent);
+}
+
+static void TestCloseAndAbort()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+
+	// The client closes gracefully, then the SAM closes its end
+	const int client1 = SimNet::Connect(80, 0x0A01A8C0, 40001);
+	const int socket1 = FindSocket(40001);
+	CHECK(socket1 >= 0);
+	SimNet::Send(client1, "hello", 5);
+	SimNet::Close(client1);
+	SimSam::Idle(2);
+
+	ConnStatusResponse resp;
+	CHECK(SamGetConnStatus(socket1, resp));
+	CHECK(resp.state == ConnState::otherEndClosed);
+	CHECK(resp.bytesAvailable == 5);
+	char buffer[8];
+	CHECK(SamRead(socket1, buffer, sizeof(buffer)) == 5);
+	CHECK(SimSam::Transaction(NetworkCommand::connClose, socket1, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SamGetConnStatus(socket1, resp));
+	CHECK(resp.state == ConnState::free);
+	CHECK(SimNet::GotFin(client1));
+
+	// The client resets the connection, then the SAM aborts its end
+	const int client2 = SimNet::Connect(80, 0x0A01A8C0, 40002);
+	const int socket2 = FindSocket(40002);
+	CHECK(socket2 >= 0);
+	SimNet::Abort(client2);
+	CHECK(SamGetConnStatus(socket2, resp));
+	CHECK(resp.state == ConnState::aborted);
+	CHECK(SamWrite(socket2, "hello", 5, MessageHeaderSamToEsp::FlagPush) == 0);	// the connection no longer has a pcb
+	CHECK(SimSam::Transaction(NetworkCommand::connAbort, socket2, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	CHECK(SamGetConnStatus(socket2, resp));
+	CHECK(resp.state == ConnState::free);
+
+	// The SAM aborts a connection that is still open
+	const int client3 = SimNet::Connect(80, 0x0A01A8C0, 40003);
+	const int socket3 = FindSocket(40003);
+	CHECK(socket3 >= 0);
+	CHECK(SimSam::Transaction(NetworkCommand::connAbort, socket3, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	CHECK(SimNet::WasReset(client3));
+	CHECK(SamGetConnStatus(socket3, resp));
+	CHECK(resp.state == ConnState::free);
+}
+
+static void TestReadMulti()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client1 = SimNet::Connect(80, 0x0A01A8C0, 40020);
+	const int client2 = SimNet::Connect(80, 0x0A01A8C0, 40021);
+	const int socket1 = FindSocket(40020);
+	const int socket2 = FindSocket(40021);
+	CHECK(socket1 >= 0 && socket2 >= 0);
+	if (socket1 < 0 || socket2 < 0)
+	{
+		return;
+	}
+	SimNet::Send(client1, "first socket", 12);
+	SimNet::Send(client2, "second", 6);
+	SimSam::Idle(2);
+
+	ReadMultiRequest request;
+	memset(&request, 0, sizeof(request));
+	request.maxLength[socket1] = 5;							// leave some behind on this one
+	request.maxLength[socket2] = 100;
+	uint8_t buffer[256];
+	const int32_t length = SimSam::Transaction(NetworkCommand::connReadMulti, 0, 0, 0, &request, sizeof(request), buffer, sizeof(buffer));
+	CHECK(length >= (int32_t)(sizeof(ReadMultiSummary) + 2 * sizeof(ReadMultiRecord) + 12));
+
+	const ReadMultiSummary * const summary = reinterpret_cast<const ReadMultiSummary*>(buffer);
+	CHECK(summary->bytesAvailable[socket1] == 12);
+	CHECK(summary->bytesAvailable[socket2] == 6);
+
+	std::string got[MaxConnections];
+	for (size_t offset = sizeof(ReadMultiSummary); offset + sizeof(ReadMultiRecord) <= (size_t)length; )
+	{
+		const ReadMultiRecord * const record = reinterpret_cast<const ReadMultiRecord*>(buffer + offset);
+		if (record->socketNumber == ReadMultiEndMarker)
+		{
+			break;
+		}
+		CHECK(record->socketNumber < MaxConnections && record->state == ConnState::connected);
+		got[record->socketNumber].assign(reinterpret_cast<const char*>(record + 1), record->length);
+		offset += sizeof(ReadMultiRecord) + NumDwords(record->length) * sizeof(uint32_t);
+	}
+	CHECK(got[socket1] == "first");
+	CHECK(got[socket2] == "second");
+
+	ConnStatusResponse resp;
+	CHECK(SamGetConnStatus(socket1, resp));
+	CHECK(resp.bytesAvailable == 7);
+
+	memset(&request, 0, sizeof(request));
+	CHECK(SimSam::Transaction(NetworkCommand::connReadMulti, 0, 0, 0, &request, sizeof(request) - 2, buffer, sizeof(buffer)) == ResponseBadDataLength);
+	CHECK(SimSam::Transaction(NetworkCommand::connReadMulti, 0, 0, 0, &request, sizeof(request), buffer, 4) == ResponseBufferTooSmall);
+}
+
+static void TestWriteMulti()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client1 = SimNet::Connect(80, 0x0A01A8C0, 40030);
+	const int client2 = SimNet::Connect(80, 0x0A01A8C0, 40031);
+	const int socket1 = FindSocket(40030);
+	const int socket2 = FindSocket(40031);
+	CHECK(socket1 >= 0 && socket2 >= 0);
+	if (socket1 < 0 || socket2 < 0)
+	{
+		return;
+	}
+
+	// The data for each socket goes in socket number order
+	WriteMultiRequest request;
+	memset(&request, 0, sizeof(request));
+	request.length[socket1] = 5;
+	request.flags[socket1] = MessageHeaderSamToEsp::FlagPush;
+	request.length[socket2] = 3;
+	request.flags[socket2] = MessageHeaderSamToEsp::FlagPush | MessageHeaderSamToEsp::FlagCloseAfterWrite;
+	uint8_t dataOut[sizeof(WriteMultiRequest) + 16];
+	memset(dataOut, 0, sizeof(dataOut));
+	memcpy(dataOut, &request, sizeof(request));
+	memcpy(dataOut + sizeof(request) + ((socket1 < socket2) ? 0 : 4), "hello", 5);
+	memcpy(dataOut + sizeof(request) + ((socket1 < socket2) ? 8 : 0), "bye", 3);
+
+	uint8_t dataIn[sizeof(WriteMultiRequest) + sizeof(WriteMultiResponse) + 16];
+	const int32_t length = SimSam::Transaction(NetworkCommand::connWriteMulti, 0, 0, 0, dataOut, sizeof(dataOut), dataIn, sizeof(dataIn));
+	CHECK(length >= (int32_t)(sizeof(WriteMultiRequest) + sizeof(WriteMultiResponse)));
+	const WriteMultiResponse * const response = reinterpret_cast<const WriteMultiResponse*>(dataIn + sizeof(WriteMultiRequest));
+	CHECK(response->acceptedLength[socket1] == 5);
+	CHECK(response->acceptedLength[socket2] == 3);
+	SimSam::Idle(2 * MaxConnections);						// Connection::PollOne looks at one connection per loop
+
+	char received[8];
+	CHECK(SimNet::Receive(client1, received, sizeof(received)) == 5 && memcmp(received, "hello", 5) == 0);
+	CHECK(SimNet::Receive(client2, received, sizeof(received)) == 3 && memcmp(received, "bye", 3) == 0);
+	CHECK(SimNet::GotFin(client2));
+	CHECK(SimNet::IsConnected(client1));
+
+	CHECK(SimSam::Transaction(NetworkCommand::connWriteMulti, 0, 0, 0, dataOut, sizeof(WriteMultiRequest) - 4, dataIn, sizeof(dataIn)) == ResponseBadDataLength);
+
+	// The segments must fit in the data sent, even though the ESP transfers enough for the response as well
+	request.length[socket2] = 0;
+	memcpy(dataOut, &request, sizeof(request));
+	memset(dataIn, 0xFF, sizeof(dataIn));
+	CHECK(SimSam::Transaction(NetworkCommand::connWriteMulti, 0, 0, 0, dataOut, sizeof(WriteMultiRequest), dataIn, sizeof(dataIn)) >= (int32_t)(sizeof(WriteMultiRequest) + sizeof(WriteMultiResponse)));
+	CHECK(response->acceptedLength[socket1] == 0);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(SimNet::Receive(client1, received, sizeof(received)) == 0);
+
+	// The sockets share the free memory, so if there is only enough for one pbuf then only the first socket gets it
+	const int client3 = SimNet::Connect(80, 0x0A01A8C0, 40032);
+	const int socket3 = FindSocket(40032);
+	CHECK(socket3 >= 0 && socket3 != socket1);
+	if (socket3 < 0)
+	{
+		return;
+	}
+	const size_t chunkLength = 1000;
+	std::vector<uint8_t> bigDataOut(sizeof(WriteMultiRequest) + 2 * chunkLength, 'z');
+	memset(&request, 0, sizeof(request));
+	request.length[socket1] = request.length[socket3] = chunkLength;
+	request.flags[socket1] = request.flags[socket3] = MessageHeaderSamToEsp::FlagPush;
+	memcpy(bigDataOut.data(), &request, sizeof(request));
+	SimNet::SetFreeHeap(WriteHeapReserve + TxPbufAllocationSize + 100);
+	CHECK(SimSam::Transaction(NetworkCommand::connWriteMulti, 0, 0, 0, bigDataOut.data(), bigDataOut.size(), dataIn, sizeof(dataIn)) >= (int32_t)(sizeof(WriteMultiRequest) + sizeof(WriteMultiResponse)));
+	SimNet::SetFreeHeap(SimNet::DefaultFreeHeap);
+	CHECK(response->acceptedLength[std::min(socket1, socket3)] == chunkLength);
+	CHECK(response->acceptedLength[std::max(socket1, socket3)] == 0);
+
+	// With enough for both, both get it
+	SimSam::Idle(2 * MaxConnections);
+	SimNet::SetFreeHeap(WriteHeapReserve + 3 * TxPbufAllocationSize + 100);
+	CHECK(SimSam::Transaction(NetworkCommand::connWriteMulti, 0, 0, 0, bigDataOut.data(), bigDataOut.size(), dataIn, sizeof(dataIn)) >= (int32_t)(sizeof(WriteMultiRequest) + sizeof(WriteMultiResponse)));
+	SimNet::SetFreeHeap(SimNet::DefaultFreeHeap);
+	CHECK(response->acceptedLength[socket1] == chunkLength && response->acceptedLength[socket3] == chunkLength);
+	SimSam::Idle(2 * MaxConnections);
+	std::vector<uint8_t> receivedData(3 * chunkLength);
+	CHECK(SimNet::Receive(client1, receivedData.data(), receivedData.size()) + SimNet::Receive(client3, receivedData.data(), receivedData.size()) == (int)(3 * chunkLength));
+}
+
+static void TestBlockSize()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40040);
+	const int socket = FindSocket(40040);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+	const std::string data(3 * MaxExtendedDataLength, 'x');
+	SimNet::Send(client, data.data(), data.size());
+	SimSam::Idle(2);
+
+	std::vector<uint8_t> buffer(MaxExtendedDataLength);
+	CHECK(SamRead(socket, buffer.data(), buffer.size()) == (int32_t)MaxDataLength);	// not negotiated yet
+
+	CHECK(SamNegotiateBlockSize(MaxExtendedDataLength) == MaxExtendedDataLength);
+	SimSam::Idle(2);
+	CHECK(SamRead(socket, buffer.data(), buffer.size()) > (int32_t)MaxDataLength);	// as much as the TCP window let through
+	SimSam::Idle(2);
+	CHECK(SamRead(socket, buffer.data(), 3000) == 3000);							// limited by what the SAM can receive
+
+	std::vector<uint8_t> writeData(MaxExtendedDataLength, 'y');
+	CHECK(SamWrite(socket, writeData.data(), writeData.size(), MessageHeaderSamToEsp::FlagPush) > (int32_t)MaxDataLength);
+
+	CHECK(SamNegotiateBlockSize(100) == MaxExtendedDataLength);						// never less than MaxDataLength
+	CHECK(SamRead(socket, buffer.data(), buffer.size()) == (int32_t)MaxDataLength);
+
+	// If the larger buffer would leave too little heap then we stay at MaxDataLength
+	SimNet::SetFreeHeap(MinFreeHeapToAccept + MaxExtendedDataLength/2);
+	CHECK(SamNegotiateBlockSize(MaxExtendedDataLength) == MaxExtendedDataLength);
+	SimNet::SetFreeHeap(SimNet::DefaultFreeHeap);
+	SimSam::Idle(2);
+	CHECK(SamRead(socket, buffer.data(), buffer.size()) == (int32_t)MaxDataLength);
+}
+
+static void TestAllStatus()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40050);
+	const int socket = FindSocket(40050);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+
+	AllConnStatusResponse before, after;
+	CHECK(SimSam::Transaction(NetworkCommand::connGetAllStatus, 0, 0, 0, nullptr, 0, &before, sizeof(before)) == (int32_t)sizeof(before));
+	CHECK(before.sockets[socket].state == ConnState::connected);
+	CHECK(before.sockets[socket].localPort == 80 && before.sockets[socket].remotePort == 40050);
+	CHECK(before.sockets[socket].bytesAvailable == 0);
+
+	SimNet::Send(client, "data", 4);
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::connGetAllStatus, 0, 0, 0, nullptr, 0, &after, sizeof(after)) == (int32_t)sizeof(after));
+	CHECK(after.sockets[socket].bytesAvailable == 4);
+	CHECK(after.sockets[socket].changeCount != before.sockets[socket].changeCount);
+	for (unsigned int i = 0; i < MaxConnections; ++i)
+	{
+		CHECK(i == (unsigned int)socket || after.sockets[i].changeCount == before.sockets[i].changeCount);
+	}
+
+	CHECK(SimSam::Transaction(NetworkCommand::connGetAllStatus, 0, 0, 0, nullptr, 0, &after, 4) == ResponseBufferTooSmall);
+}
+
+// Retrieve the queued events and return how many there were, or -1 if the command failed
+static int SamGetEvents(ConnEvent *events, size_t maxEvents, uint16_t& lostEvents)
+{
+	std::vector<uint8_t> buffer(sizeof(EventsResponseHeader) + maxEvents * sizeof(ConnEvent));
+	const int32_t length = SimSam::Transaction(NetworkCommand::networkGetEvents, 0, 0, 0, nullptr, 0, buffer.data(), buffer.size());
+	if (length < (int32_t)sizeof(EventsResponseHeader))
+	{
+		return -1;
+	}
+	const EventsResponseHeader * const hdr = reinterpret_cast<const EventsResponseHeader*>(buffer.data());
+	lostEvents = hdr->lostEvents;
+	memcpy(events, buffer.data() + sizeof(EventsResponseHeader), hdr->numEvents * sizeof(ConnEvent));
+	return hdr->numEvents;
+}
+
+static void TestEvents()
+{
+	SimSam::Init();
+	ConnEvent events[40];
+	uint16_t lost;
+
+	// This is the first test to retrieve events, so until it does the ESP mustn't pulse EspReqTransferPin for them
+	CHECK(SamListen(80, protocolHTTP, 4));
+	uint32_t edges = SimCore::NumRisingEdges(EspReqTransferPin);
+	const int client0 = SimNet::Connect(80, 0x0A01A8C0, 40059);
+	SimNet::Send(client0, "abc", 3);
+	SimSam::Idle(4);
+	CHECK(SimCore::NumRisingEdges(EspReqTransferPin) == edges);
+	while (SamGetEvents(events, 40, lost) > 0) { }			// the queue isn't cleared by a simulated reset, so discard events from earlier tests
+
+	// Now new events are signalled, but not more often than every 10ms, and we don't keep signalling events that the SAM hasn't collected
+	SimCore::AdvanceMillis(20);
+	edges = SimCore::NumRisingEdges(EspReqTransferPin);
+	SimNet::Send(client0, "def", 3);
+	SimSam::Idle(2);
+	CHECK(SimCore::NumRisingEdges(EspReqTransferPin) == edges + 1);
+	SimNet::Send(client0, "ghi", 3);
+	SimSam::Idle(2);
+	CHECK(SimCore::NumRisingEdges(EspReqTransferPin) == edges + 1);
+	SimCore::AdvanceMillis(20);
+	SimSam::Idle(2);
+	CHECK(SimCore::NumRisingEdges(EspReqTransferPin) == edges + 2);
+	char errorText[100];
+	SimSam::Transaction(NetworkCommand::networkGetLastError, 0, 0, 0, nullptr, 0, errorText, sizeof(errorText));	// so that there is no error to report either
+	edges = SimCore::NumRisingEdges(EspReqTransferPin);
+	SimCore::AdvanceMillis(1000);
+	SimSam::Idle(2);
+	CHECK(SimCore::NumRisingEdges(EspReqTransferPin) == edges);
+	SimNet::Abort(client0);
+	SimSam::Idle(2);
+	while (SamGetEvents(events, 40, lost) > 0) { }
+	SimSam::Idle(2 * MaxConnections);
+	while (SamGetEvents(events, 40, lost) > 0) { }
+
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40060);
+	SimNet::Send(client, "abc", 3);
+	SimSam::Idle(2);
+	SimNet::Send(client, "def", 3);
+	SimSam::Idle(2);
+	SimNet::Close(client);
+	SimSam::Idle(2);
+
+	const int n = SamGetEvents(events, 40, lost);
+	CHECK(n == 3 && lost == 0);
+	if (n == 3)
+	{
+		const uint8_t socket = events[0].socketNumber;
+		CHECK(events[0].type == ConnEventType::accepted && events[0].param == 80);
+		CHECK(events[1].type == ConnEventType::dataArrived && events[1].socketNumber == socket && events[1].param == 6);	// merged
+		CHECK(events[2].type == ConnEventType::otherEndClosed && events[2].socketNumber == socket);
+	}
+	CHECK(SamGetEvents(events, 40, lost) == 0);
+
+	// Alternate incoming data with acknowledged writes so that the events can't be merged, until the queue overflows
+	const int client2 = SimNet::Connect(80, 0x0A01A8C0, 40061);
+	const int socket2 = FindSocket(40061);
+	CHECK(socket2 >= 0);
+	if (socket2 < 0)
+	{
+		return;
+	}
+	for (unsigned int i = 0; i < 20; ++i)
+	{
+		SimNet::Send(client2, "x", 1);
+		SimSam::Idle(2);
+		char c;
+		CHECK(SamRead(socket2, &c, 1) == 1);
+		CHECK(SamWrite(socket2, "y", 1, MessageHeaderSamToEsp::FlagPush) == 1);
+		SimSam::Idle(2);
+	}
+	const int m = SamGetEvents(events, 40, lost);
+	CHECK(m == 32 && lost != 0);
+	CHECK(SamGetEvents(events, 40, lost) == 0 && lost == 0);
+}
+
+static void TestFraming()
+{
+	SimSam::Init();
+	const uint32_t check[2] = { 0x34333231, 0x38373635 };	// "12345678"
+	CHECK(Crc32::Calc(check, 2) == 0x9AE0DAAF);
+
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40070);
+	const int socket = FindSocket(40070);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+
+	SimSam::SetFormatVersion(MyFramedFormatVersion);
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	CHECK(SimSam::GetEspCrcOk() && SimSam::GetTrailerAck() == ResponseEmpty);
+
+	// A corrupted header is rejected
+	SimSam::CorruptSent(1);
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseBadCrc);
+	CHECK(SimSam::GetTrailerAck() == ResponseBadCrc);
+
+	// Corrupted write data is not written, so we can send it again
+	SimSam::CorruptSent(headerDwords + 2);					// the second data dword, after the header CRC and param32
+	CHECK(SamWrite(socket, "hello world", 11, MessageHeaderSamToEsp::FlagPush) == 11);
+	CHECK(SimSam::GetTrailerAck() == ResponseBadCrc);
+	SimSam::Idle(2);
+	CHECK(SimNet::Available(client) == 0);
+	CHECK(SamWrite(socket, "hello world", 11, MessageHeaderSamToEsp::FlagPush) == 11);
+	CHECK(SimSam::GetTrailerAck() == ResponseEmpty);
+	SimSam::Idle(2);
+	char received[16];
+	CHECK(SimNet::Receive(client, received, sizeof(received)) == 11 && memcmp(received, "hello world", 11) == 0);
+
+	// Corrupted read data can be retransmitted
+	SimNet::Send(client, "abcdefgh", 8);
+	SimSam::Idle(2);
+	char buffer[16];
+	SimSam::CorruptReceived(headerDwords + 1);
+	CHECK(SamRead(socket, buffer, sizeof(buffer)) == 8);
+	CHECK(!SimSam::GetEspCrcOk() && memcmp(buffer, "abcdefgh", 8) != 0);
+	memset(buffer, 0, sizeof(buffer));
+	CHECK(SimSam::Transaction(NetworkCommand::networkRetransmit, 0, 0, 0, nullptr, 0, buffer, sizeof(buffer)) == 8);
+	CHECK(SimSam::GetEspCrcOk() && memcmp(buffer, "abcdefgh", 8) == 0);
+
+	SimSam::SetFormatVersion(MyFormatVersion);
+}
+
+// Send 'runs' networkCalibrateClock test runs using patterns of the given length, then the report, and return the results of the report
+static bool SamCalibrateClock(size_t patternLength, unsigned int runs, const ClockCalibrationReport& report, ClockCalibrationResults& results)
+{
+	std::vector<uint32_t> patterns(MaxClockCandidates * NumDwords(patternLength));
+	for (size_t i = 0; i < patterns.size(); ++i)
+	{
+		patterns[i] = CalibrationPatternDword(i % NumDwords(patternLength));
+	}
+	const size_t numCandidates = ARRAY_SIZE(CalibrationClockCandidates);
+	std::vector<uint8_t> received(numCandidates * patternLength + sizeof(ClockCalibrationResults));
+	for (unsigned int run = 0; run < runs; ++run)
+	{
+		if (SimSam::Transaction(NetworkCommand::networkCalibrateClock, 0, 0, 0, patterns.data(), patterns.size() * sizeof(uint32_t), received.data(), received.size())
+				!= (int32_t)received.size())
+		{
+			return false;
+		}
+	}
+
+	uint8_t reportResponse[sizeof(ClockCalibrationReport) + sizeof(ClockCalibrationResults)];
+	if (SimSam::Transaction(NetworkCommand::networkCalibrateClock, 0, FlagCalibrationReport, 0, &report, sizeof(report), reportResponse, sizeof(reportResponse))
+			!= (int32_t)sizeof(reportResponse))
+	{
+		return false;
+	}
+	memcpy(&results, reportResponse + sizeof(ClockCalibrationReport), sizeof(results));
+	return true;
+}
+
+static void TestClockCalibration()
+{
+	SimSam::Init();
+	const size_t numCandidates = ARRAY_SIZE(CalibrationClockCandidates);
+	const uint32_t originalClockReg = SPI1CLK;
+	ClockCalibrationReport report;
+	memset(&report, 0, sizeof(report));
+	ClockCalibrationResults results;
+
+	// The link fails above 30MHz. A test run doesn't change the clock speed, and the report is refused until there has been one.
+	SimSam::SetMaxCleanClockHz(30.0e6);
+	uint8_t reportResponse[sizeof(ClockCalibrationReport) + sizeof(ClockCalibrationResults)];
+	CHECK(SimSam::Transaction(NetworkCommand::networkCalibrateClock, 0, FlagCalibrationReport, 0, &report, sizeof(report), reportResponse, sizeof(reportResponse))
+			== ResponseWrongState);
+	CHECK(SamCalibrateClock(CalibrationPatternLength, 3, report, results));
+	CHECK(results.numCandidates == numCandidates && results.numRuns == 3 && results.previousClockReg == originalClockReg);
+	CHECK(results.entries[0].bitErrors != 0 && results.entries[1].bitErrors == 0);
+
+	// Without framing, 40MHz isn't considered even if it were clean, and we step down one from the fastest clean candidate
+	CHECK(results.selected == 2 && SPI1CLK == CalibrationClockCandidates[2]);
+	CHECK(SimSam::GetSpiClockHz() <= 30.0e6);
+
+	// Errors that only the SAM saw push the selection down, and if the candidate below the fastest clean one has errors we don't change the speed
+	report.samBitErrors[1] = 1;
+	report.samBitErrors[2] = 5;
+	CHECK(SamCalibrateClock(CalibrationPatternLength, 1, report, results));
+	CHECK(results.numRuns == 1 && results.previousClockReg == CalibrationClockCandidates[2]);
+	CHECK(results.selected == 4 && SPI1CLK == CalibrationClockCandidates[4]);
+	memset(&report, 0, sizeof(report));
+	report.samBitErrors[2] = 1;
+	CHECK(SamCalibrateClock(CalibrationPatternLength, 1, report, results));
+	CHECK(results.selected == 0xFF && SPI1CLK == CalibrationClockCandidates[4]);
+	char errorText[100];
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetLastError, 0, 0, 0, nullptr, 0, errorText, sizeof(errorText)) > 0);
+
+	// A framed SAM may use 40MHz, but we still step down from it
+	SimSam::SetMaxCleanClockHz(0.0);
+	SimSam::SetFormatVersion(MyFramedFormatVersion);
+	memset(&report, 0, sizeof(report));
+	CHECK(SamCalibrateClock(CalibrationPatternLength, 2, report, results));
+	CHECK(results.entries[0].bitErrors == 0 && results.selected == 1 && SPI1CLK == CalibrationClockCandidates[1]);
+	SimSam::SetFormatVersion(MyFormatVersion);
+
+	// Longer patterns can be used once a larger block size has been negotiated, and the length must be a multiple of the basic pattern
+	CHECK(SamNegotiateBlockSize(MaxExtendedDataLength) == MaxExtendedDataLength);
+	SimSam::SetMaxCleanClockHz(25.0e6);
+	CHECK(SamCalibrateClock(2 * CalibrationPatternLength, 2, report, results));
+	CHECK(results.entries[3].bitErrors != 0 && results.entries[4].bitErrors == 0 && results.selected == 0xFF);
+	std::vector<uint8_t> buffer(MaxExtendedDataLength);
+	CHECK(SimSam::Transaction(NetworkCommand::networkCalibrateClock, 0, 0, 0, buffer.data(), 64, buffer.data(), buffer.size()) == ResponseBadDataLength);
+	CHECK(SimSam::Transaction(NetworkCommand::networkCalibrateClock, 0, 0, 0, buffer.data(), MaxClockCandidates * (CalibrationPatternLength + 4), buffer.data(), buffer.size())
+			== ResponseBadDataLength);
+	CHECK(SimSam::Transaction(NetworkCommand::networkCalibrateClock, 0, FlagCalibrationReport, 0, buffer.data(), 4, buffer.data(), buffer.size()) == ResponseBadDataLength);
+}
+
+static void TestStatistics()
+{
+	SimSam::Init();
+	std::vector<uint8_t> buffer(sizeof(StatisticsHeader) + 2 * sizeof(CommandStatistics));
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetStatistics, 0, FlagResetStatistics, 0, nullptr, 0, buffer.data(), buffer.size()) == (int32_t)buffer.size());
+	for (unsigned int i = 0; i < 5; ++i)
+	{
+		CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	}
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetStatistics, 0, 0, 0, nullptr, 0, buffer.data(), buffer.size()) == (int32_t)buffer.size());
+
+	const StatisticsHeader * const hdr = reinterpret_cast<const StatisticsHeader*>(buffer.data());
+	CHECK(hdr->firstCommand == 0 && hdr->numCommands == 2 && hdr->clockReg == SPI1CLK);
+	CHECK(hdr->numBuckets == NumLatencyBuckets && hdr->firstBucketLog2 == FirstLatencyBucketLog2);
+	const CommandStatistics * const nullStats = reinterpret_cast<const CommandStatistics*>(buffer.data() + sizeof(StatisticsHeader));
+	CHECK(nullStats->count == 5);
+	CHECK(nullStats->bytesIn >= 5 * sizeof(MessageHeaderSamToEsp) && nullStats->spiCycles != 0);
+	CHECK(nullStats->maxCycles != 0 && nullStats->totalCycles >= nullStats->maxCycles);
+	unsigned int histogramTotal = 0;
+	for (size_t i = 0; i < NumLatencyBuckets; ++i)
+	{
+		histogramTotal += nullStats->latency[i];
+	}
+	CHECK(histogramTotal == 5);
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetStatistics, 0, 0, 0, nullptr, 0, buffer.data(), 4) == ResponseBufferTooSmall);
+}
+
+static void TestDiagnostics()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40080);
+	const int socket = FindSocket(40080);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+	CHECK(SamWrite(socket, "diagnostics", 11, MessageHeaderSamToEsp::FlagPush) == 11);
+	SimNet::Send(client, "abc", 3);
+	SimSam::Idle(2);
+
+	DiagnosticsResponse diags;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &diags, sizeof(diags)) == (int32_t)sizeof(diags));
+	CHECK(diags.freeHeap == SimNet::FreeHeap() && diags.maxFreeBlock != 0 && diags.numConnections == MaxConnections);
+	CHECK(diags.loopCount != 0 && diags.maxLoopMicros >= diags.averageLoopMicros);
+	CHECK(diags.connections[socket].state == ConnState::connected && diags.connections[socket].remotePort == 40080);
+	CHECK(diags.connections[socket].remoteIp == 0x0A01A8C0 && diags.connections[socket].bytesAvailable == 3);
+	CHECK(diags.numPools == MEMP_MAX && diags.pbufPoolIndex == MEMP_PBUF_POOL);
+	CHECK(diags.pools[MEMP_TCP_SEG].avail == SimNet::MaxTcpSegments && diags.pools[MEMP_TCP_SEG].max != 0);
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &diags, 4) == ResponseBufferTooSmall);
+}
+
+static void TestTrafficCounters()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40090);
+	const int socket = FindSocket(40090);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+	SimNet::Send(client, "0123456789", 10);
+	SimSam::Idle(2);
+	char buffer[16];
+	CHECK(SamRead(socket, buffer, 4) == 4);
+	CHECK(SamWrite(socket, "abcdef", 6, MessageHeaderSamToEsp::FlagPush) == 6);
+	SimSam::Idle(2);
+
+	ExtendedConnStatusResponse resp;
+	CHECK(SimSam::Transaction(NetworkCommand::connGetStatus, socket, FlagExtendedStatus, 0, nullptr, 0, &resp, sizeof(resp)) == (int32_t)sizeof(resp));
+	CHECK(resp.status.state == ConnState::connected && resp.status.bytesAvailable == 6);
+	CHECK(resp.traffic.bytesReceived == 10 && resp.traffic.bytesRead == 4);
+	CHECK(resp.traffic.bytesWritten == 6 && resp.traffic.bytesAcked == 6 && resp.traffic.peakUnAcked == 6);
+	CHECK(resp.traffic.writeFailures == 0);
+	CHECK(resp.traffic.srttMillis == TCP_SLOW_INTERVAL && resp.traffic.retransmissions == 0);
+
+	// Without the flag, or without room for the extended response, we get the usual one
+	CHECK(SimSam::Transaction(NetworkCommand::connGetStatus, socket, 0, 0, nullptr, 0, &resp, sizeof(resp)) == (int32_t)sizeof(ConnStatusResponse));
+	CHECK(SimSam::Transaction(NetworkCommand::connGetStatus, socket, FlagExtendedStatus, 0, nullptr, 0, &resp, sizeof(ConnStatusResponse)) == (int32_t)sizeof(ConnStatusResponse));
+
+	SimNet::FailWrites(1);
+	SamWrite(socket, "x", 1, MessageHeaderSamToEsp::FlagPush);
+	SimSam::Idle(2 * MaxConnections);						// the data goes in the overflow buffer and is written when the connection is next polled
+	CHECK(SimSam::Transaction(NetworkCommand::connGetStatus, socket, FlagExtendedStatus, 0, nullptr, 0, &resp, sizeof(resp)) == (int32_t)sizeof(resp));
+	CHECK(resp.traffic.writeFailures == 1 && resp.traffic.bytesWritten == 7);
+}
+
+static void TestMemoryGovernor()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	DiagnosticsResponse before, after;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &before, sizeof(before)) == (int32_t)sizeof(before));
+
+	// Refuse connections when the heap is short
+	SimNet::SetFreeHeap(MinFreeHeapToAccept - 1000);
+	const int refused = SimNet::Connect(80, 0x0A01A8C0, 40200);
+	CHECK(SimNet::WasReset(refused));
+
+	// Hold back window updates when it is shorter still
+	SimNet::SetFreeHeap(SimNet::DefaultFreeHeap);
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40201);
+	const int socket = FindSocket(40201);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+	SimNet::SetFreeHeap(LowFreeHeap - 1000);
+	const std::string data(TCP_WND, 'm');
+	SimNet::Send(client, data.data(), 2000);
+	SimSam::Idle(2);
+	std::vector<uint8_t> buffer(TCP_WND);
+	CHECK(SamRead(socket, buffer.data(), buffer.size()) == 2000);
+	SimNet::Send(client, data.data(), data.size());
+	SimSam::Idle(2);
+	CHECK(SimNet::PendingToFirmware(client) == 2000);		// the window hasn't been opened again
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &after, sizeof(after)) == (int32_t)sizeof(after));
+	CHECK(after.refusedAccepts == before.refusedAccepts + 1);
+	CHECK(after.windowUpdatesHeld == before.windowUpdatesHeld + 1);
+
+	// Once memory recovers, the update is sent
+	SimNet::SetFreeHeap(SimNet::DefaultFreeHeap);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(SimNet::PendingToFirmware(client) == 0);
+}
+
+static void TestWriteOverflow()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client1 = SimNet::Connect(80, 0x0A01A8C0, 40210);
+	const int client2 = SimNet::Connect(80, 0x0A01A8C0, 40211);
+	const int socket1 = FindSocket(40210);
+	const int socket2 = FindSocket(40211);
+	CHECK(socket1 >= 0 && socket2 >= 0);
+	if (socket1 < 0 || socket2 < 0)
+	{
+		return;
+	}
+
+	// A write that lwIP can't queue is parked, and every socket sees backpressure until it has gone
+	SimNet::FailWrites(1);
+	const std::string data(100, 'o');
+	CHECK(SamWrite(socket1, data.data(), data.size(), MessageHeaderSamToEsp::FlagPush) == (int32_t)data.size());
+	ConnStatusResponse resp;
+	CHECK(SamGetConnStatus(socket1, resp) && resp.state == ConnState::connected && resp.writeBufferSpace == 0);
+	CHECK(SamGetConnStatus(socket2, resp) && resp.writeBufferSpace == 0);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(SimNet::Available(client1) == data.size());
+	CHECK(SamGetConnStatus(socket2, resp) && resp.writeBufferSpace != 0);
+
+	// If lwIP stays short of memory, the connection is terminated in the end
+	SimNet::FailWrites(1000);
+	CHECK(SamWrite(socket2, data.data(), data.size(), MessageHeaderSamToEsp::FlagPush) == (int32_t)data.size());
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(SimNet::IsConnected(client2));
+	SimCore::AdvanceMillis(3000);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(!SimNet::IsConnected(client2));
+	SimNet::FailWrites(0);
+	CHECK(SamGetConnStatus(socket1, resp) && resp.writeBufferSpace != 0);
+}
+
+static void TestOverflowAfterRemoteClose()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client1 = SimNet::Connect(80, 0x0A01A8C0, 40240);
+	const int client2 = SimNet::Connect(80, 0x0A01A8C0, 40241);
+	const int socket1 = FindSocket(40240);
+	const int socket2 = FindSocket(40241);
+	CHECK(socket1 >= 0 && socket2 >= 0);
+	if (socket1 < 0 || socket2 < 0)
+	{
+		return;
+	}
+
+	// The other end closing doesn't stop us sending, so the overflow buffer still drains and other sockets can write again
+	SimNet::FailWrites(1000);
+	const std::string data(100, 'h');
+	CHECK(SamWrite(socket1, data.data(), data.size(), MessageHeaderSamToEsp::FlagPush) == (int32_t)data.size());
+	SimNet::Close(client1);
+	SimSam::Idle(2 * MaxConnections);
+	ConnStatusResponse resp;
+	CHECK(SamGetConnStatus(socket1, resp) && resp.state == ConnState::otherEndClosed);
+	CHECK(SamGetConnStatus(socket2, resp) && resp.writeBufferSpace == 0);
+	SimNet::FailWrites(0);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(SimNet::Available(client1) == data.size());
+	CHECK(SamGetConnStatus(socket2, resp) && resp.writeBufferSpace != 0);
+
+	// If the SAM closes the socket while the overflow buffer is still full, it is sent before the FIN
+	SimNet::FailWrites(1000);
+	CHECK(SamWrite(socket2, data.data(), data.size(), MessageHeaderSamToEsp::FlagPush) == (int32_t)data.size());
+	SimNet::Close(client2);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(SimSam::Transaction(NetworkCommand::connClose, socket2, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(!SimNet::GotFin(client2));
+	SimNet::FailWrites(0);
+	SimSam::Idle(2 * MaxConnections);
+	CHECK(SimNet::Available(client2) == data.size());
+	SimSam::Idle(2 * MaxConnections);											// it takes more polls to see the acknowledgement and close
+	CHECK(SimNet::GotFin(client2));
+}
+
+static void TestWriteEstimate()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40220);
+	const int socket = FindSocket(40220);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+	DiagnosticsResponse before, after;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &before, sizeof(before)) == (int32_t)sizeof(before));
+
+	// With room on the heap for one full-sized pbuf, we can write one MSS
+	SimNet::SetFreeHeap(WriteHeapReserve + TxPbufAllocationSize + 100);
+	ConnStatusResponse resp;
+	CHECK(SamGetConnStatus(socket, resp) && resp.writeBufferSpace == TCP_MSS);
+	const std::string data(TCP_MSS, 'e');
+	CHECK(SamWrite(socket, data.data(), data.size(), MessageHeaderSamToEsp::FlagPush) == TCP_MSS);
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &after, sizeof(after)) == (int32_t)sizeof(after));
+	CHECK(after.writesAttempted == before.writesAttempted + 1 && after.writeEstimateFailures == before.writeEstimateFailures);
+	SimSam::Idle(2);
+	CHECK(SimNet::Available(client) == TCP_MSS);
+
+	// Without room for any, we can't write
+	SimNet::SetFreeHeap(WriteHeapReserve + 100);
+	CHECK(SamGetConnStatus(socket, resp) && resp.writeBufferSpace == 0);
+}
+
+static void TestWriteRounding()
+{
+	SimSam::Init();
+	CHECK(SamListen(80, protocolHTTP, 4));
+	const int client = SimNet::Connect(80, 0x0A01A8C0, 40230);
+	const int socket = FindSocket(40230);
+	CHECK(socket >= 0);
+	if (socket < 0)
+	{
+		return;
+	}
+	DiagnosticsResponse before, after;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &before, sizeof(before)) == (int32_t)sizeof(before));
+
+	// Make the memory governor see low memory, then let the heap recover a little but not past the hysteresis
+	SimNet::Send(client, "0123456789", 10);
+	SimSam::Idle(2);
+	SimNet::SetFreeHeap(LowFreeHeap - 1000);
+	char buffer[16];
+	CHECK(SamRead(socket, buffer, sizeof(buffer)) == 10);
+	SimNet::SetFreeHeap(LowFreeHeap + LowFreeHeapHysteresis - 500);
+
+	// Leave 1000 bytes unacknowledged, so the send buffer isn't a whole number of segments
+	const std::string data(MaxDataLength, 'r');
+	SimNet::HoldAcks(client, true);
+	CHECK(SamWrite(socket, data.data(), 1000, 0) == 1000);
+	CHECK(SamWrite(socket, data.data(), MaxDataLength, MessageHeaderSamToEsp::FlagPush) == TCP_MSS);
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetDiagnostics, 0, 0, 0, nullptr, 0, &after, sizeof(after)) == (int32_t)sizeof(after));
+	CHECK(after.writesRounded == before.writesRounded + 1);
+	CHECK(after.bytesDeferredByRounding == before.bytesDeferredByRounding + (TCP_SND_BUF - 1000 - TCP_MSS));
+	SimNet::HoldAcks(client, false);
+	SimSam::Idle(2);
+	CHECK(SimNet::Available(client) == 1000 + TCP_MSS);
+}
+
+static void TestNetworkScan()
+{
+	SimSam::Init();
+	SimCore::SetNetworks(
+	{
+		{ "weak", { 1, 2, 3, 4, 5, 6 }, -80, 1, 3, false },
+		{ "home", { 1, 2, 3, 4, 5, 7 }, -60, 6, 3, false },
+		{ "strong", { 1, 2, 3, 4, 5, 8 }, -40, 11, 4, true }
+	});
+	WiFiScanResponse resp;
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, 0, 0, nullptr, 0, &resp, sizeof(resp)) == 8);
+	CHECK(resp.valid == 0);
+
+	// Start a scan and wait for it
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, FlagStartScan, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, 0, 0, nullptr, 0, &resp, sizeof(resp)) == ResponseBusy);
+	CHECK(SimCore::CompleteScan());
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, 0, 0, nullptr, 0, &resp, 8) == ResponseBufferTooSmall);
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, 0, 0, nullptr, 0, &resp, sizeof(resp)) == (int32_t)(8 + 3 * sizeof(WiFiScanEntry)));
+	CHECK(resp.valid == 1 && resp.numNetworks == 3 && resp.totalNetworks == 3);
+	CHECK(strcmp(resp.networks[0].ssid, "strong") == 0 && resp.networks[0].rssi == -40 && resp.networks[0].channel == 11);
+	CHECK(resp.networks[0].bssid[5] == 8 && resp.networks[0].authMode == 4 && resp.networks[0].hidden == 1);
+	CHECK(strcmp(resp.networks[1].ssid, "home") == 0 && strcmp(resp.networks[2].ssid, "weak") == 0);
+
+	// Connecting to the strongest known network scans in the background, then connects to the strongest one that we have details of
+	WirelessConfigurationData config;
+	memset(&config, 0, sizeof(config));
+	strcpy(config.ssid, "home");
+	strcpy(config.password, "password");
+	CHECK(SimSam::Transaction(NetworkCommand::networkAddSsid, 0, 0, 0, &config, sizeof(config), nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkStartClient, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, 0, 0, nullptr, 0, &resp, sizeof(resp)) == ResponseBusy);
+	CHECK(SimSam::GetReplyState() == WiFiState::connecting);
+	CHECK(SimCore::CompleteScan());
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+
+	// A scan can be started while we are connected, but a failed scan leaves no results
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, FlagStartScan, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SimCore::CompleteScan(-1));
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, 0, 0, nullptr, 0, &resp, sizeof(resp)) == 8);
+	CHECK(resp.valid == 0);
+
+	// The SDK doesn't terminate an SSID that fills its record
+	const std::string longSsid(SsidLength, 'L');
+	SimCore::SetNetworks({ { longSsid, { 1, 2, 3, 4, 5, 9 }, -50, 1, 0, false } });
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, FlagStartScan, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SimCore::CompleteScan());
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkScan, 0, 0, 0, nullptr, 0, &resp, sizeof(resp)) == (int32_t)(8 + sizeof(WiFiScanEntry)));
+	CHECK(memcmp(resp.networks[0].ssid, longSsid.data(), SsidLength) == 0 && resp.networks[0].authMode == 0);
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkStop, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+}
+
+static void SamStartClient(const char *ssid)
+{
+	CHECK(SimSam::Transaction(NetworkCommand::networkStartClient, 0, 0, 0, ssid, strlen(ssid) + 1, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+}
+
+static void TestFastReconnect()
+{
+	SimSam::Init();
+	SimCore::SetNetworks({ { "fast", { 2, 2, 2, 2, 2, 2 }, -50, 3, 3, false } });
+	WirelessConfigurationData config;
+	memset(&config, 0, sizeof(config));
+	strcpy(config.ssid, "fast");
+	strcpy(config.password, "password");
+	CHECK(SimSam::Transaction(NetworkCommand::networkAddSsid, 0, 0, 0, &config, sizeof(config), nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	ConnectLogResponse before, after;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetConnectLog, 0, 0, 0, nullptr, 0, &before, sizeof(before)) > 0);
+
+	// The first connection has to scan, and the next one goes straight to the same access point
+	SamStartClient("fast");
+	CHECK(!SimCore::LastBeginWasDirected());
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(SimSam::Transaction(NetworkCommand::networkStop, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	const uint32_t erases = SimFlash::GetErases();
+	SamStartClient("fast");
+	CHECK(SimCore::LastBeginWasDirected());
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(SimFlash::GetErases() == erases);									// nothing changed, so nothing was saved
+	CHECK(SimSam::Transaction(NetworkCommand::networkStop, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+
+	// A new DHCP lease from the same access point doesn't need writing to flash either
+	const uint32_t writes = SimFlash::GetWrites();
+	SimCore::SetDhcpHostNumber(51);
+	SamStartClient("fast");
+	CHECK(SimCore::LastBeginWasDirected());
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(SimFlash::GetWrites() == writes);
+	CHECK(SimSam::Transaction(NetworkCommand::networkStop, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+
+	// If the access point has moved channel then the directed connection fails and we fall back to scanning
+	SimCore::SetNetworks({ { "fast", { 2, 2, 2, 2, 2, 2 }, -50, 9, 3, false } });
+	SamStartClient("fast");
+	SimSam::Idle(2);
+	CHECK(!SimCore::LastBeginWasDirected());
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(SimSam::Transaction(NetworkCommand::networkStop, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+
+	const int32_t length = SimSam::Transaction(NetworkCommand::networkGetConnectLog, 0, 0, 0, nullptr, 0, &after, sizeof(after));
+	CHECK(length == (int32_t)(sizeof(ConnectLogResponse) - (MaxConnectAttemptRecords - after.numRecords) * sizeof(ConnectAttemptRecord)));
+	CHECK(after.totalAttempts == before.totalAttempts + 5);
+	if (after.numRecords >= 5)
+	{
+		const ConnectAttemptRecord * const rec = &after.records[after.numRecords - 5];
+		CHECK(rec[0].type == ConnectAttemptType::fullScan && rec[0].status == STATION_GOT_IP && rec[0].channel == 3);
+		CHECK(rec[1].type == ConnectAttemptType::directed && rec[1].status == STATION_GOT_IP && rec[1].channel == 3);
+		CHECK(rec[2].type == ConnectAttemptType::directed && rec[2].status == STATION_GOT_IP && rec[2].channel == 3);
+		CHECK(rec[3].type == ConnectAttemptType::directed && rec[3].status == STATION_NO_AP_FOUND);
+		CHECK(rec[4].type == ConnectAttemptType::fullScan && rec[4].status == STATION_GOT_IP && rec[4].channel == 9);
+	}
+	else
+	{
+		CHECK(after.numRecords >= 5);
+	}
+
+	// Deleting the network forgets its access point
+	CHECK(SimSam::Transaction(NetworkCommand::networkDeleteSsid, 0, 0, 0, config.ssid, SsidLength, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkAddSsid, 0, 0, 0, &config, sizeof(config), nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	SamStartClient("fast");
+	CHECK(!SimCore::LastBeginWasDirected());
+	CHECK(SimSam::Transaction(NetworkCommand::networkStop, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+}
+
+static void TestFastBoot()
+{
+	SimSam::Init();
+	SimCore::SetNetworks({ { "boot", { 3, 3, 3, 3, 3, 3 }, -50, 1, 3, false } });
+	WirelessConfigurationData config;
+	memset(&config, 0, sizeof(config));
+	strcpy(config.ssid, "boot");
+	strcpy(config.password, "password");
+	CHECK(SimSam::Transaction(NetworkCommand::networkAddSsid, 0, 0, 0, &config, sizeof(config), nullptr, 0) == ResponseEmpty);
+	CHECK(SimSam::Transaction(NetworkCommand::networkSetFastBoot, 0, FlagFastBoot, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	SamStartClient("boot");
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(SimCore::IsDhcpActive());
+	BootTimesResponse times;
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetBootTimes, 0, 0, 0, nullptr, 0, &times, sizeof(times)) == (int32_t)sizeof(times));
+	CHECK(times.fastBoot == 1);
+
+	// After a reset we connect to the same network without being asked, reusing the DHCP lease
+	SimSam::Init();
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetBootTimes, 0, 0, 0, nullptr, 0, &times, sizeof(times)) == (int32_t)sizeof(times));
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(times.fastBootConnect == 1 && times.leaseReused == 1 && times.resetReason == 6);
+	CHECK(times.setupStartMillis <= times.spiReadyMillis);
+	CHECK(!SimCore::IsDhcpActive());
+
+	// The SAM asking for the same network doesn't disturb the connection
+	SamStartClient("boot");
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(!SimCore::IsDhcpActive());
+
+	// After a power cycle the lease has gone, so we use DHCP
+	SimCore::ClearRtcMemory();
+	SimCore::SetResetReason(0);
+	SimSam::Init();
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetBootTimes, 0, 0, 0, nullptr, 0, &times, sizeof(times)) == (int32_t)sizeof(times));
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+	CHECK(times.leaseReused == 0 && times.resetReason == 0);
+	CHECK(SimCore::IsDhcpActive());
+	SimCore::SetResetReason(6);
+
+	// If the fast boot connection fails then we are idle again, so when the SAM asks for the same network we have another go
+	SimSam::Init();
+	SimCore::SetStationStatus(STATION_WRONG_PASSWORD);
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::nullCommand, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	CHECK(SimSam::GetReplyState() == WiFiState::idle);
+	SimCore::SetStationStatus(STATION_GOT_IP);
+	SamStartClient("boot");
+	CHECK(SimSam::GetReplyState() == WiFiState::connected);
+
+	// With fast boot turned off we wait for the SAM
+	CHECK(SimSam::Transaction(NetworkCommand::networkSetFastBoot, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	SimSam::Init();
+	SimSam::Idle(2);
+	CHECK(SimSam::Transaction(NetworkCommand::networkGetBootTimes, 0, 0, 0, nullptr, 0, &times, sizeof(times)) == (int32_t)sizeof(times));
+	CHECK(SimSam::GetReplyState() == WiFiState::idle);
+	CHECK(times.fastBoot == 0);
+}
+
+static void SamAddSsid(const char *ssid, const char *password)
+{
+	WirelessConfigurationData config;
+	memset(&config, 0, sizeof(config));
+	memcpy(config.ssid, ssid, strnlen(ssid, sizeof(config.ssid)));
+	memcpy(config.password, password, strnlen(password, sizeof(config.password)));
+	CHECK(SimSam::Transaction(NetworkCommand::networkAddSsid, 0, 0, 0, &config, sizeof(config), nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+}
+
+static std::string SamGetLastError()
+{
+	char buffer[MaxDataLength];
+	const int32_t length = SimSam::Transaction(NetworkCommand::networkGetLastError, 0, 0, 0, nullptr, 0, buffer, sizeof(buffer));
+	return (length > 0) ? std::string(buffer, strnlen(buffer, length)) : std::string();
+}
+
+// Return the slot that holds an SSID, from what the ESP lists
+static int SamFindSsid(const char *ssid)
+{
+	std::vector<uint8_t> buffer((MaxRememberedNetworks + 1) * ReducedWirelessConfigurationDataSize);
+	const int32_t length = SimSam::Transaction(NetworkCommand::networkRetrieveSsidData, 0, 0, 0, nullptr, 0, buffer.data(), buffer.size());
+	for (int32_t i = 0; (i + 1) * (int32_t)ReducedWirelessConfigurationDataSize <= length; ++i)
+	{
+		const WirelessConfigurationData * const wp = reinterpret_cast<const WirelessConfigurationData*>(buffer.data() + i * ReducedWirelessConfigurationDataSize);
+		if (strncmp(wp->ssid, ssid, SsidLength) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void TestSsidIndex()
+{
+	// The index on its own
+	SsidIndex::Init();
+	CHECK(SsidIndex::FindFree() == 1);
+	SsidIndex::Set(1, "alpha");
+	SsidIndex::Set(2, "beta");
+	CHECK(SsidIndex::Find("alpha") == 1 && SsidIndex::Find("beta") == 2 && SsidIndex::Find("gamma") == -1);
+	CHECK(SsidIndex::FindFree() == 3);
+	SsidIndex::Clear(1);
+	CHECK(SsidIndex::Find("alpha") == -1 && SsidIndex::Find("beta") == 2);
+	CHECK(SsidIndex::FindFree() == 1);
+	SsidIndex::Set(2, "gamma");
+	CHECK(SsidIndex::Find("beta") == -1 && SsidIndex::Find("gamma") == 2);
+	char ssid[SsidLength];
+	for (size_t slot = 1; slot <= MaxRememberedNetworks; ++slot)
+	{
+		snprintf(ssid, sizeof(ssid), "net%u", (unsigned int)slot);
+		SsidIndex::Set(slot, ssid);
+	}
+	CHECK(SsidIndex::FindFree() == -1);
+	bool allFound = true;
+	for (size_t slot = 1; slot <= MaxRememberedNetworks; ++slot)
+	{
+		snprintf(ssid, sizeof(ssid), "net%u", (unsigned int)slot);
+		allFound = allFound && SsidIndex::Find(ssid) == (int)slot;
+	}
+	CHECK(allFound);
+
+	// The firmware builds the index from the table in flash and keeps it up to date
+	SimSam::Init();
+	CHECK(SimSam::Transaction(NetworkCommand::networkFactoryReset, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	for (size_t i = 1; i <= MaxRememberedNetworks; ++i)
+	{
+		snprintf(ssid, sizeof(ssid), "net%u", (unsigned int)i);
+		SamAddSsid(ssid, "password");
+	}
+	CHECK(SamGetLastError().empty());
+	SamAddSsid("extra", "password");
+	CHECK(SamGetLastError() == "SSID table full");
+	CHECK(SamFindSsid("net3") == 3);
+
+	char deleteSsid[SsidLength] = "net3";
+	CHECK(SimSam::Transaction(NetworkCommand::networkDeleteSsid, 0, 0, 0, deleteSsid, SsidLength, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SamFindSsid("net3") == -1);
+	SamAddSsid("extra", "password");
+	CHECK(SamFindSsid("extra") == 3);
+	SamAddSsid("net5", "changed");											// replaces the existing entry
+	CHECK(SamGetLastError().empty());
+
+	SimSam::Init();
+	strcpy(deleteSsid, "net7");
+	CHECK(SimSam::Transaction(NetworkCommand::networkDeleteSsid, 0, 0, 0, deleteSsid, SsidLength, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+	CHECK(SamGetLastError().empty());
+	CHECK(SamFindSsid("net7") == -1 && SamFindSsid("extra") == 3);
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkFactoryReset, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+}
+
+static void TestCredentialStore()
+{
+	// The first time we run, the settings are migrated from the EEPROM sector, which is then left alone
+	SimFlash::EraseAll();
+	uint8_t * const eeprom = SimFlash::flash + SimFlash::EepromSector * SPI_FLASH_SEC_SIZE;
+	WirelessConfigurationData legacy;
+	memset(&legacy, 0, sizeof(legacy));
+	strcpy(legacy.ssid, "legacy");
+	memcpy(eeprom + sizeof(WirelessConfigurationData), &legacy, sizeof(legacy));
+	const std::vector<uint8_t> eepromBefore(eeprom, eeprom + SPI_FLASH_SEC_SIZE);
+	SimSam::Init();
+	CHECK(SamFindSsid("legacy") == 1);
+	SamAddSsid("first", "password");
+	CHECK(std::vector<uint8_t>(eeprom, eeprom + SPI_FLASH_SEC_SIZE) == eepromBefore);
+
+	// Small changes are appended to the journal, so they rarely need an erase. With fast boot on, each new host name is saved.
+	SamAddSsid("wear", "password");
+	CHECK(SimSam::Transaction(NetworkCommand::networkSetFastBoot, 0, FlagFastBoot, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	const uint32_t erases = SimFlash::GetErases();
+	const unsigned int numChanges = 100;
+	for (unsigned int i = 0; i < numChanges; ++i)
+	{
+		char hostName[HostNameLength];
+		memset(hostName, 0, sizeof(hostName));
+		snprintf(hostName, sizeof(hostName), "duet%u", i);
+		CHECK(SimSam::Transaction(NetworkCommand::networkSetHostName, 0, 0, 0, hostName, sizeof(hostName), nullptr, 0) == ResponseEmpty);
+	}
+	CHECK(SimFlash::GetErases() - erases <= numChanges/10);
+	CHECK(SimSam::Transaction(NetworkCommand::networkSetFastBoot, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+
+	// Adding or deleting a network changes its entry and its fast connect data, which are far apart but are journalled separately
+	const uint32_t churnErases = SimFlash::GetErases();
+	const unsigned int numChurns = 40;
+	char churnSsid[SsidLength];
+	memset(churnSsid, 0, sizeof(churnSsid));
+	strcpy(churnSsid, "churn");
+	for (unsigned int i = 0; i < numChurns; ++i)
+	{
+		SamAddSsid("churn", "password");
+		CHECK(SimSam::Transaction(NetworkCommand::networkDeleteSsid, 0, 0, 0, churnSsid, sizeof(churnSsid), nullptr, 0) == ResponseEmpty);
+		SimSam::Idle(2);
+	}
+	CHECK(SimFlash::GetErases() - churnErases <= numChurns/2);
+	SimSam::Init();
+	CHECK(SamFindSsid("legacy") == 1 && SamFindSsid("first") >= 0 && SamFindSsid("wear") >= 0 && SamFindSsid("churn") == -1);
+
+	// A change that was interrupted by a reset is lost, but nothing else is
+	SimFlash::FailWritesAfter(1);											// the record header is written but not its data
+	SamAddSsid("torn", "password");
+	SimFlash::FailWritesAfter(-1);
+	SimSam::Init();
+	CHECK(SamFindSsid("torn") == -1);
+	CHECK(SamFindSsid("legacy") == 1 && SamFindSsid("first") >= 0 && SamFindSsid("wear") >= 0);
+	SamAddSsid("after", "password");
+	SimSam::Init();
+	CHECK(SamFindSsid("after") >= 0 && SamFindSsid("wear") >= 0);
+
+	// Adding a network writes its entry and its fast connect data as separate records of one commit. If the commit is interrupted after the
+	// first record, none of it is applied.
+	SimFlash::FailWritesAfter(2);											// the first record is written, then the second one's header fails
+	SamAddSsid("half", "password");
+	SimFlash::FailWritesAfter(-1);
+	SimSam::Init();
+	CHECK(SamFindSsid("half") == -1);
+	CHECK(SamFindSsid("after") >= 0 && SamFindSsid("wear") >= 0);
+	SamAddSsid("whole", "password");
+	SimSam::Init();
+	CHECK(SamFindSsid("whole") >= 0 && SamFindSsid("after") >= 0);
+
+	CHECK(SimSam::Transaction(NetworkCommand::networkFactoryReset, 0, 0, 0, nullptr, 0, nullptr, 0) == ResponseEmpty);
+	SimSam::Idle(2);
+}
+
+static void TestListenLimits()
+{
+	SimSam::Init();
+	CHECK(SamListen(23, protocolTelnet, 1));
+	const int client1 = SimNet::Connect(23, 0x0A01A8C0, 40010);
+	const int client2 = SimNet::Connect(23, 0x0A01A8C0, 40011);
+	CHECK(SimNet::IsConnected(client1));
+	CHECK(SimNet::WasReset(client2));						// only one connection allowed on this port
+
+	const int client3 = SimNet::Connect(21, 0x0A01A8C0, 40012);
+	CHECK(SimNet::WasReset(client3));						// nothing listening on this port
+
+	CHECK(SamListen(23, protocolTelnet, 0));				// stop listening
+	CHECK(SimNet::NumListeners() == 0);
+}
+
+void RunTests()
+{
+	TestRequestHeaders();
+	TestEcho();
+	TestCloseAndAbort();
+	TestReadMulti();
+	TestWriteMulti();
+	TestBlockSize();
+	TestAllStatus();
+	TestEvents();
+	TestFraming();
+	TestClockCalibration();
+	TestStatistics();
+	TestDiagnostics();
+	TestTrafficCounters();
+	TestMemoryGovernor();
+	TestWriteOverflow();
+	TestOverflowAfterRemoteClose();
+	TestWriteEstimate();
+	TestWriteRounding();
+	TestNetworkScan();
+	TestFastReconnect();
+	TestFastBoot();
+	TestSsidIndex();
+	TestCredentialStore();
+	TestListenLimits();
+}
+
+// End
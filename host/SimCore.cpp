@@ -0,0 +1,700 @@
+/*
+ * SimCore.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-ins for the Arduino core, the ESP8266 SDK, the WiFi and EEPROM libraries and the flash chip
+ */
+
+#include "SimCore.h"
+#include "SimNet.h"
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <EEPROM.h>
+#include <chrono>
+#include <cassert>
+
+extern "C"
+{
+	#include "user_interface.h"
+	#include "spi_flash.h"
+	#include "lwip/stats.h"
+	#include "lwip/dhcp.h"
+}
+
+namespace
+{
+	const size_t NumPins = 17;
+
+	struct PinData
+	{
+		uint8_t level;
+		uint8_t mode;
+		uint32_t risingEdges;
+		void (*isr)(void);
+		int isrMode;
+	};
+
+	PinData pins[NumPins];
+	SimCore::PinWriteHook pinWriteHook = nullptr;
+	uint64_t millisOffset = 0;
+	bool verbose = false;
+	uint8_t stationStatus = STATION_GOT_IP;
+	bool stationStarted = false;
+	std::vector<SimCore::Network> networks;			// what a scan finds
+	std::vector<SimCore::Network> scanResults;		// what the last scan found, until the firmware deletes them
+	std::vector<bss_info> scanInfo;					// the same in the form the SDK keeps them
+	std::function<void(int)> scanCallback;			// set while an asynchronous scan is running
+	SimCore::Network accessPoint;					// the access point that the station is connecting or connected to
+	bool directedBegin = false;						// WiFi.begin was given a channel and BSSID
+	bool directedMiss = false;						// ...and there is no such access point
+	bool dhcpActive = false;						// the station got its address from DHCP
+	uint8_t dhcpHostNumber = 50;					// the last byte of the address that the DHCP server gives the station
+	bool stationEventsSent = false;					// the connected and got IP events have been sent since WiFi.begin was called
+	struct rst_info resetInfo = { 6, 0, 0, 0, 0, 0, 0 };	// external reset
+	uint32_t rtcMemory[128];						// RTC user memory, which survives a reset but not a power cycle
+
+	// Choose the access point that WiFi.begin would connect to, i.e. the one asked for or else the strongest with the SSID
+	void ChooseAccessPoint(const char *ssid, int32_t channel, const uint8_t *bssid)
+	{
+		memset(accessPoint.bssid, 0, sizeof(accessPoint.bssid));
+		accessPoint.channel = 0;
+		directedBegin = (bssid != nullptr);
+		directedMiss = false;
+		bool found = false;
+		for (const SimCore::Network& n : networks)
+		{
+			if (n.ssid == ssid)
+			{
+				if (directedBegin)
+				{
+					if (n.channel == channel && memcmp(n.bssid, bssid, sizeof(n.bssid)) == 0)
+					{
+						accessPoint = n;
+						found = true;
+					}
+				}
+				else if (!found || n.rssi > accessPoint.rssi)
+				{
+					accessPoint = n;
+					found = true;
+				}
+			}
+		}
+		directedMiss = directedBegin && !found;
+	}
+
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	uint64_t ElapsedNanos()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count() + millisOffset * 1000000;
+	}
+
+	uint64_t ElapsedMicros()
+	{
+		return ElapsedNanos()/1000;
+	}
+
+	int writesBeforeFailure = -1;
+	uint32_t erases = 0;
+	uint32_t writes = 0;
+	uint32_t bytesWritten = 0;
+}
+
+namespace SimCore
+{
+	void Init()
+	{
+		memset(pins, 0, sizeof(pins));
+		pinWriteHook = nullptr;
+		stationStatus = STATION_GOT_IP;
+		stationStarted = false;
+		networks.clear();
+		scanResults.clear();
+		scanCallback = nullptr;
+		accessPoint = SimCore::Network();
+		directedBegin = directedMiss = false;
+		dhcpActive = stationEventsSent = false;
+		dhcpHostNumber = 50;
+		hostInterruptsDisabled = 0;
+	}
+
+	void SetPinWriteHook(PinWriteHook hook)
+	{
+		pinWriteHook = hook;
+	}
+
+	void SetInputPin(uint8_t pin, uint8_t level)
+	{
+		assert(pin < NumPins);
+		PinData& p = pins[pin];
+		const bool changed = (level != p.level);
+		p.level = level;
+		if (changed && p.isr != nullptr && (p.isrMode == CHANGE || (p.isrMode == RISING && level == HIGH) || (p.isrMode == FALLING && level == LOW)))
+		{
+			p.isr();
+		}
+	}
+
+	uint8_t GetPin(uint8_t pin)
+	{
+		assert(pin < NumPins);
+		return pins[pin].level;
+	}
+
+	uint32_t NumRisingEdges(uint8_t pin)
+	{
+		assert(pin < NumPins);
+		return pins[pin].risingEdges;
+	}
+
+	void AdvanceMillis(uint32_t ms)
+	{
+		millisOffset += ms;
+	}
+
+	void SetVerbose(bool on)
+	{
+		verbose = on;
+	}
+
+	void SetStationStatus(uint8_t status)
+	{
+		stationStatus = status;
+	}
+
+	void SetNetworks(const std::vector<Network>& nets)
+	{
+		networks = nets;
+	}
+
+	bool CompleteScan(int result)
+	{
+		if (!scanCallback)
+		{
+			return false;
+		}
+		const std::function<void(int)> callback = scanCallback;
+		scanCallback = nullptr;
+		if (result >= 0)
+		{
+			scanResults = networks;
+			result = (int)scanResults.size();
+		}
+		callback(result);
+		return true;
+	}
+
+	bool LastBeginWasDirected()
+	{
+		return directedBegin;
+	}
+
+	bool IsDhcpActive()
+	{
+		return dhcpActive;
+	}
+
+	void SetDhcpHostNumber(uint8_t hostNumber)
+	{
+		dhcpHostNumber = hostNumber;
+	}
+
+	void SetResetReason(uint32_t reason)
+	{
+		resetInfo.reason = reason;
+	}
+
+	void ClearRtcMemory()
+	{
+		memset(rtcMemory, 0, sizeof(rtcMemory));
+	}
+
+	void Process()
+	{
+		if (!stationEventsSent && wifi_station_get_connect_status() == STATION_GOT_IP)
+		{
+			stationEventsSent = true;
+			WiFi.SendStationEvents();
+		}
+	}
+}
+
+// Arduino core
+
+int hostInterruptsDisabled = 0;
+HardwareSerial Serial;
+EspClass ESP;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+	assert(pin < NumPins);
+	pins[pin].mode = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+	assert(pin < NumPins);
+	PinData& p = pins[pin];
+	if (val != LOW && p.level == LOW)
+	{
+		++p.risingEdges;
+	}
+	p.level = (val != LOW) ? HIGH : LOW;
+	if (pinWriteHook != nullptr)
+	{
+		pinWriteHook(pin, p.level);
+	}
+}
+
+int digitalRead(uint8_t pin)
+{
+	assert(pin < NumPins);
+	return pins[pin].level;
+}
+
+void attachInterrupt(uint8_t pin, void (*userFunc)(void), int mode)
+{
+	assert(pin < NumPins);
+	pins[pin].isr = userFunc;
+	pins[pin].isrMode = mode;
+}
+
+unsigned long millis()
+{
+	return (unsigned long)(uint32_t)(ElapsedMicros()/1000);
+}
+
+unsigned long micros()
+{
+	return (unsigned long)(uint32_t)ElapsedMicros();
+}
+
+void delay(unsigned long ms)
+{
+	millisOffset += ms;						// the simulation has nothing to wait for
+}
+
+void delayMicroseconds(unsigned int us)
+{
+}
+
+void noInterrupts()
+{
+	++hostInterruptsDisabled;
+}
+
+void interrupts()
+{
+	assert(hostInterruptsDisabled > 0);
+	--hostInterruptsDisabled;
+}
+
+int ets_printf(const char *fmt, ...)
+{
+	if (!verbose)
+	{
+		return 0;
+	}
+	va_list vargs;
+	va_start(vargs, fmt);
+	const int ret = vprintf(fmt, vargs);
+	va_end(vargs);
+	return ret;
+}
+
+void stats_display(void)
+{
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+	return system_get_free_heap_size();
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+{
+	if (offset * sizeof(uint32_t) + size > sizeof(rtcMemory))
+	{
+		return false;
+	}
+	memcpy(data, &rtcMemory[offset], size);
+	return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+{
+	if (offset * sizeof(uint32_t) + size > sizeof(rtcMemory))
+	{
+		return false;
+	}
+	memcpy(&rtcMemory[offset], data, size);
+	return true;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+	return (uint32_t)(ElapsedNanos() * 80/1000);	// 80MHz CPU clock
+}
+
+// ESP8266 SDK
+
+struct rst_info *system_get_rst_info(void) { return &resetInfo; }
+uint32 system_get_free_heap_size(void) { return SimNet::FreeHeap(); }
+uint16 system_get_vdd33(void) { return 3300; }
+void system_phy_set_max_tpw(uint8 max_tpw) { }
+void system_soft_wdt_feed(void) { }
+
+bool wifi_get_macaddr(uint8 if_index, uint8 *macaddr)
+{
+	static const uint8 mac[6] = { 0x5C, 0xCF, 0x7F, 0x00, 0x00, 0x01 };
+	memcpy(macaddr, mac, sizeof(mac));
+	macaddr[5] += if_index;
+	return true;
+}
+
+enum phy_mode wifi_get_phy_mode(void) { return PHY_MODE_11N; }
+enum sleep_type wifi_get_sleep_type(void) { return MODEM_SLEEP_T; }
+bool wifi_set_sleep_type(enum sleep_type type) { return true; }
+uint8 wifi_softap_get_station_num(void) { return 0; }
+uint8 wifi_station_get_connect_status(void) { return (!stationStarted) ? STATION_IDLE : (directedMiss) ? STATION_NO_AP_FOUND : stationStatus; }
+bool wifi_station_disconnect(void) { stationStarted = false; return true; }
+enum dhcp_status wifi_station_dhcpc_status(void) { return (dhcpActive) ? DHCP_STARTED : DHCP_STOPPED; }
+
+struct dhcp *netif_dhcp_data(struct netif *netif)
+{
+	static struct dhcp dhcpData = { SimCore::DhcpLeaseSeconds };
+	return (netif == netif_list && dhcpActive) ? &dhcpData : nullptr;
+}
+sint8 wifi_station_get_rssi(void) { return -50; }
+bool wifi_station_set_hostname(char *name) { return true; }
+
+// WiFi library
+
+ESP8266WiFiClass WiFi;
+
+bool ESP8266WiFiClass::mode(WiFiMode_t m)
+{
+	currentMode = m;
+	if (m != WIFI_STA && m != WIFI_AP_STA)
+	{
+		stationStarted = false;
+		staIp = IPAddress();
+	}
+	return true;
+}
+
+bool ESP8266WiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2)
+{
+	staIp = local_ip;
+	staGateway = gateway;
+	staNetmask = subnet;
+	staDns = dns1;
+	if ((uint32_t)local_ip == 0 && stationStarted && !dhcpActive)
+	{
+		// Going back to DHCP while connected gets a new lease
+		AssignDhcpAddress();
+		stationEventsSent = false;
+	}
+	return true;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *passphrase, int32_t channel, const uint8_t *bssid, bool connect)
+{
+	stationStarted = true;
+	stationEventsSent = false;
+	ChooseAccessPoint(ssid, channel, bssid);
+	dhcpActive = ((uint32_t)staIp == 0);
+	if (dhcpActive)
+	{
+		AssignDhcpAddress();
+	}
+	return status();
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifioff)
+{
+	stationStarted = false;
+	return true;
+}
+
+void ESP8266WiFiClass::AssignDhcpAddress()
+{
+	dhcpActive = true;
+	staIp = IPAddress(192, 168, 1, dhcpHostNumber);
+	staGateway = IPAddress(192, 168, 1, 1);
+	staNetmask = IPAddress(255, 255, 255, 0);
+	staDns = staGateway;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeConnected(std::function<void(const WiFiEventStationModeConnected&)> f)
+{
+	WiFiEventHandler handler = std::make_shared<WiFiEventHandlerOpaque>();
+	handler->onConnected = f;
+	eventHandlers.push_back(handler);
+	return handler;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)> f)
+{
+	WiFiEventHandler handler = std::make_shared<WiFiEventHandlerOpaque>();
+	handler->onGotIp = f;
+	eventHandlers.push_back(handler);
+	return handler;
+}
+
+void ESP8266WiFiClass::SendStationEvents()
+{
+	WiFiEventStationModeConnected connected;
+	connected.ssid = String(accessPoint.ssid.c_str());
+	memcpy(connected.bssid, accessPoint.bssid, sizeof(connected.bssid));
+	connected.channel = accessPoint.channel;
+	WiFiEventStationModeGotIP gotIp;
+	gotIp.ip = staIp;
+	gotIp.mask = staNetmask;
+	gotIp.gw = staGateway;
+
+	// Drop the handlers that the firmware has released
+	std::vector<WiFiEventHandler> handlers;
+	for (const std::weak_ptr<WiFiEventHandlerOpaque>& wp : eventHandlers)
+	{
+		if (WiFiEventHandler h = wp.lock())
+		{
+			handlers.push_back(h);
+		}
+	}
+	eventHandlers.assign(handlers.begin(), handlers.end());
+
+	for (const WiFiEventHandler& h : handlers)
+	{
+		if (h->onConnected)
+		{
+			h->onConnected(connected);
+		}
+	}
+	for (const WiFiEventHandler& h : handlers)
+	{
+		if (h->onGotIp)
+		{
+			h->onGotIp(gotIp);
+		}
+	}
+}
+
+uint8_t *ESP8266WiFiClass::BSSID()
+{
+	return accessPoint.bssid;
+}
+
+int32_t ESP8266WiFiClass::channel() const
+{
+	return accessPoint.channel;
+}
+
+wl_status_t ESP8266WiFiClass::status()
+{
+	return (wifi_station_get_connect_status() == STATION_GOT_IP) ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool ESP8266WiFiClass::softAPConfig(IPAddress local_ip, IPAddress gateway, IPAddress subnet)
+{
+	apIp = local_ip;
+	return true;
+}
+
+bool ESP8266WiFiClass::softAP(const char *ssid, const char *passphrase, int channel, int ssid_hidden, int max_connection)
+{
+	return true;
+}
+
+bool ESP8266WiFiClass::softAPdisconnect(bool wifioff)
+{
+	apIp = IPAddress();
+	return true;
+}
+
+int8_t ESP8266WiFiClass::scanNetworks(bool async, bool show_hidden)
+{
+	scanResults = networks;
+	return (int8_t)scanResults.size();
+}
+
+// The scan completes when a test calls SimCore::CompleteScan
+void ESP8266WiFiClass::scanNetworksAsync(std::function<void(int)> onComplete, bool show_hidden)
+{
+	scanCallback = onComplete;
+}
+
+void ESP8266WiFiClass::scanDelete()
+{
+	scanResults.clear();
+}
+
+String ESP8266WiFiClass::SSID(uint8_t networkItem) const
+{
+	return (networkItem < scanResults.size()) ? String(scanResults[networkItem].ssid.c_str()) : String("");
+}
+
+int32_t ESP8266WiFiClass::RSSI(uint8_t networkItem) const
+{
+	return (networkItem < scanResults.size()) ? scanResults[networkItem].rssi : 0;
+}
+
+uint8_t *ESP8266WiFiClass::BSSID(uint8_t networkItem)
+{
+	return (networkItem < scanResults.size()) ? scanResults[networkItem].bssid : nullptr;
+}
+
+int32_t ESP8266WiFiClass::channel(uint8_t networkItem) const
+{
+	return (networkItem < scanResults.size()) ? scanResults[networkItem].channel : 0;
+}
+
+uint8_t ESP8266WiFiClass::encryptionType(uint8_t networkItem) const
+{
+	return (networkItem < scanResults.size()) ? scanResults[networkItem].authMode : 0;
+}
+
+bool ESP8266WiFiClass::isHidden(uint8_t networkItem) const
+{
+	return networkItem < scanResults.size() && scanResults[networkItem].hidden;
+}
+
+void *ESP8266WiFiClass::getScanInfoByIndex(int i)
+{
+	if (i < 0 || (size_t)i >= scanResults.size())
+	{
+		return nullptr;
+	}
+	scanInfo.resize(scanResults.size());
+	bss_info& info = scanInfo[i];
+	memset(&info, 0, sizeof(info));
+	const SimCore::Network& n = scanResults[i];
+	memcpy(info.bssid, n.bssid, sizeof(info.bssid));
+	info.ssid_len = (uint8)std::min<size_t>(n.ssid.size(), sizeof(info.ssid));
+	memcpy(info.ssid, n.ssid.data(), info.ssid_len);
+	info.channel = n.channel;
+	info.rssi = n.rssi;
+	info.authmode = (AUTH_MODE)n.authMode;
+	info.is_hidden = (n.hidden) ? 1 : 0;
+	return &info;
+}
+
+// Flash and the EEPROM library
+
+uint8_t SimFlash::flash[SimFlash::FlashSize];
+
+void SimFlash::EraseAll()
+{
+	memset(flash, 0xFF, sizeof(flash));
+	writesBeforeFailure = -1;
+	erases = writes = bytesWritten = 0;
+}
+
+void SimFlash::FailWritesAfter(int numWrites)
+{
+	writesBeforeFailure = numWrites;
+}
+
+uint32_t SimFlash::GetErases() { return erases; }
+uint32_t SimFlash::GetWrites() { return writes; }
+uint32_t SimFlash::GetBytesWritten() { return bytesWritten; }
+
+uint32 spi_flash_get_id(void)
+{
+	return 0x1540EF;							// 2Mbyte Winbond chip
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec)
+{
+	assert(hostInterruptsDisabled == 1);
+	if ((size_t)(sec + 1) * SPI_FLASH_SEC_SIZE > SimFlash::FlashSize)
+	{
+		return SPI_FLASH_RESULT_ERR;
+	}
+	memset(SimFlash::flash + sec * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE);
+	++erases;
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size)
+{
+	assert(hostInterruptsDisabled == 1);
+	if (des_addr % sizeof(uint32_t) != 0 || size % sizeof(uint32_t) != 0 || des_addr + size > SimFlash::FlashSize)
+	{
+		return SPI_FLASH_RESULT_ERR;
+	}
+	++writes;
+	if (writesBeforeFailure == 0)
+	{
+		return SPI_FLASH_RESULT_ERR;
+	}
+	if (writesBeforeFailure > 0)
+	{
+		--writesBeforeFailure;
+	}
+
+	const uint8_t * const src = reinterpret_cast<const uint8_t*>(src_addr);
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		SimFlash::flash[des_addr + i] &= src[i];			// programming can only clear bits
+	}
+	bytesWritten += size;
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size)
+{
+	assert(hostInterruptsDisabled == 1);
+	if (size % sizeof(uint32_t) != 0 || src_addr + size > SimFlash::FlashSize)
+	{
+		return SPI_FLASH_RESULT_ERR;
+	}
+	memcpy(des_addr, SimFlash::flash + src_addr, size);
+	return SPI_FLASH_RESULT_OK;
+}
+
+EEPROMClass EEPROM;
+
+void EEPROMClass::begin(size_t sz)
+{
+	assert(sz <= SPI_FLASH_SEC_SIZE);
+	delete[] data;
+	data = new uint8_t[(sz + 3) & ~3];			// commit() writes whole dwords
+	size = sz;
+	memset(data, 0xFF, (sz + 3) & ~3);
+	memcpy(data, SimFlash::flash + SimFlash::EepromSector * SPI_FLASH_SEC_SIZE, sz);
+	dirty = false;
+}
+
+bool EEPROMClass::commit()
+{
+	if (data == nullptr)
+	{
+		return false;
+	}
+	if (dirty)
+	{
+		noInterrupts();
+		spi_flash_erase_sector(SimFlash::EepromSector);
+		const bool ok = spi_flash_write(SimFlash::EepromSector * SPI_FLASH_SEC_SIZE, reinterpret_cast<uint32*>(data), (size + 3) & ~3) == SPI_FLASH_RESULT_OK;
+		interrupts();
+		if (!ok)
+		{
+			return false;
+		}
+		dirty = false;
+	}
+	return true;
+}
+
+void EEPROMClass::end()
+{
+	commit();
+	delete[] data;
+	data = nullptr;
+	size = 0;
+}
+
+// End
@@ -0,0 +1,67 @@
+/*
+ * SimCore.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Controls for the host build's stand-ins for the Arduino core, the ESP8266 SDK and the flash chip
+ */
+
+#ifndef HOST_SIMCORE_H_
+#define HOST_SIMCORE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace SimCore
+{
+	typedef void (*PinWriteHook)(uint8_t pin, uint8_t level);
+
+	const uint32_t DhcpLeaseSeconds = 2 * 60 * 60;
+
+	struct Network									// an access point that the simulated radio can find
+	{
+		std::string ssid;
+		uint8_t bssid[6];
+		int8_t rssi;
+		uint8_t channel;
+		uint8_t authMode;
+		bool hidden;
+	};
+
+	void Init();									// reset pins, time and the simulated radio
+	void SetPinWriteHook(PinWriteHook hook);		// called whenever the firmware writes an output pin
+	void SetInputPin(uint8_t pin, uint8_t level);	// drive an input, calling the firmware's interrupt handler if the level changes
+	uint8_t GetPin(uint8_t pin);
+	uint32_t NumRisingEdges(uint8_t pin);			// how many times the firmware has driven the pin from low to high
+	void AdvanceMillis(uint32_t ms);				// move the firmware's clock on without waiting
+	void SetVerbose(bool on);						// pass the firmware's debug output through to stdout
+	void SetStationStatus(uint8_t status);			// what wifi_station_get_connect_status() returns once the firmware has called WiFi.begin()
+	void SetNetworks(const std::vector<Network>& networks);	// what the next scan will find, and the access points that the station can connect to
+	bool CompleteScan(int result = 0);				// finish an asynchronous scan, passing the number of networks or a negative result to the callback. False if none was running.
+	bool LastBeginWasDirected();					// true if the firmware gave WiFi.begin a channel and BSSID last time
+	bool IsDhcpActive();							// true if the station got its address from DHCP rather than a static configuration
+	void SetDhcpHostNumber(uint8_t hostNumber);		// the last byte of the address that the DHCP server gives the station from now on
+	void SetResetReason(uint32_t reason);			// what system_get_rst_info() reports when the firmware next starts, 0 for power up
+	void ClearRtcMemory();							// lose the RTC user memory, as a power cycle does
+	void Process();									// deliver the WiFi events that the SDK would send between calls to loop()
+}
+
+// RAM stand-in for the flash chip. Writes can only clear bits, as with real NOR flash, and we count erases and writes
+// so that tests can check how much wear a sequence of changes causes.
+namespace SimFlash
+{
+	const size_t FlashSize = 0x200000;				// 2Mbyte chip, to match the linker script
+	const uint32_t EepromSector = 0x1FB;			// where _SPIFFS_end puts the EEPROM library's sector
+
+	extern uint8_t flash[FlashSize];
+
+	void EraseAll();
+	void FailWritesAfter(int numWrites);			// -1 means never fail
+	uint32_t GetErases();
+	uint32_t GetWrites();
+	uint32_t GetBytesWritten();
+}
+
+#endif /* HOST_SIMCORE_H_ */
@@ -0,0 +1,127 @@
+/*
+ * SimHSPI.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build replacement for HSPI.cpp. Instead of driving the SPI registers, each dword goes straight to the simulated SAM.
+ * The busy cycle count is how long the transfers would keep the bus busy at the clock rate set, in 80MHz CPU cycles.
+ */
+
+#include "HSPI.h"
+#include "SimSam.h"
+
+volatile uint32_t SPI1CLK = 0;
+
+static uint32_t BusCycles(uint32_t dwords)
+{
+	return (uint32_t)(dwords * 32 * 80.0e6/SimSam::GetSpiClockHz());
+}
+
+HSPIClass::HSPIClass()
+	: asyncOut(nullptr), asyncIn(nullptr), asyncRemainingDwords(0), asyncChunkDwords(0),
+	  streamPartialDword(0), streamPartialBytes(0), streamFifoDwords(0), pipelined(false),
+	  busyCycles(0), bytesSent(0), bytesReceived(0), transferStartCycles(0)
+{
+}
+
+void HSPIClass::InitMaster(uint8_t mode, uint32_t clockReg, bool msbFirst)
+{
+	setClockDivider(clockReg);
+}
+
+void HSPIClass::end()
+{
+}
+
+void HSPIClass::setDataBits(uint16_t bits)
+{
+}
+
+void HSPIClass::setClockDivider(uint32_t clockDiv)
+{
+	SPI1CLK = clockDiv;
+}
+
+void HSPIClass::beginTransaction()
+{
+}
+
+void HSPIClass::endTransaction()
+{
+}
+
+uint32_t HSPIClass::transfer32(uint32_t data)
+{
+	bytesSent += sizeof(uint32_t);
+	bytesReceived += sizeof(uint32_t);
+	busyCycles += BusCycles(1);
+	return SimSam::ExchangeSingle(data);
+}
+
+void HSPIClass::transferDwords(const uint32_t * out, uint32_t * in, uint32_t size)
+{
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		const uint32_t received = SimSam::Exchange((out == nullptr) ? 0xFFFFFFFF : out[i], out != nullptr, in != nullptr);
+		if (in != nullptr)
+		{
+			in[i] = received;
+		}
+	}
+	if (out != nullptr)
+	{
+		bytesSent += size * sizeof(uint32_t);
+	}
+	if (in != nullptr)
+	{
+		bytesReceived += size * sizeof(uint32_t);
+	}
+	busyCycles += BusCycles(size);
+}
+
+// The simulated SAM receives each dword as soon as we send it, so a background transfer has always finished by the time we return
+void HSPIClass::startTransferDwords(const uint32_t * out, uint32_t * in, uint32_t size)
+{
+	transferDwords(out, in, size);
+}
+
+void HSPIClass::beginStream()
+{
+	streamPartialDword = 0;
+	streamPartialBytes = 0;
+	streamFifoDwords = 0;
+}
+
+void HSPIClass::streamDword(uint32_t data)
+{
+	busyCycles += BusCycles(1);
+	SimSam::Exchange(data, true, false);
+}
+
+void HSPIClass::streamBytes(const uint8_t * data, size_t length)
+{
+	bytesSent += length;
+	while (length != 0)
+	{
+		streamPartialDword |= (uint32_t)*data++ << (8 * streamPartialBytes);
+		--length;
+		if (++streamPartialBytes == 4)
+		{
+			streamDword(streamPartialDword);
+			streamPartialDword = 0;
+			streamPartialBytes = 0;
+		}
+	}
+}
+
+void HSPIClass::endStream()
+{
+	if (streamPartialBytes != 0)
+	{
+		streamDword(streamPartialDword);
+		streamPartialDword = 0;
+		streamPartialBytes = 0;
+	}
+}
+
+// End
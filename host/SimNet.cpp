@@ -0,0 +1,637 @@
+/*
+ * SimNet.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Loopback implementation of the lwIP raw TCP API, pbufs and the parts of the mDNS and NetBIOS APIs that the firmware uses,
+ * with the TCP segment pool statistics and umm_malloc's heap information
+ */
+
+#include "SimNet.h"
+#include <deque>
+#include <vector>
+#include <string>
+
+extern "C"
+{
+	#include "lwip/tcp.h"
+	#include "lwip/netif.h"
+	#include "lwip/apps/mdns.h"
+	#include "lwip/apps/netbiosns.h"
+	#include "lwip/stats.h"
+	#include "umm_malloc/umm_malloc.h"
+}
+
+namespace
+{
+	struct Segment
+	{
+		std::string data;
+		size_t charge;							// how much heap it uses
+	};
+
+	struct SimConn
+	{
+		tcp_pcb *pcb = nullptr;					// the firmware's end of the connection, or nullptr once it has gone
+		std::deque<Segment> unsent;				// written by the firmware but not yet output
+		std::deque<Segment> inFlight;			// output by the firmware and not yet delivered
+		std::string toFirmware;					// what the client has queued to send
+		size_t toFirmwareSent = 0;				// how much of that the firmware has accepted
+		std::string received;					// what the client has received and not yet taken
+		bool clientClosing = false;				// the client wants to send FIN
+		bool finDelivered = false;				// the firmware has been told about the FIN
+		bool firmwareClosed = false;			// the firmware called tcp_close
+		bool gotFin = false;
+		bool wasReset = false;
+		bool holdAcks = false;					// the client isn't acknowledging what it receives
+	};
+
+	std::vector<SimConn*> conns;
+	std::vector<tcp_pcb*> listeners;
+	std::vector<tcp_pcb*> deadPcbs;				// freed at the end of Process() because a callback may still be using them
+	size_t freeHeap = SimNet::DefaultFreeHeap;
+	struct stats_mem segmentStats = { "TCP_SEG", 0, SimNet::MaxTcpSegments, 0, 0, 0 };	// 'used' is the number of segments in use
+	struct stats_mem pbufStats = { "PBUF_POOL", 0, SimNet::PbufPoolSize, 0, 0, 0 };		// 'used' is the number of received pbufs in use
+	unsigned int writesToFail = 0;
+
+	SimConn *GetConn(int client)
+	{
+		return (client >= 0 && (size_t)client < conns.size()) ? conns[client] : nullptr;
+	}
+
+	void ReleaseSegments(std::deque<Segment>& segs)
+	{
+		for (const Segment& s : segs)
+		{
+			freeHeap += s.charge;
+			--segmentStats.used;
+		}
+		segs.clear();
+	}
+
+	// Detach a pcb from its connection and arrange for it to be freed
+	void KillPcb(tcp_pcb *pcb)
+	{
+		SimConn * const c = static_cast<SimConn*>(pcb->sim);
+		if (c != nullptr)
+		{
+			ReleaseSegments(c->unsent);
+			ReleaseSegments(c->inFlight);
+			c->pcb = nullptr;
+		}
+		pcb->sim = nullptr;
+		pcb->state = CLOSED;
+		pcb->recv = nullptr;
+		pcb->sent = nullptr;
+		pcb->errf = nullptr;
+		deadPcbs.push_back(pcb);
+	}
+
+	pbuf *AllocPbuf(const char *data, size_t length)
+	{
+		const size_t charge = length + SimNet::PbufOverhead;
+		if (freeHeap < charge || pbufStats.used == pbufStats.avail)
+		{
+			++pbufStats.err;
+			return nullptr;
+		}
+		freeHeap -= charge;
+		++pbufStats.used;
+		pbufStats.max = std::max<u16_t>(pbufStats.max, pbufStats.used);
+		pbuf * const p = static_cast<pbuf*>(malloc(sizeof(pbuf) + length));
+		p->next = nullptr;
+		p->payload = p + 1;
+		p->len = p->tot_len = (u16_t)length;
+		p->ref = 1;
+		memcpy(p->payload, data, length);
+		return p;
+	}
+
+	// Deliver what the firmware output last time, acknowledge it, then output what it has written since
+	void ProcessOutput(SimConn *c)
+	{
+		tcp_pcb * const pcb = c->pcb;
+		size_t acked = 0;
+		while (!c->holdAcks && !c->inFlight.empty())
+		{
+			Segment& s = c->inFlight.front();
+			c->received += s.data;
+			acked += s.data.size();
+			freeHeap += s.charge;
+			--segmentStats.used;
+			--pcb->snd_queuelen;
+			c->inFlight.pop_front();
+		}
+
+		if (acked != 0)
+		{
+			pcb->snd_buf += acked;
+			if (pcb->sent != nullptr)
+			{
+				pcb->sent(pcb->callback_arg, pcb, (u16_t)acked);
+				if (c->pcb == nullptr)
+				{
+					return;								// the firmware aborted the connection in the callback
+				}
+			}
+			tcp_output(pcb);							// lwIP sends more data when an ACK arrives
+		}
+
+		if (c->firmwareClosed && c->unsent.empty() && c->inFlight.empty())
+		{
+			c->gotFin = true;
+			KillPcb(pcb);
+		}
+	}
+
+	// Feed the client's data to the firmware as far as the receive window allows, then the FIN if there is one
+	void ProcessInput(SimConn *c)
+	{
+		while (c->pcb != nullptr && c->toFirmwareSent < c->toFirmware.size() && c->pcb->rcv_wnd != 0)
+		{
+			tcp_pcb * const pcb = c->pcb;
+			const size_t length = std::min<size_t>(std::min<size_t>(c->toFirmware.size() - c->toFirmwareSent, pcb->mss), pcb->rcv_wnd);
+			pbuf * const p = AllocPbuf(c->toFirmware.data() + c->toFirmwareSent, length);
+			if (p == nullptr)
+			{
+				return;									// out of memory, so the segment is dropped and the client will retransmit it
+			}
+
+			if (pcb->recv == nullptr)
+			{
+				pbuf_free(p);							// lwIP's default receive function discards the data
+			}
+			else
+			{
+				const err_t rc = pcb->recv(pcb->callback_arg, pcb, p, ERR_OK);
+				if (rc == ERR_ABRT || c->pcb == nullptr)
+				{
+					return;
+				}
+				if (rc != ERR_OK)
+				{
+					pbuf_free(p);						// refused, so lwIP will offer it again later
+					return;
+				}
+			}
+			pcb->rcv_wnd -= length;
+			c->toFirmwareSent += length;
+		}
+
+		if (   c->pcb != nullptr && c->clientClosing && !c->finDelivered && c->toFirmwareSent == c->toFirmware.size()
+			&& !c->firmwareClosed && c->pcb->recv != nullptr
+		   )
+		{
+			c->finDelivered = true;
+			c->pcb->state = CLOSE_WAIT;
+			c->pcb->recv(c->pcb->callback_arg, c->pcb, nullptr, ERR_OK);
+		}
+	}
+}
+
+const ip_addr_t ip_addr_any = { IPADDR_ANY };
+
+static struct netif apNetif = { nullptr, { 0 }, { 'a', 'p' }, 1 };
+static struct netif staNetif = { &apNetif, { 0 }, { 's', 't' }, 0 };
+struct netif *netif_list = &staNetif;
+
+namespace SimNet
+{
+	void Init()
+	{
+		for (SimConn *c : conns)
+		{
+			if (c->pcb != nullptr)
+			{
+				KillPcb(c->pcb);
+			}
+			delete c;
+		}
+		conns.clear();
+		for (tcp_pcb *pcb : listeners)
+		{
+			delete pcb;
+		}
+		listeners.clear();
+		for (tcp_pcb *pcb : deadPcbs)
+		{
+			delete pcb;
+		}
+		deadPcbs.clear();
+		freeHeap = DefaultFreeHeap;
+		segmentStats.used = segmentStats.err = segmentStats.max = 0;
+		pbufStats.used = pbufStats.err = pbufStats.max = 0;
+		writesToFail = 0;
+	}
+
+	int Connect(uint16_t port, uint32_t remoteIp, uint16_t remotePort)
+	{
+		SimConn * const c = new SimConn;
+		conns.push_back(c);
+		const int handle = (int)conns.size() - 1;
+
+		tcp_pcb *listener = nullptr;
+		for (tcp_pcb *pcb : listeners)
+		{
+			if (pcb->local_port == port)
+			{
+				listener = pcb;
+				break;
+			}
+		}
+		if (listener == nullptr || listener->accept == nullptr)
+		{
+			c->wasReset = true;							// connection refused
+			return handle;
+		}
+
+		tcp_pcb * const pcb = tcp_new();
+		pcb->state = ESTABLISHED;
+		pcb->local_port = port;
+		pcb->remote_port = (remotePort != 0) ? remotePort : (u16_t)(50000 + handle);
+		pcb->remote_ip.addr = remoteIp;
+		pcb->sim = c;
+		c->pcb = pcb;
+
+		const err_t rc = listener->accept(listener->callback_arg, pcb, ERR_OK);
+		if (rc != ERR_OK && rc != ERR_ABRT && c->pcb != nullptr)
+		{
+			tcp_abort(pcb);
+		}
+		return handle;
+	}
+
+	void Send(int client, const void *data, size_t length)
+	{
+		SimConn * const c = GetConn(client);
+		if (c != nullptr)
+		{
+			c->toFirmware.append(static_cast<const char*>(data), length);
+		}
+	}
+
+	size_t Receive(int client, void *buffer, size_t maxLength)
+	{
+		SimConn * const c = GetConn(client);
+		if (c == nullptr)
+		{
+			return 0;
+		}
+		const size_t length = std::min<size_t>(maxLength, c->received.size());
+		memcpy(buffer, c->received.data(), length);
+		c->received.erase(0, length);
+		return length;
+	}
+
+	size_t Available(int client)
+	{
+		SimConn * const c = GetConn(client);
+		return (c == nullptr) ? 0 : c->received.size();
+	}
+
+	void Close(int client)
+	{
+		SimConn * const c = GetConn(client);
+		if (c != nullptr)
+		{
+			c->clientClosing = true;
+		}
+	}
+
+	void Abort(int client)
+	{
+		SimConn * const c = GetConn(client);
+		if (c != nullptr && c->pcb != nullptr)
+		{
+			tcp_pcb * const pcb = c->pcb;
+			const tcp_err_fn errf = pcb->errf;
+			void * const arg = pcb->callback_arg;
+			KillPcb(pcb);
+			if (errf != nullptr)
+			{
+				errf(arg, ERR_RST);						// lwIP frees the pcb before calling the error callback
+			}
+		}
+	}
+
+	void HoldAcks(int client, bool hold)
+	{
+		SimConn * const c = GetConn(client);
+		if (c != nullptr)
+		{
+			c->holdAcks = hold;
+		}
+	}
+
+	bool IsConnected(int client)
+	{
+		SimConn * const c = GetConn(client);
+		return c != nullptr && c->pcb != nullptr;
+	}
+
+	bool GotFin(int client)
+	{
+		SimConn * const c = GetConn(client);
+		return c != nullptr && c->gotFin;
+	}
+
+	bool WasReset(int client)
+	{
+		SimConn * const c = GetConn(client);
+		return c != nullptr && c->wasReset;
+	}
+
+	size_t PendingToFirmware(int client)
+	{
+		SimConn * const c = GetConn(client);
+		return (c == nullptr) ? 0 : c->toFirmware.size() - c->toFirmwareSent;
+	}
+
+	void Process()
+	{
+		for (size_t i = 0; i < conns.size(); ++i)
+		{
+			SimConn * const c = conns[i];
+			if (c->pcb != nullptr)
+			{
+				ProcessOutput(c);
+			}
+			if (c->pcb != nullptr)
+			{
+				ProcessInput(c);
+			}
+		}
+		for (tcp_pcb *pcb : deadPcbs)
+		{
+			delete pcb;
+		}
+		deadPcbs.clear();
+	}
+
+	size_t FreeHeap()
+	{
+		return freeHeap;
+	}
+
+	void SetFreeHeap(size_t bytes)
+	{
+		freeHeap = bytes;
+	}
+
+	void FailWrites(unsigned int count)
+	{
+		writesToFail = count;
+	}
+
+	unsigned int NumSegmentsInUse()
+	{
+		return segmentStats.used;
+	}
+
+	unsigned int NumListeners()
+	{
+		return listeners.size();
+	}
+}
+
+// lwIP raw TCP API
+
+struct tcp_pcb *tcp_new(void)
+{
+	tcp_pcb * const pcb = new tcp_pcb;
+	memset(pcb, 0, sizeof(*pcb));
+	pcb->state = CLOSED;
+	pcb->mss = TCP_MSS;
+	pcb->snd_buf = TCP_SND_BUF;
+	pcb->rcv_wnd = TCP_WND;
+	pcb->sa = 8;
+	return pcb;
+}
+
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
+{
+	for (tcp_pcb *other : listeners)
+	{
+		if (other->local_port == port && (other->so_options & pcb->so_options & SOF_REUSEADDR) == 0)
+		{
+			return ERR_USE;
+		}
+	}
+	pcb->local_ip = *ipaddr;
+	pcb->local_port = port;
+	return ERR_OK;
+}
+
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog)
+{
+	pcb->state = LISTEN;
+	pcb->backlog = backlog;
+	listeners.push_back(pcb);
+	return pcb;
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg)
+{
+	pcb->callback_arg = arg;
+}
+
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept)
+{
+	pcb->accept = accept;
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv)
+{
+	pcb->recv = recv;
+}
+
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent)
+{
+	pcb->sent = sent;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err)
+{
+	pcb->errf = err;
+}
+
+void tcp_recved(struct tcp_pcb *pcb, u16_t len)
+{
+	pcb->rcv_wnd = (u16_t)std::min<size_t>(pcb->rcv_wnd + len, TCP_WND);
+}
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags)
+{
+	SimConn * const c = static_cast<SimConn*>(pcb->sim);
+	if (c == nullptr || c->firmwareClosed || (pcb->state != ESTABLISHED && pcb->state != CLOSE_WAIT))
+	{
+		return ERR_CONN;
+	}
+	if (len > pcb->snd_buf)
+	{
+		return ERR_MEM;
+	}
+	if (writesToFail != 0)
+	{
+		--writesToFail;
+		return ERR_MEM;
+	}
+
+	// Work out how many new segments we need, after topping up the last unsent one
+	const char *data = static_cast<const char*>(dataptr);
+	size_t topUp = 0;
+	if (!c->unsent.empty() && c->unsent.back().data.size() < pcb->mss)
+	{
+		topUp = std::min<size_t>(len, pcb->mss - c->unsent.back().data.size());
+	}
+	const size_t newSegments = (len - topUp + pcb->mss - 1)/pcb->mss;
+	if (pcb->snd_queuelen + newSegments > TCP_SND_QUEUELEN)
+	{
+		return ERR_MEM;
+	}
+	if (segmentStats.used + newSegments > SimNet::MaxTcpSegments)
+	{
+		++segmentStats.err;
+		return ERR_MEM;
+	}
+	size_t charge = topUp;
+	for (size_t i = 0; i < newSegments; ++i)
+	{
+		charge += std::min<size_t>(len - topUp - i * pcb->mss, pcb->mss) + SimNet::PbufOverhead;
+	}
+	if (charge > freeHeap)
+	{
+		return ERR_MEM;
+	}
+
+	if (topUp != 0)
+	{
+		c->unsent.back().data.append(data, topUp);
+		c->unsent.back().charge += topUp;
+		freeHeap -= topUp;
+	}
+	for (size_t done = topUp; done < len; )
+	{
+		const size_t segLength = std::min<size_t>(len - done, pcb->mss);
+		Segment s;
+		s.data.assign(data + done, segLength);
+		s.charge = segLength + SimNet::PbufOverhead;
+		freeHeap -= s.charge;
+		++segmentStats.used;
+		segmentStats.max = std::max<u16_t>(segmentStats.max, segmentStats.used);
+		++pcb->snd_queuelen;
+		c->unsent.push_back(s);
+		done += segLength;
+	}
+	pcb->snd_buf -= len;
+	return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb)
+{
+	SimConn * const c = static_cast<SimConn*>(pcb->sim);
+	if (c != nullptr)
+	{
+		while (!c->unsent.empty())
+		{
+			c->inFlight.push_back(c->unsent.front());
+			c->unsent.pop_front();
+		}
+	}
+	return ERR_OK;
+}
+
+err_t tcp_close(struct tcp_pcb *pcb)
+{
+	if (pcb->state == LISTEN || pcb->sim == nullptr)
+	{
+		listeners.erase(std::remove(listeners.begin(), listeners.end(), pcb), listeners.end());
+		delete pcb;
+		return ERR_OK;
+	}
+
+	SimConn * const c = static_cast<SimConn*>(pcb->sim);
+	c->firmwareClosed = true;
+	pcb->state = (pcb->state == CLOSE_WAIT) ? LAST_ACK : FIN_WAIT_1;
+	tcp_output(pcb);
+	return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb)
+{
+	const tcp_err_fn errf = pcb->errf;
+	void * const arg = pcb->callback_arg;
+	SimConn * const c = static_cast<SimConn*>(pcb->sim);
+	if (c != nullptr)
+	{
+		c->wasReset = true;
+	}
+	KillPcb(pcb);
+	if (errf != nullptr)
+	{
+		errf(arg, ERR_ABRT);
+	}
+}
+
+// pbufs
+
+u8_t pbuf_free(struct pbuf *p)
+{
+	u8_t count = 0;
+	while (p != nullptr)
+	{
+		pbuf * const next = p->next;
+		if (--p->ref != 0)
+		{
+			break;
+		}
+		freeHeap += p->len + SimNet::PbufOverhead;
+		if (pbufStats.used != 0)				// it may be left over from before the last Init()
+		{
+			--pbufStats.used;
+		}
+		free(p);
+		++count;
+		p = next;
+	}
+	return count;
+}
+
+void pbuf_cat(struct pbuf *head, struct pbuf *tail)
+{
+	pbuf *p = head;
+	for (; p->next != nullptr; p = p->next)
+	{
+		p->tot_len += tail->tot_len;
+	}
+	p->tot_len += tail->tot_len;
+	p->next = tail;
+}
+
+// Statistics. The simulation only has pools for TCP segments and received pbufs; the other pools are always empty.
+
+static struct stats_mem emptyPoolStats = { "", 0, 0, 0, 0, 0 };
+struct stats_ lwip_stats = { { &emptyPoolStats, &emptyPoolStats, &emptyPoolStats, &emptyPoolStats, &segmentStats, &emptyPoolStats, &pbufStats } };
+
+UMM_HEAP_INFO ummHeapInfo;
+
+void *umm_info(void *ptr, int force)
+{
+	ummHeapInfo.maxFreeContiguousBlocks = (unsigned short int)std::min<size_t>(freeHeap/8, 0xFFFF);
+	ummHeapInfo.freeBlocks = ummHeapInfo.maxFreeContiguousBlocks;
+	return nullptr;
+}
+
+// mDNS and NetBIOS. There is no UDP in the simulation, so these only need to accept what the firmware gives them.
+
+void mdns_resp_init(void) { }
+err_t mdns_resp_add_netif(struct netif *netif, const char *hostname, u32_t dns_ttl) { return ERR_OK; }
+err_t mdns_resp_remove_netif(struct netif *netif) { return ERR_OK; }
+err_t mdns_resp_add_service(struct netif *netif, const char *name, const char *service, enum mdns_sd_proto proto, u16_t port, u32_t dns_ttl,
+							service_get_txt_fn_t txt_fn, void *txt_userdata) { return ERR_OK; }
+err_t mdns_resp_add_service_txtitem(struct mdns_service *service, const char *txt, u8_t txt_len) { return ERR_OK; }
+void mdns_resp_netif_settings_changed(struct netif *netif) { }
+void netbiosns_init(void) { }
+void netbiosns_set_name(const char *hostname) { }
+
+// End
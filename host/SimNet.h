@@ -0,0 +1,50 @@
+/*
+ * SimNet.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * A loopback stand-in for lwIP's raw TCP API, so that Connection.cpp and Listener.cpp run unchanged on the host.
+ * Each connection that the firmware accepts has a simulated client at the other end. Process() plays the part of the
+ * network: it delivers what the firmware has output to the client, acknowledges it, and feeds the client's data to the
+ * firmware as far as the receive window allows. Bandwidth is unlimited, so the throughput that the benchmark reports
+ * is limited only by the firmware and the SPI link.
+ */
+
+#ifndef HOST_SIMNET_H_
+#define HOST_SIMNET_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace SimNet
+{
+	const size_t DefaultFreeHeap = 40000;			// roughly what the firmware has free once it is running
+	const size_t MaxTcpSegments = 16;				// MEMP_NUM_TCP_SEG in the ESP8266 core's lwIP build
+	const size_t PbufPoolSize = 16;					// how many received pbufs the firmware can hold at once
+	const size_t PbufOverhead = 80;					// heap used by a pbuf over and above its payload, including the protocol headers
+
+	void Init();									// forget all clients and listeners and reset the simulated heap
+
+	// Clients
+	int Connect(uint16_t port, uint32_t remoteIp = 0x0A01A8C0, uint16_t remotePort = 0);	// returns a client handle
+	void Send(int client, const void *data, size_t length);	// queue data for the client to send to the firmware
+	size_t Receive(int client, void *buffer, size_t maxLength);	// take data that the client has received
+	size_t Available(int client);					// how much the client has received and not yet taken
+	void Close(int client);							// send FIN once the queued data has gone
+	void Abort(int client);							// send RST
+	void HoldAcks(int client, bool hold);			// stop or restart the client acknowledging what the firmware sends
+	bool IsConnected(int client);					// true if the firmware side of the connection still exists
+	bool GotFin(int client);						// true if the firmware closed the connection gracefully
+	bool WasReset(int client);						// true if the firmware refused or aborted the connection
+	size_t PendingToFirmware(int client);			// how much of the client's data the firmware has not yet accepted
+
+	// The network
+	void Process();
+	size_t FreeHeap();
+	void SetFreeHeap(size_t bytes);
+	void FailWrites(unsigned int count);			// make the next 'count' calls to tcp_write fail with ERR_MEM
+	unsigned int NumSegmentsInUse();
+	unsigned int NumListeners();
+}
+
+#endif /* HOST_SIMNET_H_ */
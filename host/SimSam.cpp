@@ -0,0 +1,345 @@
+/*
+ * SimSam.cpp
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#include "SimSam.h"
+#include "SimCore.h"
+#include "SimNet.h"
+#include "Config.h"
+#include "Listener.h"
+#include "Connection.h"
+#include "Crc32.h"
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+
+void setup();
+void loop();
+
+namespace
+{
+	std::vector<uint32_t> txBuffer;						// what the SAM's DMA sends: header then data
+	std::vector<uint32_t> rxBuffer;						// what the SAM's DMA receives
+	size_t rxCapacity = 0;								// how many dwords the SAM can receive
+	size_t position = 0;								// how many dwords have been exchanged in this transaction
+	size_t dwordsClocked = 0;							// how many dwords the ESP has clocked in this transaction
+	bool overrun = false;
+	bool csAsserted = false;
+	bool transactionDone = false;
+	uint8_t formatVersion = MyFormatVersion;
+
+	// Framing state
+	unsigned int singlesExchanged = 0;					// how many times the ESP has called transfer32 in this transaction
+	unsigned int exchangeCount = 0;						// how many dwords have been exchanged including the CRCs, for fault injection
+	int corruptSentIndex = -1, corruptReceivedIndex = -1;
+	double maxCleanClockHz = 0.0;
+	uint32_t samTxCrc, samRxCrc;
+	bool espCrcOk = true;
+	int32_t trailerAck = ResponseEmpty;
+
+	SimSam::CommandStats stats[256];
+
+	void OnPinWrite(uint8_t pin, uint8_t level)
+	{
+		if (pin == SamSSPin)
+		{
+			if (level == LOW)
+			{
+				csAsserted = true;
+				position = 0;
+			}
+			else if (csAsserted)
+			{
+				// The SAM's end of transfer interrupt drops TransferReady when CS is released
+				csAsserted = false;
+				transactionDone = true;
+				SimCore::SetInputPin(SamTfrReadyPin, LOW);
+			}
+		}
+	}
+
+	bool IsFramed()
+	{
+		return formatVersion == MyFramedFormatVersion;
+	}
+
+	// Apply any fault injection to a dword on the bus
+	uint32_t ApplySentFault(uint32_t dword)
+	{
+		if (exchangeCount == (unsigned int)corruptSentIndex)
+		{
+			dword ^= 1;
+		}
+		if (maxCleanClockHz != 0.0 && exchangeCount % 16 == 15 && SimSam::GetSpiClockHz() > maxCleanClockHz)
+		{
+			dword ^= 0x00010000;
+		}
+		return dword;
+	}
+
+	uint32_t ApplyReceivedFault(uint32_t dword)
+	{
+		return (exchangeCount == (unsigned int)corruptReceivedIndex) ? dword ^ 1 : dword;
+	}
+
+	uint64_t NowNanos()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+namespace SimSam
+{
+	void Init()
+	{
+		static bool initialised = false;
+		if (initialised)
+		{
+			// The firmware's static data outlives setup(), so don't leave it pointing at freed pcbs or holding on to shared buffers,
+			// or thinking that it is still connected to an access point
+			Transaction(NetworkCommand::networkStop, 0, 0, 0, nullptr, 0, nullptr, 0);
+			Idle(2);
+			Listener::StopListening(0);
+			Connection::TerminateAll();
+		}
+		initialised = true;
+
+		SimCore::Init();
+		SimNet::Init();
+		SimCore::SetPinWriteHook(OnPinWrite);
+		formatVersion = MyFormatVersion;
+		maxCleanClockHz = 0.0;
+		csAsserted = transactionDone = false;
+		ClearStats();
+		setup();
+	}
+
+	int32_t Transaction(NetworkCommand cmd, uint8_t socket, uint8_t flags, uint32_t param32,
+						const void *dataOut, size_t dataOutLength, void *dataIn, size_t dataInLength)
+	{
+		// Set up the DMA buffers
+		MessageHeaderSamToEsp hdr;
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.formatVersion = formatVersion;
+		hdr.command = cmd;
+		hdr.socketNumber = socket;
+		hdr.flags = flags;
+		hdr.dataLength = (uint16_t)dataOutLength;
+		hdr.dataBufferAvailable = (uint16_t)dataInLength;
+		hdr.param32 = param32;
+
+		txBuffer.assign(headerDwords + NumDwords(dataOutLength), 0);
+		memcpy(txBuffer.data(), &hdr, sizeof(hdr));
+		if (dataOutLength != 0)
+		{
+			memcpy(txBuffer.data() + headerDwords, dataOut, dataOutLength);
+		}
+		rxCapacity = headerDwords + NumDwords(dataInLength);
+		rxBuffer.assign(rxCapacity, 0);
+		overrun = false;
+		transactionDone = false;
+		dwordsClocked = 0;
+		singlesExchanged = exchangeCount = 0;
+		espCrcOk = true;
+		trailerAck = ResponseEmpty;
+
+		// Tell the ESP we are ready and wait for it to do the transaction
+		const uint64_t startTime = NowNanos();
+		SimCore::SetInputPin(SamTfrReadyPin, HIGH);
+		for (unsigned int i = 0; i < MaxLoopsPerTransaction && !transactionDone; ++i)
+		{
+			loop();
+			SimCore::Process();
+			SimNet::Process();
+		}
+
+		corruptSentIndex = corruptReceivedIndex = -1;
+		if (!transactionDone)
+		{
+			SimCore::SetInputPin(SamTfrReadyPin, LOW);
+			return ResponseTimeout;
+		}
+
+		const uint64_t elapsed = NowNanos() - startTime;
+		CommandStats& st = stats[(uint8_t)cmd];
+		if (st.count == 0 || elapsed < st.minNanos)
+		{
+			st.minNanos = elapsed;
+		}
+		if (elapsed > st.maxNanos)
+		{
+			st.maxNanos = elapsed;
+		}
+		st.totalNanos += elapsed;
+		st.busNanos += (uint64_t)(dwordsClocked * 32 * 1.0e9/GetSpiClockHz());
+		++st.count;
+
+		// Decode the ESP's reply
+		MessageHeaderEspToSam reply;
+		memcpy(&reply, rxBuffer.data(), sizeof(reply));
+		if (reply.response > 0 && dataIn != nullptr)
+		{
+			memcpy(dataIn, rxBuffer.data() + headerDwords, std::min<size_t>((size_t)reply.response, dataInLength));
+		}
+		return reply.response;
+	}
+
+	void Idle(unsigned int loops)
+	{
+		for (unsigned int i = 0; i < loops; ++i)
+		{
+			loop();
+			SimCore::Process();
+			SimNet::Process();
+		}
+	}
+
+	void SetFormatVersion(uint8_t version)
+	{
+		formatVersion = version;
+	}
+
+	uint8_t GetReplyFormatVersion()
+	{
+		return reinterpret_cast<const MessageHeaderEspToSam*>(rxBuffer.data())->formatVersion;
+	}
+
+	WiFiState GetReplyState()
+	{
+		return reinterpret_cast<const MessageHeaderEspToSam*>(rxBuffer.data())->state;
+	}
+
+	bool GetOverrun()
+	{
+		return overrun;
+	}
+
+	// The ESP8266 SPI clock register holds a prescaler and a divider, unless bit 31 says to use the 80MHz system clock directly
+	void CorruptSent(unsigned int index)
+	{
+		corruptSentIndex = index;
+	}
+
+	void CorruptReceived(unsigned int index)
+	{
+		corruptReceivedIndex = index;
+	}
+
+	bool GetEspCrcOk()
+	{
+		return espCrcOk;
+	}
+
+	int32_t GetTrailerAck()
+	{
+		return trailerAck;
+	}
+
+	double GetSpiClockHz()
+	{
+		const uint32_t reg = SPI1CLK;
+		if (reg & (1u << 31))
+		{
+			return 80.0e6;
+		}
+		const uint32_t pre = (reg >> 18) & 0x1FFF;
+		const uint32_t n = (reg >> 12) & 0x3F;
+		return 80.0e6/((pre + 1) * (n + 1));
+	}
+
+	void SetMaxCleanClockHz(double hz)
+	{
+		maxCleanClockHz = hz;
+	}
+
+	const CommandStats& GetStats(NetworkCommand cmd)
+	{
+		return stats[(uint8_t)cmd];
+	}
+
+	void ClearStats()
+	{
+		memset(stats, 0, sizeof(stats));
+	}
+
+	uint32_t Exchange(uint32_t dwordFromEsp, bool espSending, bool espReceiving)
+	{
+		++dwordsClocked;
+		if (!csAsserted)
+		{
+			return 0xFFFFFFFF;								// the SAM isn't listening
+		}
+		const uint32_t received = ApplyReceivedFault(dwordFromEsp);
+		if (position < rxCapacity)
+		{
+			rxBuffer[position] = received;
+		}
+		else
+		{
+			overrun = true;
+		}
+		const uint32_t ret = (position < txBuffer.size()) ? txBuffer[position] : 0;
+		if (IsFramed() && singlesExchanged == 2)			// in the data phase
+		{
+			if (espSending)
+			{
+				samRxCrc = Crc32::Update(samRxCrc, &received, 1);
+			}
+			if (espReceiving)
+			{
+				samTxCrc = Crc32::Update(samTxCrc, &ret, 1);
+			}
+		}
+		++position;
+		const uint32_t sent = ApplySentFault(ret);
+		++exchangeCount;
+		return sent;
+	}
+
+	uint32_t ExchangeSingle(uint32_t dwordFromEsp)
+	{
+		if (!IsFramed())
+		{
+			return Exchange(dwordFromEsp, true, true);
+		}
+
+		++singlesExchanged;
+		if (singlesExchanged == 2)
+		{
+			// The response and param32, which start the CRCs of the data phase
+			const uint32_t param32 = txBuffer[headerDwords - 1];
+			const uint32_t response = ApplyReceivedFault(dwordFromEsp);
+			samTxCrc = Crc32::Update(Crc32::Initial, &param32, 1);
+			samRxCrc = Crc32::Update(Crc32::Initial, &response, 1);
+			return Exchange(dwordFromEsp, false, false);
+		}
+
+		// The CRCs and the acknowledgement aren't stored in the receive buffer
+		++dwordsClocked;
+		const uint32_t received = ApplyReceivedFault(dwordFromEsp);
+		uint32_t ret = 0;
+		switch (singlesExchanged)
+		{
+		case 1:												// header CRCs
+			ret = Crc32::Calc(txBuffer.data(), headerDwords - 1);
+			espCrcOk = (received == Crc32::Calc(rxBuffer.data(), headerDwords - 1));
+			break;
+
+		case 3:												// data phase CRCs
+			ret = Crc32::Finish(samTxCrc);
+			espCrcOk = espCrcOk && received == Crc32::Finish(samRxCrc);
+			break;
+
+		case 4:												// the ESP's verdict on our CRCs
+			trailerAck = (int32_t)received;
+			break;
+		}
+		const uint32_t sent = ApplySentFault(ret);
+		++exchangeCount;
+		return sent;
+	}
+}
+
+// End
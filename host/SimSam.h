@@ -0,0 +1,65 @@
+/*
+ * SimSam.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * An in-memory SAM at the other end of the SPI link. Like the real one, it prepares a DMA buffer holding the request
+ * header and data, raises TransferReady and waits for the ESP to clock the transaction. SimHSPI.cpp feeds it each
+ * dword that the firmware transfers. We time each transaction from raising TransferReady to the ESP releasing CS,
+ * and also work out how long the transfers themselves would take at the SPI clock rate that the firmware has set.
+ *
+ * If the format version is MyFramedFormatVersion we also play the SAM's part in the CRC framing. A real SAM knows from the
+ * command which data dwords each side fills in; we are told by SimHSPI.cpp instead.
+ */
+
+#ifndef HOST_SIMSAM_H_
+#define HOST_SIMSAM_H_
+
+#include <cstdint>
+#include <cstddef>
+#include "include/MessageFormats.h"
+
+namespace SimSam
+{
+	const unsigned int MaxLoopsPerTransaction = 1000;	// how many times we call loop() before giving up on a transaction
+
+	struct CommandStats
+	{
+		uint32_t count;
+		uint64_t totalNanos;
+		uint64_t minNanos;
+		uint64_t maxNanos;
+		uint64_t busNanos;								// total time the SPI bus was clocking data
+	};
+
+	void Init();										// reset the simulation and run the firmware's setup()
+
+	// Perform a transaction and return the response code, or ResponseTimeout if the ESP didn't service the request.
+	// Returned data is copied to 'dataIn', up to 'dataInLength' bytes, which is also what we tell the ESP we can receive.
+	int32_t Transaction(NetworkCommand cmd, uint8_t socket, uint8_t flags, uint32_t param32,
+						const void *dataOut, size_t dataOutLength, void *dataIn, size_t dataInLength);
+	void Idle(unsigned int loops);						// call loop() and run the network without sending a request
+
+	void SetFormatVersion(uint8_t version);				// the format version that we put in request headers
+	uint8_t GetReplyFormatVersion();					// from the ESP's header in the last transaction
+	WiFiState GetReplyState();
+	bool GetOverrun();									// true if the ESP clocked more than we could receive in the last transaction
+
+	// Framed transactions
+	void CorruptSent(unsigned int index);				// flip a bit in this dword of what we send in the next transaction, counting the CRCs
+	void CorruptReceived(unsigned int index);			// likewise for what we receive
+	bool GetEspCrcOk();									// true if the ESP's CRCs were correct in the last framed transaction
+	int32_t GetTrailerAck();							// what the ESP sent to say whether our CRCs were correct
+
+	double GetSpiClockHz();								// decoded from the clock control register
+	void SetMaxCleanClockHz(double hz);					// above this clock rate, corrupt every 16th dword that we send. Zero for no limit.
+	const CommandStats& GetStats(NetworkCommand cmd);
+	void ClearStats();
+
+	// Called by SimHSPI.cpp. ExchangeSingle is for the dwords that the ESP exchanges using transfer32, i.e. the response and the CRC framing.
+	// For the rest, espSending and espReceiving say whether the ESP is sending and keeping data or just clocking the bus.
+	uint32_t Exchange(uint32_t dwordFromEsp, bool espSending, bool espReceiving);
+	uint32_t ExchangeSingle(uint32_t dwordFromEsp);
+}
+
+#endif /* HOST_SIMSAM_H_ */
@@ -0,0 +1,79 @@
+/*
+ * Arduino.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the parts of the ESP8266 Arduino core that the firmware uses. SimCore.cpp implements it.
+ */
+
+#ifndef HOST_STUBS_ARDUINO_H_
+#define HOST_STUBS_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c_types.h"
+#include "pgmspace.h"
+#include "esp8266_peri.h"
+
+#define HIGH			0x1
+#define LOW				0x0
+
+#define INPUT			0x00
+#define OUTPUT			0x01
+
+#define RISING			0x01
+#define FALLING			0x02
+#define CHANGE			0x03
+
+#define D4				(2)
+
+#define ADC_MODE(_mode)	extern int __get_adc_mode(void)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ets_printf(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+void stats_display(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*userFunc)(void), int mode);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts();
+void interrupts();
+
+// Counts how deeply interrupts are disabled, so that tests can check that the firmware re-enables them
+extern int hostInterruptsDisabled;
+
+#ifdef __cplusplus
+
+class EspClass
+{
+public:
+	uint16_t getVcc() { return 3300; }
+	uint32_t getFreeHeap();
+	uint32_t getCycleCount();
+	uint8_t getCpuFreqMHz() { return 80; }
+	bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+	bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+};
+
+extern EspClass ESP;
+
+# include "WString.h"
+# include "HardwareSerial.h"
+#endif
+
+#endif /* HOST_STUBS_ARDUINO_H_ */
@@ -0,0 +1,33 @@
+/*
+ * DNSServer.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 core's captive portal DNS server. The simulation has no UDP, so it does nothing.
+ */
+
+#ifndef HOST_STUBS_DNSSERVER_H_
+#define HOST_STUBS_DNSSERVER_H_
+
+#include "ESP8266WiFi.h"
+
+enum class DNSReplyCode
+{
+	NoError = 0,
+	FormError = 1,
+	ServerFailure = 2,
+	NonExistentDomain = 3,
+	NotImplemented = 4,
+	Refused = 5
+};
+
+class DNSServer
+{
+public:
+	void processNextRequest() { }
+	void setErrorReplyCode(const DNSReplyCode& replyCode) { }
+	bool start(uint16_t port, const char *domainName, const IPAddress& resolvedIP) { return true; }
+	void stop() { }
+};
+
+#endif /* HOST_STUBS_DNSSERVER_H_ */
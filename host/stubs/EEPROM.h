@@ -0,0 +1,60 @@
+/*
+ * EEPROM.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 core's EEPROM emulation. Like the real one, it keeps a RAM copy of the
+ * last sector below the SPIFFS area and writes it back to the simulated flash on commit().
+ */
+
+#ifndef HOST_STUBS_EEPROM_H_
+#define HOST_STUBS_EEPROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass
+{
+public:
+	void begin(size_t size);
+	bool commit();
+	void end();
+
+	uint8_t read(int address) const { return (address >= 0 && (size_t)address < size) ? data[address] : 0; }
+	void write(int address, uint8_t val) { if (address >= 0 && (size_t)address < size) { data[address] = val; dirty = true; } }
+	uint8_t *getDataPtr() { dirty = true; return data; }
+
+	template<typename T> T& get(int address, T& t) const
+	{
+		if (address >= 0 && address + sizeof(T) <= size)
+		{
+			memcpy((uint8_t*)&t, data + address, sizeof(T));
+		}
+		return t;
+	}
+
+	template<typename T> const T* getPtr(int address) const
+	{
+		return (address >= 0 && address + sizeof(T) <= size) ? (const T*)(data + address) : nullptr;
+	}
+
+	template<typename T> const T& put(int address, const T& t)
+	{
+		if (address >= 0 && address + sizeof(T) <= size)
+		{
+			memcpy(data + address, (const uint8_t*)&t, sizeof(T));
+			dirty = true;
+		}
+		return t;
+	}
+
+private:
+	uint8_t *data = nullptr;
+	size_t size = 0;
+	bool dirty = false;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* HOST_STUBS_EEPROM_H_ */
@@ -0,0 +1,124 @@
+/*
+ * ESP8266WiFi.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 core's WiFi class. There is no radio in the simulation: the station never
+ * finds an access point unless a test tells it to, and scans find only the networks that a test has set up.
+ */
+
+#ifndef HOST_STUBS_ESP8266WIFI_H_
+#define HOST_STUBS_ESP8266WIFI_H_
+
+#include "Arduino.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+class IPAddress
+{
+public:
+	IPAddress() : address(0) { }
+	IPAddress(uint32_t addr) : address(addr) { }
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) { }
+
+	operator uint32_t() const { return address; }
+
+private:
+	uint32_t address;
+};
+
+typedef enum
+{
+	WIFI_OFF = 0,
+	WIFI_STA = 1,
+	WIFI_AP = 2,
+	WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum
+{
+	WL_IDLE_STATUS = 0,
+	WL_NO_SSID_AVAIL = 1,
+	WL_SCAN_COMPLETED = 2,
+	WL_CONNECTED = 3,
+	WL_CONNECT_FAILED = 4,
+	WL_CONNECTION_LOST = 5,
+	WL_DISCONNECTED = 6
+} wl_status_t;
+
+struct WiFiEventStationModeConnected
+{
+	String ssid;
+	uint8_t bssid[6];
+	uint8_t channel;
+};
+
+struct WiFiEventStationModeGotIP
+{
+	IPAddress ip;
+	IPAddress mask;
+	IPAddress gw;
+};
+
+// As in the WiFi library, a handler stays registered for as long as the firmware holds on to the WiFiEventHandler
+struct WiFiEventHandlerOpaque
+{
+	std::function<void(const WiFiEventStationModeConnected&)> onConnected;
+	std::function<void(const WiFiEventStationModeGotIP&)> onGotIp;
+};
+
+typedef std::shared_ptr<WiFiEventHandlerOpaque> WiFiEventHandler;
+
+class ESP8266WiFiClass
+{
+public:
+	bool mode(WiFiMode_t m);
+	WiFiMode_t getMode() const { return currentMode; }
+	void persistent(bool persistent) { }
+	bool setAutoConnect(bool autoConnect) { return true; }
+	bool setAutoReconnect(bool autoReconnect) { return true; }
+
+	bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+	wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true);
+	bool disconnect(bool wifioff = false);
+	wl_status_t status();
+
+	IPAddress localIP() const { return staIp; }
+	IPAddress gatewayIP() const { return staGateway; }
+	IPAddress subnetMask() const { return staNetmask; }
+	IPAddress dnsIP(uint8_t dns_no = 0) const { return staDns; }
+	uint8_t *BSSID();
+	int32_t channel() const;
+
+	bool softAPConfig(IPAddress local_ip, IPAddress gateway, IPAddress subnet);
+	bool softAP(const char *ssid, const char *passphrase = nullptr, int channel = 1, int ssid_hidden = 0, int max_connection = 4);
+	bool softAPdisconnect(bool wifioff = false);
+	IPAddress softAPIP() const { return apIp; }
+
+	WiFiEventHandler onStationModeConnected(std::function<void(const WiFiEventStationModeConnected&)> f);
+	WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)> f);
+	void SendStationEvents();						// called by the simulation when the station has connected
+
+	int8_t scanNetworks(bool async = false, bool show_hidden = false);
+	void scanNetworksAsync(std::function<void(int)> onComplete, bool show_hidden = false);
+	void scanDelete();
+	String SSID(uint8_t networkItem) const;
+	int32_t RSSI(uint8_t networkItem) const;
+	uint8_t *BSSID(uint8_t networkItem);
+	int32_t channel(uint8_t networkItem) const;
+	uint8_t encryptionType(uint8_t networkItem) const;
+	bool isHidden(uint8_t networkItem) const;
+	void *getScanInfoByIndex(int i);
+
+private:
+	WiFiMode_t currentMode = WIFI_OFF;
+	IPAddress staIp, staGateway, staNetmask, staDns, apIp;
+	std::vector<std::weak_ptr<WiFiEventHandlerOpaque>> eventHandlers;
+
+	void AssignDhcpAddress();						// what DHCP gives us
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif /* HOST_STUBS_ESP8266WIFI_H_ */
@@ -0,0 +1,23 @@
+/*
+ * HardwareSerial.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the Arduino serial port. Debug output goes through ets_printf instead.
+ */
+
+#ifndef HOST_STUBS_HARDWARESERIAL_H_
+#define HOST_STUBS_HARDWARESERIAL_H_
+
+#include "Arduino.h"
+
+class HardwareSerial
+{
+public:
+	void begin(unsigned long baud) { }
+	void setDebugOutput(bool en) { }
+};
+
+extern HardwareSerial Serial;
+
+#endif /* HOST_STUBS_HARDWARESERIAL_H_ */
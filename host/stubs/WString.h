@@ -0,0 +1,27 @@
+/*
+ * WString.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the Arduino String class
+ */
+
+#ifndef HOST_STUBS_WSTRING_H_
+#define HOST_STUBS_WSTRING_H_
+
+#include <string>
+
+class String
+{
+public:
+	String() { }
+	String(const char *s) : str((s == nullptr) ? "" : s) { }
+
+	const char *c_str() const { return str.c_str(); }
+	unsigned int length() const { return str.length(); }
+
+private:
+	std::string str;
+};
+
+#endif /* HOST_STUBS_WSTRING_H_ */
@@ -0,0 +1,25 @@
+/*
+ * c_types.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 SDK's c_types.h
+ */
+
+#ifndef HOST_STUBS_C_TYPES_H_
+#define HOST_STUBS_C_TYPES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef uint32_t uint32;
+typedef int32_t sint32;
+
+#define ICACHE_RAM_ATTR
+#define ICACHE_FLASH_ATTR
+
+#endif /* HOST_STUBS_C_TYPES_H_ */
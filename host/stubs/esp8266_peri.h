@@ -0,0 +1,16 @@
+/*
+ * esp8266_peri.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 peripheral registers. Only the ones that code outside HSPI.cpp reads are here.
+ */
+
+#ifndef HOST_STUBS_ESP8266_PERI_H_
+#define HOST_STUBS_ESP8266_PERI_H_
+
+#include <stdint.h>
+
+extern volatile uint32_t SPI1CLK;					// SimHSPI.cpp keeps the clock control word here
+
+#endif /* HOST_STUBS_ESP8266_PERI_H_ */
@@ -0,0 +1,32 @@
+/*
+ * lwip/apps/mdns.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's mDNS responder. The simulation has no UDP, so it only records what was registered.
+ */
+
+#ifndef HOST_STUBS_LWIP_APPS_MDNS_H_
+#define HOST_STUBS_LWIP_APPS_MDNS_H_
+
+#include "lwip/err.h"
+#include "lwip/netif.h"
+
+enum mdns_sd_proto
+{
+	DNSSD_PROTO_UDP = 0,
+	DNSSD_PROTO_TCP = 1
+};
+
+struct mdns_service;
+
+typedef void (*service_get_txt_fn_t)(struct mdns_service *service, void *txt_userdata);
+
+void mdns_resp_init(void);
+err_t mdns_resp_add_netif(struct netif *netif, const char *hostname, u32_t dns_ttl);
+err_t mdns_resp_remove_netif(struct netif *netif);
+err_t mdns_resp_add_service(struct netif *netif, const char *name, const char *service, enum mdns_sd_proto proto, u16_t port, u32_t dns_ttl, service_get_txt_fn_t txt_fn, void *txt_userdata);
+err_t mdns_resp_add_service_txtitem(struct mdns_service *service, const char *txt, u8_t txt_len);
+void mdns_resp_netif_settings_changed(struct netif *netif);
+
+#endif /* HOST_STUBS_LWIP_APPS_MDNS_H_ */
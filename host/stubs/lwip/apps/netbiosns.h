@@ -0,0 +1,15 @@
+/*
+ * lwip/apps/netbiosns.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's NetBIOS name responder
+ */
+
+#ifndef HOST_STUBS_LWIP_APPS_NETBIOSNS_H_
+#define HOST_STUBS_LWIP_APPS_NETBIOSNS_H_
+
+void netbiosns_init(void);
+void netbiosns_set_name(const char *hostname);
+
+#endif /* HOST_STUBS_LWIP_APPS_NETBIOSNS_H_ */
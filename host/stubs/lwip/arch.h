@@ -0,0 +1,24 @@
+/*
+ * lwip/arch.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's basic types
+ */
+
+#ifndef HOST_STUBS_LWIP_ARCH_H_
+#define HOST_STUBS_LWIP_ARCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t u8_t;
+typedef int8_t s8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+
+#define LWIP_UNUSED_ARG(x)	(void)x
+
+#endif /* HOST_STUBS_LWIP_ARCH_H_ */
@@ -0,0 +1,22 @@
+/*
+ * lwip/dhcp.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's DHCP client data. The station has a DHCP client whenever the simulated radio
+ * gave it its address.
+ */
+
+#ifndef HOST_STUBS_LWIP_DHCP_H_
+#define HOST_STUBS_LWIP_DHCP_H_
+
+#include "lwip/netif.h"
+
+struct dhcp
+{
+	u32_t offered_t0_lease;		// lease time in seconds
+};
+
+struct dhcp *netif_dhcp_data(struct netif *netif);
+
+#endif /* HOST_STUBS_LWIP_DHCP_H_ */
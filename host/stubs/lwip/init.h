@@ -0,0 +1,16 @@
+/*
+ * lwip/init.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's version information. The simulation behaves like the lwIP 2 build.
+ */
+
+#ifndef HOST_STUBS_LWIP_INIT_H_
+#define HOST_STUBS_LWIP_INIT_H_
+
+#define LWIP_VERSION_MAJOR		2
+#define LWIP_VERSION_MINOR		0
+#define LWIP_VERSION_REVISION	3
+
+#endif /* HOST_STUBS_LWIP_INIT_H_ */
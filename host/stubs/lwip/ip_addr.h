@@ -0,0 +1,24 @@
+/*
+ * lwip/ip_addr.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's IPv4 address type
+ */
+
+#ifndef HOST_STUBS_LWIP_IP_ADDR_H_
+#define HOST_STUBS_LWIP_IP_ADDR_H_
+
+#include "lwip/arch.h"
+
+typedef struct ip4_addr
+{
+	u32_t addr;
+} ip_addr_t;
+
+extern const ip_addr_t ip_addr_any;
+
+#define IPADDR_ANY		((u32_t)0x00000000UL)
+#define IP_ADDR_ANY		(&ip_addr_any)
+
+#endif /* HOST_STUBS_LWIP_IP_ADDR_H_ */
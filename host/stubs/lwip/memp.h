@@ -0,0 +1,24 @@
+/*
+ * lwip/memp.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's memory pools. Only MEMP_TCP_SEG is used by the simulation.
+ */
+
+#ifndef HOST_STUBS_LWIP_MEMP_H_
+#define HOST_STUBS_LWIP_MEMP_H_
+
+typedef enum
+{
+	MEMP_RAW_PCB,
+	MEMP_UDP_PCB,
+	MEMP_TCP_PCB,
+	MEMP_TCP_PCB_LISTEN,
+	MEMP_TCP_SEG,
+	MEMP_PBUF,
+	MEMP_PBUF_POOL,
+	MEMP_MAX
+} memp_t;
+
+#endif /* HOST_STUBS_LWIP_MEMP_H_ */
@@ -0,0 +1,24 @@
+/*
+ * lwip/netif.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's network interface list. The simulation has a station and an access point interface.
+ */
+
+#ifndef HOST_STUBS_LWIP_NETIF_H_
+#define HOST_STUBS_LWIP_NETIF_H_
+
+#include "lwip/ip_addr.h"
+
+struct netif
+{
+	struct netif *next;
+	ip_addr_t ip_addr;
+	char name[2];
+	u8_t num;
+};
+
+extern struct netif *netif_list;
+
+#endif /* HOST_STUBS_LWIP_NETIF_H_ */
@@ -0,0 +1,26 @@
+/*
+ * lwip/pbuf.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP packet buffers. SimNet.cpp allocates them from the simulated heap.
+ */
+
+#ifndef HOST_STUBS_LWIP_PBUF_H_
+#define HOST_STUBS_LWIP_PBUF_H_
+
+#include "lwip/arch.h"
+
+struct pbuf
+{
+	struct pbuf *next;
+	void *payload;
+	u16_t tot_len;
+	u16_t len;
+	u16_t ref;
+};
+
+u8_t pbuf_free(struct pbuf *p);
+void pbuf_cat(struct pbuf *head, struct pbuf *tail);
+
+#endif /* HOST_STUBS_LWIP_PBUF_H_ */
@@ -0,0 +1,37 @@
+/*
+ * lwip/stats.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's statistics. SimNet.cpp keeps the pool statistics up to date.
+ */
+
+#ifndef HOST_STUBS_LWIP_STATS_H_
+#define HOST_STUBS_LWIP_STATS_H_
+
+#include "lwip/arch.h"
+#include "lwip/memp.h"
+
+#define LWIP_STATS	1
+#define MEMP_STATS	1
+
+struct stats_mem
+{
+	const char *name;
+	u16_t err;
+	u16_t avail;
+	u16_t used;
+	u16_t max;
+	u16_t illegal;
+};
+
+struct stats_
+{
+	struct stats_mem *memp[MEMP_MAX];
+};
+
+extern struct stats_ lwip_stats;
+
+void stats_display(void);
+
+#endif /* HOST_STUBS_LWIP_STATS_H_ */
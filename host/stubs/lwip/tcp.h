@@ -0,0 +1,102 @@
+/*
+ * lwip/tcp.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for lwIP's raw TCP API. SimNet.cpp implements it as a loopback to simulated clients.
+ * The limits are the ones the ESP8266 core builds lwIP with.
+ */
+
+#ifndef HOST_STUBS_LWIP_TCP_H_
+#define HOST_STUBS_LWIP_TCP_H_
+
+#include "lwip/arch.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+#define TCP_MSS					1460
+#define TCP_WND					(4 * TCP_MSS)
+#define TCP_SND_BUF				(2 * TCP_MSS)
+#define TCP_SND_QUEUELEN		((4 * (TCP_SND_BUF) + (TCP_MSS - 1))/(TCP_MSS))
+#define TCP_SNDLOWAT			LWIP_MIN(LWIP_MAX(((TCP_SND_BUF)/2), (2 * TCP_MSS) + 1), (TCP_SND_BUF) - 1)
+#define TCP_SLOW_INTERVAL		500
+
+#define LWIP_MIN(x, y)			(((x) < (y)) ? (x) : (y))
+#define LWIP_MAX(x, y)			(((x) > (y)) ? (x) : (y))
+
+#define TCP_WRITE_FLAG_COPY		0x01
+#define TCP_WRITE_FLAG_MORE		0x02
+
+#define SOF_REUSEADDR			0x04
+
+enum tcp_state
+{
+	CLOSED = 0,
+	LISTEN = 1,
+	SYN_SENT = 2,
+	SYN_RCVD = 3,
+	ESTABLISHED = 4,
+	FIN_WAIT_1 = 5,
+	FIN_WAIT_2 = 6,
+	CLOSE_WAIT = 7,
+	CLOSING = 8,
+	LAST_ACK = 9,
+	TIME_WAIT = 10
+};
+
+struct tcp_pcb;
+
+typedef err_t (*tcp_accept_fn)(void *arg, struct tcp_pcb *newpcb, err_t err);
+typedef err_t (*tcp_recv_fn)(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
+typedef err_t (*tcp_sent_fn)(void *arg, struct tcp_pcb *tpcb, u16_t len);
+typedef void (*tcp_err_fn)(void *arg, err_t err);
+
+struct tcp_pcb
+{
+	ip_addr_t local_ip;
+	ip_addr_t remote_ip;
+	u8_t so_options;
+	enum tcp_state state;
+	u16_t local_port;
+	u16_t remote_port;
+
+	void *callback_arg;
+	tcp_accept_fn accept;
+	tcp_recv_fn recv;
+	tcp_sent_fn sent;
+	tcp_err_fn errf;
+
+	u16_t mss;
+	u16_t snd_buf;
+	u16_t snd_queuelen;
+	u16_t rcv_wnd;
+	s16_t sa;							// smoothed round trip time, times 8, in slow timer ticks
+	u8_t nrtx;							// number of retransmissions, always zero here because the simulated network never loses anything
+	u8_t backlog;
+	u8_t accepts_pending;
+
+	void *sim;							// the simulated connection that this pcb belongs to
+};
+
+#define tcp_mss(pcb)			((pcb)->mss)
+#define tcp_sndbuf(pcb)			((pcb)->snd_buf)
+#define tcp_sndqueuelen(pcb)	((pcb)->snd_queuelen)
+#define tcp_accepted(pcb)		do { LWIP_UNUSED_ARG(pcb); } while (0)
+#define tcp_listen(pcb)			tcp_listen_with_backlog(pcb, 0xFF)
+
+struct tcp_pcb *tcp_new(void);
+err_t tcp_bind(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port);
+struct tcp_pcb *tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog);
+void tcp_arg(struct tcp_pcb *pcb, void *arg);
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept);
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv);
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent);
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err);
+void tcp_recved(struct tcp_pcb *pcb, u16_t len);
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags);
+err_t tcp_output(struct tcp_pcb *pcb);
+err_t tcp_close(struct tcp_pcb *pcb);
+void tcp_abort(struct tcp_pcb *pcb);
+
+#endif /* HOST_STUBS_LWIP_TCP_H_ */
@@ -0,0 +1,15 @@
+/*
+ * pgmspace.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 core's pgmspace.h
+ */
+
+#ifndef HOST_STUBS_PGMSPACE_H_
+#define HOST_STUBS_PGMSPACE_H_
+
+#define PROGMEM
+#define PSTR(_s)	(_s)
+
+#endif /* HOST_STUBS_PGMSPACE_H_ */
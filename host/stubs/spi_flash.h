@@ -0,0 +1,28 @@
+/*
+ * spi_flash.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 SDK's flash API. SimCore.cpp implements it in RAM.
+ */
+
+#ifndef HOST_STUBS_SPI_FLASH_H_
+#define HOST_STUBS_SPI_FLASH_H_
+
+#include "c_types.h"
+
+typedef enum
+{
+	SPI_FLASH_RESULT_OK,
+	SPI_FLASH_RESULT_ERR,
+	SPI_FLASH_RESULT_TIMEOUT
+} SpiFlashOpResult;
+
+#define SPI_FLASH_SEC_SIZE	4096
+
+uint32 spi_flash_get_id(void);
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec);
+SpiFlashOpResult spi_flash_write(uint32 des_addr, uint32 *src_addr, uint32 size);
+SpiFlashOpResult spi_flash_read(uint32 src_addr, uint32 *des_addr, uint32 size);
+
+#endif /* HOST_STUBS_SPI_FLASH_H_ */
@@ -0,0 +1,27 @@
+/*
+ * umm_malloc/umm_malloc.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the ESP8266 core's heap allocator. The simulated heap is never fragmented.
+ */
+
+#ifndef HOST_STUBS_UMM_MALLOC_H_
+#define HOST_STUBS_UMM_MALLOC_H_
+
+typedef struct
+{
+	unsigned short int totalEntries;
+	unsigned short int usedEntries;
+	unsigned short int freeEntries;
+	unsigned short int totalBlocks;
+	unsigned short int usedBlocks;
+	unsigned short int freeBlocks;
+	unsigned short int maxFreeContiguousBlocks;
+} UMM_HEAP_INFO;
+
+extern UMM_HEAP_INFO ummHeapInfo;
+
+void *umm_info(void *ptr, int force);
+
+#endif /* HOST_STUBS_UMM_MALLOC_H_ */
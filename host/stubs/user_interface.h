@@ -0,0 +1,97 @@
+/*
+ * user_interface.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Host build stand-in for the parts of the ESP8266 SDK's user_interface.h that the firmware uses
+ */
+
+#ifndef HOST_STUBS_USER_INTERFACE_H_
+#define HOST_STUBS_USER_INTERFACE_H_
+
+#include "c_types.h"
+#include "spi_flash.h"
+
+#define STATION_IF		0x00
+#define SOFTAP_IF		0x01
+
+struct rst_info
+{
+	uint32 reason;
+	uint32 exccause;
+	uint32 epc1;
+	uint32 epc2;
+	uint32 epc3;
+	uint32 excvaddr;
+	uint32 depc;
+};
+
+typedef enum
+{
+	STATION_IDLE = 0,
+	STATION_CONNECTING,
+	STATION_WRONG_PASSWORD,
+	STATION_NO_AP_FOUND,
+	STATION_CONNECT_FAIL,
+	STATION_GOT_IP
+} station_status_t;
+
+typedef enum
+{
+	AUTH_OPEN = 0,
+	AUTH_WEP,
+	AUTH_WPA_PSK,
+	AUTH_WPA2_PSK,
+	AUTH_WPA_WPA2_PSK,
+	AUTH_MAX
+} AUTH_MODE;
+
+struct bss_info									// the SDK's record of a network found by a scan, less the list linkage and the cipher details
+{
+	uint8 bssid[6];
+	uint8 ssid[32];
+	uint8 ssid_len;
+	uint8 channel;
+	sint8 rssi;
+	AUTH_MODE authmode;
+	uint8 is_hidden;
+};
+
+enum dhcp_status
+{
+	DHCP_STOPPED,
+	DHCP_STARTED
+};
+
+enum sleep_type
+{
+	NONE_SLEEP_T = 0,
+	LIGHT_SLEEP_T,
+	MODEM_SLEEP_T
+};
+
+enum phy_mode
+{
+	PHY_MODE_11B = 1,
+	PHY_MODE_11G = 2,
+	PHY_MODE_11N = 3
+};
+
+struct rst_info *system_get_rst_info(void);
+uint32 system_get_free_heap_size(void);
+uint16 system_get_vdd33(void);
+void system_phy_set_max_tpw(uint8 max_tpw);
+void system_soft_wdt_feed(void);
+
+bool wifi_get_macaddr(uint8 if_index, uint8 *macaddr);
+enum phy_mode wifi_get_phy_mode(void);
+enum sleep_type wifi_get_sleep_type(void);
+bool wifi_set_sleep_type(enum sleep_type type);
+uint8 wifi_softap_get_station_num(void);
+uint8 wifi_station_get_connect_status(void);
+bool wifi_station_disconnect(void);
+enum dhcp_status wifi_station_dhcpc_status(void);
+sint8 wifi_station_get_rssi(void);
+bool wifi_station_set_hostname(char *name);
+
+#endif /* HOST_STUBS_USER_INTERFACE_H_ */
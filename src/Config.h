@@ -5,7 +5,7 @@
 
 #define NO_WIFI_SLEEP	0
 
-#define VERSION_MAIN	"1.26"
+#define VERSION_MAIN	"1.27"
 
 #if NO_WIFI_SLEEP
 #define VERSION_SLEEP	"-nosleep"
@@ -34,9 +34,19 @@ const uint32_t maxSpiFileData = 2048;
 // 0x3043	20MHz 2:2
 
 // The SAM occasionally transmits incorrect data at 40MHz, so we now use 26.7MHz.
+// A SAM that uses framed transactions (see MessageFormats.h) can detect and recover from such errors, so it may select 40MHz using networkSetClockControl.
 // Due to the 15ns SCLK to MISO delay of the SAMD51, 2:1 is preferred over 1:2
 const uint32_t defaultClockControl = 0x2002;		// 80MHz/3, mark:space 2:1
 
+// Candidate values of the SPI clock register for networkCalibrateClock, fastest first.
+// The first NumFastClockCandidates are faster than defaultClockControl, so we only select them for a SAM that uses framed transactions.
+const uint32_t CalibrationClockCandidates[] = { 0x1001, 0x2001, 0x2402, 0x2002, 0x3043 };
+const size_t NumFastClockCandidates = 1;
+
+// Long SPI transfers can use the two halves of the FIFO alternately so that the clock doesn't stop while we refill it.
+// This is off until it has been measured against a real SAM, which then sees less idle time between FIFO loads.
+const bool defaultPipelinedSpi = false;
+
 // Pin numbers
 const int SamSSPin = 15;          // GPIO15, output to SAM, SS pin for SPI transfer
 const int EspReqTransferPin = 0;  // GPIO0, output, indicates to the SAM that we want to send something
@@ -44,6 +54,16 @@ const int SamTfrReadyPin = 4;     // GPIO4, input, indicates that SAM is ready t
 
 const uint8_t Backlog = 8;
 
+// Memory governor thresholds. Below these we refuse new connections and hold back receive window updates, so that established transfers can finish.
+const size_t MinFreeHeapToAccept = 12 * 1024;		// don't accept new connections if the free heap is less than this
+const size_t MinFreePbufsToAccept = 4;				// don't accept new connections if fewer pbufs than this are free in the pbuf pool
+const size_t LowFreeHeap = 8 * 1024;				// hold back receive window updates if the free heap is less than this...
+const size_t LowFreeHeapHysteresis = 2 * 1024;		// ...until it has recovered by this much
+
+// Write capacity estimation. Each MSS-sized chunk of outgoing data needs a pbuf allocated from the heap.
+const size_t TxPbufAllocationSize = 1560;			// heap used by one MSS-sized outgoing pbuf, including headers and allocation overhead
+const size_t WriteHeapReserve = 4 * 1024;			// heap we leave for LWIP and incoming data when estimating how much can be written
+
 #define ARRAY_SIZE(_x) (sizeof(_x)/sizeof((_x)[0]))
 
 #ifdef DEBUG
@@ -9,6 +9,9 @@
 #include "algorithm"			// for std::min
 #include "Arduino.h"			// for millis
 #include "Config.h"
+#include "HSPI.h"
+#include "EventQueue.h"
+#include "MemoryGovernor.h"
 
 const uint32_t MaxWriteTime = 2000;		// how long we wait for a write operation to complete before it is cancelled
 const uint32_t MaxAckTime = 4000;		// how long we wait for a connection to acknowledge the remaining data before it is closed
@@ -18,6 +21,8 @@ extern "C"
 {
 	#include "lwip/init.h"				// for version info
 	#include "lwip/tcp.h"
+	#include "lwip/memp.h"				// for MEMP_TCP_SEG
+	#include "user_interface.h"			// for system_get_free_heap_size()
 
 	static void conn_err(void *arg, err_t err)
 	{
@@ -46,10 +51,13 @@ extern "C"
 	}
 }
 
+const size_t OverflowBufferSize = TCP_SND_BUF;		// we never accept more than tcp_sndbuf() returns, so this is enough for one write
+
 // Public interface
 Connection::Connection(uint8_t num)
-	: number(num), state(ConnState::free), localPort(0), remotePort(0), remoteIp(0), writeTimer(0), closeTimer(0),
-	  unAcked(0), readIndex(0), alreadyRead(0), ownPcb(nullptr), pb(nullptr)
+	: number(num), state(ConnState::free), changeCount(0), localPort(0), remotePort(0), remoteIp(0), writeTimer(0), closeTimer(0),
+	  unAcked(0), readIndex(0), alreadyRead(0), peakUnAcked(0), bytesReceived(0), bytesRead(0), bytesWritten(0), bytesAcked(0), writeFailures(0),
+	  windowUpdateHeld(false), ownPcb(nullptr), pb(nullptr)
 {
 }
 
@@ -64,13 +72,56 @@ void Connection::GetStatus(ConnStatusResponse& resp) const
 	resp.remoteIp = remoteIp;
 }
 
+void Connection::GetTraffic(ConnTrafficCounters& traffic) const
+{
+	traffic.bytesReceived = bytesReceived;
+	traffic.bytesRead = bytesRead;
+	traffic.bytesWritten = bytesWritten;
+	traffic.bytesAcked = bytesAcked;
+	traffic.writeFailures = writeFailures;
+	traffic.peakUnAcked = std::min<size_t>(peakUnAcked, UINT16_MAX);
+	if (ownPcb != nullptr)
+	{
+		traffic.srttMillis = std::min<uint32_t>((uint32_t)(ownPcb->sa >> 3) * TCP_SLOW_INTERVAL, UINT16_MAX);
+		traffic.retransmissions = ownPcb->nrtx;
+	}
+	else
+	{
+		traffic.srttMillis = 0;
+		traffic.retransmissions = 0;
+	}
+}
+
+void Connection::GetSummary(ConnSummary& summary) const
+{
+	summary.state = state;
+	summary.changeCount = changeCount;
+	summary.bytesAvailable = std::min<size_t>(CanRead(), UINT16_MAX);
+	summary.writeBufferSpace = std::min<size_t>(CanWrite(), UINT16_MAX);
+	summary.localPort = localPort;
+	summary.remotePort = remotePort;
+	summary.zero = 0;
+}
+
+void Connection::GetDiagnostics(ConnDiagnostics& diags) const
+{
+	diags.state = state;
+	diags.changeCount = changeCount;
+	diags.localPort = localPort;
+	diags.remotePort = remotePort;
+	diags.unAcked = std::min<size_t>((size_t)unAcked, UINT16_MAX);
+	diags.remoteIp = remoteIp;
+	diags.bytesAvailable = std::min<size_t>(CanRead(), UINT16_MAX);
+	diags.writeBufferSpace = std::min<size_t>(CanWrite(), UINT16_MAX);
+}
+
 // Close the connection gracefully
 void Connection::Close()
 {
 	switch(state)
 	{
 	case ConnState::connected:						// both ends are still connected
-		if (unAcked != 0)
+		if (unAcked != 0 || overflowOwner == this)
 		{
 			closeTimer = millis();
 			SetState(ConnState::closePending);		// wait for the remaining data to be sent before closing
@@ -78,6 +129,13 @@ void Connection::Close()
 		}
 		// no break
 	case ConnState::otherEndClosed:					// the other end has already closed the connection
+		if (state == ConnState::otherEndClosed && overflowOwner == this)
+		{
+			closeTimer = millis();
+			SetState(ConnState::closePending);		// we can still send, so let the overflow buffer drain first
+			break;
+		}
+		// no break
 	case ConnState::closeReady:						// the other end has closed and we were already closePending
 	default:										// should not happen
 		if (ownPcb != nullptr)
@@ -89,6 +147,7 @@ void Connection::Close()
 			ownPcb = nullptr;
 		}
 		unAcked = 0;
+		ReleaseOverflow();
 		FreePbuf();
 		SetState(ConnState::free);
 		break;
@@ -114,6 +173,7 @@ void Connection::Terminate(bool external)
 		ownPcb = nullptr;
 	}
 	unAcked = 0;
+	ReleaseOverflow();
 	FreePbuf();
 	SetState((external) ? ConnState::free : ConnState::aborted);
 }
@@ -121,7 +181,19 @@ void Connection::Terminate(bool external)
 // Perform housekeeping tasks
 void Connection::Poll()
 {
-	if (state == ConnState::connected)
+	if (state == ConnState::connected || state == ConnState::otherEndClosed)
+	{
+		// If we held back a receive window update because memory was short, see whether we can send it now
+		UpdateReceiveWindow();
+	}
+
+	// The other end closing only stops it sending to us, so we can carry on draining the overflow buffer in the otherEndClosed state too
+	if (overflowOwner == this && (state == ConnState::connected || state == ConnState::otherEndClosed || state == ConnState::closePending))
+	{
+		RetryOverflow();
+	}
+
+	if (state == ConnState::connected || (state == ConnState::otherEndClosed && overflowOwner == this))
 	{
 		// Are we still waiting for data to be written?
 		if (writeTimer > 0 && millis() - writeTimer >= MaxWriteTime)
@@ -137,8 +209,8 @@ void Connection::Poll()
 	}
 	else if (state == ConnState::closePending)
 	{
-		// We're about to close this connection and we're still waiting for the remaining data to be acknowledged
-		if (unAcked == 0)
+		// We're about to close this connection and we're still waiting for the remaining data to be sent and acknowledged
+		if (unAcked == 0 && overflowOwner != this)
 		{
 			// All data has been received, close this connection next time
 			SetState(ConnState::closeReady);
@@ -162,13 +234,15 @@ void Connection::Poll()
 // - When it receives a write request from the Duet main processor, our socket server has to say how much data it can accept before accepting it.
 // - So in version 1.21 it sometimes happened that we accept some data based on the amount that tcp_sndbuf say we can, but we can't actually send it.
 // - We then terminate the connection, and the client request fails.
-// To mitigate this we could:
+// To mitigate this we:
 // - Have one overflow write buffer, shared between all connections
 // - Only accept write data from the Duet main processor if the overflow buffer is free
-// - If after accepting data from the Duet main processor we find that we can't send it, we send some of it if we can and store the rest in the overflow buffer
+// - If after accepting data from the Duet main processor we find that we can't send it, we store it in the overflow buffer
 // - Then we push any pending data that we already have, and in Poll() we try to send the data in overflow buffer
 // - When the overflow buffer is empty again, we can start accepting write data from the Duet main processor again.
-// A further mitigation would be to restrict the amount of data we accept so some amount that will fit in the MSS, then tcp_write will need to allocate at most one PBUF.
+// If the overflow buffer is already in use, or LWIP stays short of memory for longer than MaxWriteTime, we still have to terminate the connection.
+// A further mitigation is to restrict the amount of data we accept to whole multiples of the MSS when memory is tight, so that tcp_write doesn't allocate a PBUF
+// for a partial segment that would otherwise be topped up by the next write. See AcceptWriteLength.
 // However, another reason why tcp_write can fail is because MEMP_NUM_TCP_SEG is set too low in Lwip. It now appears that this is the maoin cause of files tcp_write
 // call in version 1.21. So I have increased it from 10 to 16, which seems to have fixed the problem..
 size_t Connection::Write(const uint8_t *data, size_t length, bool doPush, bool closeAfterSending)
@@ -178,20 +252,55 @@ size_t Connection::Write(const uint8_t *data, size_t length, bool doPush, bool c
 		return 0;
 	}
 
+	// If our previous data is still in the overflow buffer then we can't accept any more, but we can remember to push or close afterwards
+	if (overflowOwner == this)
+	{
+		if (length == 0)
+		{
+			overflowPush = overflowPush || doPush || closeAfterSending;
+			overflowClose = overflowClose || closeAfterSending;
+		}
+		return 0;
+	}
+
 	// Try to send all the data
 	const bool push = doPush || closeAfterSending;
+	const size_t estimate = CanWrite();
 	err_t result = tcp_write(ownPcb, data, length, push ? TCP_WRITE_FLAG_COPY : TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+	if (length != 0)
+	{
+		++writesAttempted;
+	}
 	if (result != ERR_OK)
 	{
-		// We failed to write the data. See above for possible mitigations. For now we just terminate the connection.
-		debugPrintfAlways("Write fail len=%u err=%d\n", length, (int)result);
-		Terminate(false);		// chrishamm: Not sure if this helps with LwIP v1.4.3 but it is mandatory for proper error handling with LwIP 2.0.3
-		return 0;
+		++writeFailures;
+		if (result == ERR_MEM && length <= estimate)
+		{
+			++writeEstimateFailures;
+		}
+		if (result != ERR_MEM || overflowOwner != nullptr || length > OverflowBufferSize)
+		{
+			// We failed to write the data and we can't keep it for later, so terminate the connection
+			debugPrintfAlways("Write fail len=%u err=%d\n", length, (int)result);
+			Terminate(false);		// chrishamm: Not sure if this helps with LwIP v1.4.3 but it is mandatory for proper error handling with LwIP 2.0.3
+			return 0;
+		}
+
+		// LWIP is short of memory, so keep the data in the overflow buffer and try again in Poll()
+		memcpy(overflowBuffer, data, length);
+		overflowOwner = this;
+		overflowLength = length;
+		overflowOffset = 0;
+		overflowPush = push;
+		overflowClose = closeAfterSending;
+		writeTimer = millis();
+		tcp_output(ownPcb);		// sending what is already queued may free up some memory
+		return length;
 	}
 
 	// Data was successfully written
 	writeTimer = 0;
-	unAcked += length;
+	WriteCompleted(length);
 
 	// See if we need to push the remaining data
 	if (push || tcp_sndbuf(ownPcb) <= TCP_SNDLOWAT)
@@ -208,11 +317,128 @@ size_t Connection::Write(const uint8_t *data, size_t length, bool doPush, bool c
 	return length;
 }
 
+// Update the counters when LWIP has accepted some data
+void Connection::WriteCompleted(size_t length)
+{
+	unAcked += length;
+	peakUnAcked = std::max<size_t>(peakUnAcked, (size_t)unAcked);
+	bytesWritten += length;
+}
+
+// Try to pass LWIP the data that is waiting in the overflow buffer
+void Connection::RetryOverflow()
+{
+	const size_t amount = std::min<size_t>(overflowLength - overflowOffset, tcp_sndbuf(ownPcb));
+	if (amount == 0)
+	{
+		return;
+	}
+
+	const bool last = (overflowOffset + amount == overflowLength);
+	const err_t result = tcp_write(ownPcb, overflowBuffer + overflowOffset, amount, (last && overflowPush) ? TCP_WRITE_FLAG_COPY : TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+	if (result == ERR_MEM)
+	{
+		return;					// still short of memory, so try again later unless writeTimer expires first
+	}
+	if (result != ERR_OK)
+	{
+		debugPrintfAlways("Overflow write fail len=%u err=%d\n", amount, (int)result);
+		Terminate(false);
+		return;
+	}
+
+	overflowOffset += amount;
+	WriteCompleted(amount);
+	tcp_output(ownPcb);
+	if (!last)
+	{
+		writeTimer = millis();	// we made some progress, so allow more time for the rest
+		return;
+	}
+
+	// The overflow buffer is empty, so all connections can accept data again
+	overflowOwner = nullptr;
+	writeTimer = 0;
+	if (overflowClose)
+	{
+		closeTimer = millis();
+		if (state == ConnState::connected || state == ConnState::otherEndClosed)
+		{
+			SetState(ConnState::closePending);
+		}
+	}
+	++changeCount;
+	EventQueue::Add(ConnEventType::writeSpaceAvailable, number, CanWrite());
+}
+
+// Return how much data we can write with a good chance that LWIP will be able to allocate the memory it needs, or zero if we are waiting to send
+// the data in the overflow buffer. tcp_sndbuf() doesn't take account of the limits on the number of queued segments, or of the heap needed for the pbuf
+// that each MSS-sized chunk is copied into. Outgoing pbufs are allocated from the heap, not from the pbuf pool.
 size_t Connection::CanWrite() const
 {
-	// Return the amount of free space in the write buffer
-	// Note: we cannot necessarily write this amount, because it depends on memory allocations being successful.
-	return (state == ConnState::connected) ? tcp_sndbuf(ownPcb) : 0;
+	WriteBudget budget;
+	GetWriteBudget(budget);
+	return CanWrite(budget);
+}
+
+// As above, but with the heap and segments left over from writes that we have already accepted in this transaction
+size_t Connection::CanWrite(const WriteBudget& budget) const
+{
+	if (state != ConnState::connected || overflowOwner != nullptr)
+	{
+		return 0;
+	}
+
+	const size_t sndbuf = tcp_sndbuf(ownPcb);
+	const size_t mss = tcp_mss(ownPcb);
+	if (sndbuf == 0 || mss == 0)
+	{
+		return sndbuf;
+	}
+
+	// Each chunk needs a segment from the pool, a slot in this connection's send queue, and a pbuf from the heap
+	const size_t freeQueueSlots = (ownPcb->snd_queuelen < TCP_SND_QUEUELEN) ? TCP_SND_QUEUELEN - ownPcb->snd_queuelen : 0;
+	size_t chunks = std::min<size_t>(std::min<size_t>(freeQueueSlots, budget.heapChunks), budget.segments);
+	if (!budget.overflowFree && chunks != 0)
+	{
+		--chunks;								// an earlier write has first call on the overflow buffer, so keep a chunk in hand instead
+	}
+	return std::min<size_t>(sndbuf, chunks * mss);
+}
+
+// Return how much of a write of the specified length we should accept, and take the memory it needs out of the budget.
+// Normally this is as much as CanWrite() says there is room for. When memory is tight and we can accept more than one segment but not all of the data,
+// round the amount down to a whole number of segments. The remainder will be sent by the SAM in a later write, instead of occupying a PBUF of its own now.
+size_t Connection::AcceptWriteLength(size_t length, WriteBudget& budget)
+{
+	const size_t canWrite = CanWrite(budget);
+	if (length == 0 || canWrite == 0 || state != ConnState::connected)
+	{
+		return 0;								// we may not have a pcb at all
+	}
+
+	const size_t mss = tcp_mss(ownPcb);
+	size_t accepted = std::min<size_t>(length, canWrite);
+	if (length > canWrite && mss != 0 && canWrite > mss && (MemoryGovernor::IsLow() || canWrite < tcp_sndbuf(ownPcb)))
+	{
+		const size_t rounded = canWrite - (canWrite % mss);
+		if (rounded != canWrite)
+		{
+			++writesRounded;
+			bytesDeferredByRounding += canWrite - rounded;
+			accepted = rounded;
+		}
+	}
+
+	// The writes to other connections in this transaction can't have the memory that this one will use
+	if (mss != 0)
+	{
+		const size_t chunks = (accepted + mss - 1)/mss;
+		budget.heapChunks -= std::min<size_t>(chunks, budget.heapChunks);
+		budget.segments -= std::min<size_t>(chunks, budget.segments);
+	}
+	budget.overflowFree = false;				// the overflow buffer can only rescue one write
+	return accepted;
 }
 
 size_t Connection::Read(uint8_t *data, size_t length)
@@ -239,13 +465,65 @@ size_t Connection::Read(uint8_t *data, size_t length)
 		} while (pb != nullptr && length != 0);
 
 		alreadyRead += lengthRead;
-		if (pb == nullptr || alreadyRead >= TCP_MSS)
+		bytesRead += lengthRead;
+		UpdateReceiveWindow();
+	}
+	return lengthRead;
+}
+
+// Read data and stream it straight from the pbuf chain into the SPI FIFO, freeing the pbufs as we go.
+// The caller must already have started the stream and must end it afterwards.
+size_t Connection::ReadTo(HSPIClass& spi, size_t length)
+{
+	size_t lengthRead = 0;
+	if (pb != nullptr && length != 0 && (state == ConnState::connected || state == ConnState::otherEndClosed))
+	{
+		do
+		{
+			const size_t toRead = std::min<size_t>(pb->len - readIndex, length);
+			spi.streamBytes((const uint8_t *)pb->payload + readIndex, toRead);
+			lengthRead += toRead;
+			readIndex += toRead;
+			length -= toRead;
+			if (readIndex != pb->len)
+			{
+				break;
+			}
+			pbuf * const currentPb = pb;
+			pb = pb->next;
+			currentPb->next = nullptr;
+			pbuf_free(currentPb);
+			readIndex = 0;
+		} while (pb != nullptr && length != 0);
+
+		alreadyRead += lengthRead;
+		bytesRead += lengthRead;
+		UpdateReceiveWindow();
+	}
+	return lengthRead;
+}
+
+// Tell LWIP how much data we have read so that it can open the receive window again.
+// If memory is short then we hold the update back until we have read half a window, so that the sender slows down.
+void Connection::UpdateReceiveWindow()
+{
+	if (alreadyRead != 0 && (pb == nullptr || alreadyRead >= TCP_MSS))
+	{
+		if (alreadyRead < TCP_WND/2 && MemoryGovernor::IsLow())
+		{
+			if (!windowUpdateHeld)
+			{
+				windowUpdateHeld = true;
+				MemoryGovernor::NoteWindowUpdateHeld();
+			}
+		}
+		else
 		{
 			tcp_recved(ownPcb, alreadyRead);
 			alreadyRead = 0;
+			windowUpdateHeld = false;
 		}
 	}
-	return lengthRead;
 }
 
 size_t Connection::CanRead() const
@@ -291,7 +569,10 @@ int Connection::Accept(tcp_pcb *pcb)
 	remotePort = pcb->remote_port;
 	remoteIp = pcb->remote_ip.addr;
 	writeTimer = closeTimer = 0;
-	unAcked = readIndex = alreadyRead = 0;
+	unAcked = readIndex = alreadyRead = peakUnAcked = 0;
+	bytesReceived = bytesRead = bytesWritten = bytesAcked = 0;
+	writeFailures = 0;
+	windowUpdateHeld = false;
 
 	return ERR_OK;
 }
@@ -305,8 +586,10 @@ void Connection::ConnError(int err)
 		tcp_err(ownPcb, nullptr);
 		ownPcb = nullptr;
 	}
+	ReleaseOverflow();
 	FreePbuf();
 	SetState(ConnState::aborted);
+	EventQueue::Add(ConnEventType::aborted, number, 0);
 }
 
 int Connection::ConnRecv(pbuf *p, int err)
@@ -317,21 +600,28 @@ int Connection::ConnRecv(pbuf *p, int err)
 		if (state == ConnState::connected)
 		{
 			SetState(ConnState::otherEndClosed);
+			EventQueue::Add(ConnEventType::otherEndClosed, number, 0);
 		}
 		else if (state == ConnState::closePending)
 		{
 			// We could perhaps call tcp_close here, but perhaps better to do it outside the callback
-			state = ConnState::closeReady;
+			SetState(ConnState::closeReady);
 		}
 	}
-	else if (pb != nullptr)
-	{
-		pbuf_cat(pb, p);
-	}
 	else
 	{
-		pb = p;
-		readIndex = alreadyRead = 0;
+		if (pb != nullptr)
+		{
+			pbuf_cat(pb, p);
+		}
+		else
+		{
+			pb = p;
+			readIndex = 0;							// keep alreadyRead, UpdateReceiveWindow may be holding it back
+		}
+		bytesReceived += p->tot_len;
+		++changeCount;
+		EventQueue::Add(ConnEventType::dataArrived, number, CanRead());
 	}
 	//debugPrint("Packet rcvd\n");
 	return ERR_OK;
@@ -349,6 +639,9 @@ int Connection::ConnSent(uint16_t len)
 		// Something is wrong, more data has been acknowledged than has been sent (hopefully this will never occur)
 		unAcked = 0;
 	}
+	bytesAcked += len;
+	++changeCount;
+	EventQueue::Add(ConnEventType::writeSpaceAvailable, number, CanWrite());
 	return ERR_OK;
 }
 
@@ -417,6 +710,15 @@ void Connection::FreePbuf()
 	}
 }
 
+// Work out how much memory is available for the writes in a transaction
+/*static*/ void Connection::GetWriteBudget(WriteBudget& budget)
+{
+	const size_t freeHeap = system_get_free_heap_size();
+	budget.heapChunks = (freeHeap > WriteHeapReserve) ? (freeHeap - WriteHeapReserve)/TxPbufAllocationSize : 0;
+	budget.segments = MemoryGovernor::FreePoolElements(MEMP_TCP_SEG);
+	budget.overflowFree = (overflowOwner == nullptr);
+}
+
 /*static*/ void Connection::GetSummarySocketStatus(uint16_t& connectedSockets, uint16_t& otherEndClosedSockets)
 {
 	connectedSockets = 0;
@@ -434,6 +736,22 @@ void Connection::FreePbuf()
 	}
 }
 
+/*static*/ void Connection::GetAllStatus(AllConnStatusResponse& resp)
+{
+	for (size_t i = 0; i < MaxConnections; ++i)
+	{
+		Connection::Get(i).GetSummary(resp.sockets[i]);
+	}
+}
+
+/*static*/ void Connection::GetAllDiagnostics(ConnDiagnostics diags[MaxConnections])
+{
+	for (size_t i = 0; i < MaxConnections; ++i)
+	{
+		Connection::Get(i).GetDiagnostics(diags[i]);
+	}
+}
+
 /*static*/ void Connection::ReportConnections()
 {
 	ets_printf("Conns");
@@ -449,4 +767,16 @@ void Connection::FreePbuf()
 Connection *Connection::connectionList[MaxConnections] = { 0 };
 size_t Connection::nextConnectionToPoll = 0;
 
+uint8_t Connection::overflowBuffer[OverflowBufferSize];
+Connection *Connection::overflowOwner = nullptr;
+size_t Connection::overflowLength = 0;
+size_t Connection::overflowOffset = 0;
+bool Connection::overflowPush = false;
+bool Connection::overflowClose = false;
+
+uint32_t Connection::writesAttempted = 0;
+uint32_t Connection::writeEstimateFailures = 0;
+uint32_t Connection::writesRounded = 0;
+uint32_t Connection::bytesDeferredByRounding = 0;
+
 // End
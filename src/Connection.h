@@ -17,21 +17,37 @@
 // If we #include "tcp.h" here we get clashes between two different ip_addr.h files, so don't do that here
 class tcp_pcb;
 class pbuf;
+class HSPIClass;
 
 class Connection
 {
 public:
+	// The memory that the writes we accept in one transaction have to share. Each write we accept takes what it will need out of the budget.
+	struct WriteBudget
+	{
+		size_t heapChunks;		// how many more MSS-sized pbufs the heap can spare
+		size_t segments;		// how many more elements of the TCP_SEG pool we can use
+		bool overflowFree;		// true if a write that LWIP can't take could still fall back on the overflow buffer
+	};
+
 	Connection(uint8_t num);
 
 	// Public interface
 	ConnState GetState() const { return state; }
+	uint8_t GetNumber() const { return number; }
 	void GetStatus(ConnStatusResponse& resp) const;
+	void GetSummary(ConnSummary& summary) const;
+	void GetDiagnostics(ConnDiagnostics& diags) const;
+	void GetTraffic(ConnTrafficCounters& traffic) const;
 
 	void Close();
 	void Terminate(bool external);
 	size_t Write(const uint8_t *data, size_t length, bool doPush, bool closeAfterSending);
 	size_t CanWrite() const;
+	size_t CanWrite(const WriteBudget& budget) const;
+	size_t AcceptWriteLength(size_t length, WriteBudget& budget);
 	size_t Read(uint8_t *data, size_t length);
+	size_t ReadTo(HSPIClass& spi, size_t length);
 	size_t CanRead() const;
 	void Poll();
 
@@ -49,19 +65,36 @@ public:
 	static void PollOne();
 	static void ReportConnections();
 	static void GetSummarySocketStatus(uint16_t& connectedSockets, uint16_t& otherEndClosedSockets);
+	static void GetAllStatus(AllConnStatusResponse& resp);
+	static void GetAllDiagnostics(ConnDiagnostics diags[MaxConnections]);
 	static void TerminateAll();
+	static void GetWriteBudget(WriteBudget& budget);
+	static uint32_t GetWritesAttempted() { return writesAttempted; }
+	static uint32_t GetWriteEstimateFailures() { return writeEstimateFailures; }
+	static uint32_t GetWritesRounded() { return writesRounded; }
+	static uint32_t GetBytesDeferredByRounding() { return bytesDeferredByRounding; }
 
 private:
 	void FreePbuf();
+	void UpdateReceiveWindow();
+	void WriteCompleted(size_t length);
+	void RetryOverflow();
+	void ReleaseOverflow() { if (overflowOwner == this) { overflowOwner = nullptr; } }
 	void Report();
 
 	void SetState(ConnState st)
 	{
 		state = st;
+		if (st != ConnState::connected && st != ConnState::otherEndClosed && st != ConnState::closePending)
+		{
+			ReleaseOverflow();			// the overflow data can no longer be sent, so don't block writes on other connections
+		}
+		++changeCount;
 	}
 
 	uint8_t number;
 	volatile ConnState state;
+	uint8_t changeCount;		// incremented when anything the SAM is interested in changes
 
 	uint16_t localPort;
 	uint16_t remotePort;
@@ -72,11 +105,31 @@ private:
 	volatile size_t unAcked;	// how much data we have sent but hasn't been acknowledged
 	size_t readIndex;			// how much data we have already read from the current pbuf
 	size_t alreadyRead;			// how much data we read from previous pbufs and didn't tell LWIP about yet
+	size_t peakUnAcked;			// the highest value of unAcked since the connection was accepted
+	uint32_t bytesReceived;		// traffic counters since the connection was accepted
+	uint32_t bytesRead;
+	uint32_t bytesWritten;
+	uint32_t bytesAcked;
+	uint16_t writeFailures;
+	bool windowUpdateHeld;		// true if we are holding back a receive window update because memory is short
 	tcp_pcb *ownPcb;			// the pcb that corresponds to this connection
 	pbuf *pb;					// the buffers holding data we have received that has not yet been taken
 
 	static Connection *connectionList[MaxConnections];
 	static size_t nextConnectionToPoll;
+
+	// Overflow write buffer, shared between all connections. While it is in use, no connection accepts more data.
+	static uint8_t overflowBuffer[];
+	static Connection *overflowOwner;		// the connection whose data is in the overflow buffer, or nullptr if it is free
+	static size_t overflowLength;			// how much data is in the overflow buffer
+	static size_t overflowOffset;			// how much of it LWIP has accepted so far
+	static bool overflowPush;				// whether to push the data when LWIP has accepted all of it
+	static bool overflowClose;				// whether to close the connection when the data has been sent
+
+	static uint32_t writesAttempted;		// how many times we have passed data from the SAM to tcp_write
+	static uint32_t writeEstimateFailures;	// how many of those failed for lack of memory even though CanWrite() said there was room
+	static uint32_t writesRounded;			// how many times we accepted less data so as to end on a segment boundary
+	static uint32_t bytesDeferredByRounding;	// how much data we asked the SAM to send later because of that
 };
 
 #endif /* SRC_CONNECTION_H_ */
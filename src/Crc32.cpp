@@ -0,0 +1,43 @@
+/*
+ * Crc32.cpp
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#include "Crc32.h"
+#include <c_types.h>			// for ICACHE_RAM_ATTR
+
+uint32_t Crc32::table[256];
+
+// Build the lookup table. Must be called before any CRC is calculated.
+/*static*/ void Crc32::Init()
+{
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t crc = i;
+		for (unsigned int bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ Polynomial : crc >> 1;
+		}
+		table[i] = crc;
+	}
+}
+
+// Add some dwords to a CRC. This is called while SPI transactions are in progress, so it lives in IRAM.
+// Because the ESP8266 is little-endian, processing the low byte of each dword first gives the same result as a byte-wise CRC over the data in memory order.
+/*static*/ uint32_t ICACHE_RAM_ATTR Crc32::Update(uint32_t crc, const uint32_t *data, size_t numDwords)
+{
+	const uint32_t * const table = Crc32::table;
+	while (numDwords != 0)
+	{
+		crc ^= *data++;
+		crc = table[crc & 0xFF] ^ (crc >> 8);
+		crc = table[crc & 0xFF] ^ (crc >> 8);
+		crc = table[crc & 0xFF] ^ (crc >> 8);
+		crc = table[crc & 0xFF] ^ (crc >> 8);
+		--numDwords;
+	}
+	return crc;
+}
+
+// End
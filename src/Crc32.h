@@ -0,0 +1,31 @@
+/*
+ * Crc32.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * CRC-32 (IEEE 802.3 polynomial, reflected) calculated a dword at a time, used to protect framed SPI transfers
+ */
+
+#ifndef SRC_CRC32_H_
+#define SRC_CRC32_H_
+
+#include <cstdint>
+#include <cstddef>
+
+class Crc32
+{
+public:
+	static const uint32_t Initial = 0xFFFFFFFF;
+
+	static void Init();
+	static uint32_t Update(uint32_t crc, const uint32_t *data, size_t numDwords);
+	static uint32_t Finish(uint32_t crc) { return ~crc; }
+	static uint32_t Calc(const uint32_t *data, size_t numDwords) { return Finish(Update(Initial, data, numDwords)); }
+
+private:
+	static const uint32_t Polynomial = 0xEDB88320;		// reflected form of 0x04C11DB7
+
+	static uint32_t table[256];
+};
+
+#endif /* SRC_CRC32_H_ */
@@ -0,0 +1,384 @@
+/*
+ * CredentialStore.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Flash layout. We use NumSectors sectors immediately below the sector that the EEPROM library uses, which are at the end of the SPIFFS area
+ * that this firmware doesn't use. Each sector holds a SectorHeader followed by journal records, each of which is a RecordHeader followed by data.
+ * The first record in a sector is always a snapshot of the whole image. The newest sector is the one with the highest sequence number whose
+ * header and snapshot are valid. When we load it we apply commits in order until we reach erased flash, a record with a bad CRC, or a commit
+ * that is missing some of its records.
+ * Crash safety:
+ * - A record header is written before its data, so a record that was interrupted has a bad CRC and is ignored, as is anything after it.
+ * - A commit that changed several ranges writes one record for each, all with the same commit sequence number and each saying how many there are.
+ *   We only apply a commit once we have checked all its records, so if it was interrupted none of it is applied.
+ *   If we find an incomplete commit then we write a new snapshot before appending anything else, because we can't append over partly-written flash.
+ * - A new snapshot is written to a different sector from the current one, so if it is interrupted we still have the previous sector.
+ */
+
+#include "CredentialStore.h"
+#include "Crc32.h"
+#include "Config.h"
+#include "include/MessageFormats.h"		// for NumDwords
+#include <Arduino.h>					// for noInterrupts() and interrupts()
+#include <algorithm>
+#include <EEPROM.h>						// to migrate the settings from EEPROM the first time we run
+
+extern "C"
+{
+	#include "spi_flash.h"
+	extern uint32_t _SPIFFS_end;		// the EEPROM library puts its sector here
+}
+
+// Allocate the image and load the settings from the journal. If there is no valid journal, take the settings from EEPROM.
+/*static*/ bool CredentialStore::Init(size_t size)
+{
+	imageSize = NumDwords(size) * sizeof(uint32_t);
+	image = new uint32_t[NumDwords(size)];
+	memset(image, 0xFF, imageSize);
+	numDirtyRanges = 0;
+	firstSector = ((uint32_t)(uintptr_t)&_SPIFFS_end - 0x40200000)/SPI_FLASH_SEC_SIZE - NumSectors;
+
+	// Try the sectors with valid headers, newest first, until we find one with a valid snapshot
+	uint32_t triedSectors = 0;
+	bool tailClean = true;
+	for (unsigned int attempt = 0; attempt < NumSectors; ++attempt)
+	{
+		int newest = -1;
+		uint32_t newestSequence = 0;
+		for (unsigned int sector = 0; sector < NumSectors; ++sector)
+		{
+			SectorHeader hdr;
+			if (   (triedSectors & (1u << sector)) == 0
+				&& Read(SectorAddress(sector), &hdr, sizeof(hdr))
+				&& hdr.magic == Magic
+				&& hdr.imageSize == imageSize
+				&& hdr.crc == Crc32::Calc(reinterpret_cast<const uint32_t*>(&hdr), NumDwords(offsetof(SectorHeader, crc)))
+				&& (newest < 0 || hdr.sequence > newestSequence)
+			   )
+			{
+				newest = sector;
+				newestSequence = hdr.sequence;
+			}
+		}
+
+		if (newest < 0)
+		{
+			break;
+		}
+		triedSectors |= 1u << newest;
+		if (LoadSector(newest, tailClean))
+		{
+			debugPrintf("Loaded settings from sector %u, %u commits\n", newest, commitSequence);
+			return (tailClean) ? true : Compact();
+		}
+	}
+
+	// There is no valid journal, so this is the first time we have run this firmware or the flash has been erased. Take the settings from EEPROM.
+	debugPrint("Migrating settings from EEPROM\n");
+	EEPROM.begin(size);
+	uint8_t * const p = reinterpret_cast<uint8_t*>(image);
+	for (size_t i = 0; i < size; ++i)
+	{
+		p[i] = EEPROM.read(i);
+	}
+	EEPROM.end();										// free the EEPROM buffer, we don't write to EEPROM any more
+
+	currentSector = NumSectors - 1;						// so that the first snapshot goes in sector 0
+	sectorSequence = 0;
+	commitSequence = 0;
+	return Compact();
+}
+
+// Save the changes made since the last commit. Normally we append a record for each range that changed to the journal; if there is no room,
+// or the changes are large, we write a snapshot to the next sector instead.
+// If we are interrupted part way through, none of the changes are applied when we next load the settings.
+/*static*/ bool CredentialStore::Commit()
+{
+	if (numDirtyRanges == 0)
+	{
+		return true;
+	}
+
+	size_t dataLength = 0, flashNeeded = 0;
+	for (size_t i = 0; i < numDirtyRanges; ++i)
+	{
+		dataLength += dirtyRanges[i].end - dirtyRanges[i].start;
+		flashNeeded += sizeof(RecordHeader) + dirtyRanges[i].end - dirtyRanges[i].start;
+	}
+
+	if (dataLength * 2 < imageSize && writeOffset + flashNeeded <= SPI_FLASH_SEC_SIZE)
+	{
+		bool ok = true;
+		for (size_t i = 0; ok && i < numDirtyRanges; ++i)
+		{
+			ok = AppendRecord(dirtyRanges[i].start, dirtyRanges[i].end - dirtyRanges[i].start, i, numDirtyRanges);
+		}
+		if (ok)
+		{
+			++commitSequence;
+			numDirtyRanges = 0;
+			return true;
+		}
+	}
+	return Compact();
+}
+
+// Add a range of bytes to the dirty ranges, merging it with any that it overlaps or touches.
+// If all the ranges are in use then we merge the closest one into it, which may mean that we write some bytes that haven't changed.
+/*static*/ void CredentialStore::MarkDirty(size_t offset, size_t length)
+{
+	size_t start = offset & ~(sizeof(uint32_t) - 1);
+	size_t end = (offset + length + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+	for (;;)
+	{
+		size_t i = 0;
+		while (i < numDirtyRanges)
+		{
+			if (dirtyRanges[i].start <= end && start <= dirtyRanges[i].end)
+			{
+				start = std::min<size_t>(start, dirtyRanges[i].start);
+				end = std::max<size_t>(end, dirtyRanges[i].end);
+				dirtyRanges[i] = dirtyRanges[--numDirtyRanges];
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		if (numDirtyRanges < MaxDirtyRanges)
+		{
+			break;
+		}
+
+		size_t closest = 0, closestGap = SIZE_MAX;
+		for (i = 0; i < numDirtyRanges; ++i)
+		{
+			const size_t gap = (dirtyRanges[i].start > end) ? dirtyRanges[i].start - end : start - dirtyRanges[i].end;
+			if (gap < closestGap)
+			{
+				closest = i;
+				closestGap = gap;
+			}
+		}
+		start = std::min<size_t>(start, dirtyRanges[closest].start);
+		end = std::max<size_t>(end, dirtyRanges[closest].end);
+		dirtyRanges[closest] = dirtyRanges[--numDirtyRanges];
+	}
+
+	dirtyRanges[numDirtyRanges].start = start;
+	dirtyRanges[numDirtyRanges].end = end;
+	++numDirtyRanges;
+}
+
+// Load the snapshot and journal from a sector whose header is valid. Return true if the snapshot was valid.
+// Set tailClean false if we stopped at a record that is not erased flash, or at the end of an incomplete commit, because then we can't append to this sector.
+/*static*/ bool CredentialStore::LoadSector(unsigned int sector, bool& tailClean)
+{
+	SectorHeader sectorHdr;
+	const uint32_t sectorAddress = SectorAddress(sector);
+	if (!Read(sectorAddress, &sectorHdr, sizeof(sectorHdr)))
+	{
+		return false;
+	}
+
+	bool haveSnapshot = false;
+	tailClean = true;
+	size_t offset = sizeof(SectorHeader);
+	size_t commitStart = offset;								// where the records of the commit we are checking start
+	size_t recordsChecked = 0;									// how many records of that commit we have checked
+	uint32_t commitBeingChecked = 0;							// the sequence number of that commit
+	size_t commitRecords = 0;									// how many records that commit has
+	while (offset + sizeof(RecordHeader) <= SPI_FLASH_SEC_SIZE)
+	{
+		RecordHeader hdr;
+		if (!Read(sectorAddress + offset, &hdr, sizeof(hdr)))
+		{
+			tailClean = false;
+			break;
+		}
+		if (hdr.offset == 0xFFFF && hdr.length == 0xFFFF)
+		{
+			break;												// erased flash, so this is the end of the journal
+		}
+		if (   hdr.offset % sizeof(uint32_t) != 0 || hdr.length % sizeof(uint32_t) != 0
+			|| hdr.offset + hdr.length > imageSize
+			|| offset + sizeof(RecordHeader) + hdr.length > SPI_FLASH_SEC_SIZE
+			|| hdr.recordNumber != recordsChecked || hdr.numRecords == 0 || hdr.numRecords > MaxDirtyRanges
+			|| (recordsChecked != 0 && (hdr.commitSequence != commitBeingChecked || hdr.numRecords != commitRecords))
+			|| (!haveSnapshot && (hdr.offset != 0 || hdr.length != imageSize || hdr.numRecords != 1))
+		   )
+		{
+			tailClean = false;
+			break;
+		}
+
+		// Check the CRC, reading the data a chunk at a time. We don't apply the data until we have checked the whole commit.
+		const uint32_t dataAddress = sectorAddress + offset + sizeof(RecordHeader);
+		uint32_t crc = Crc32::Update(Crc32::Initial, reinterpret_cast<const uint32_t*>(&hdr), NumDwords(offsetof(RecordHeader, crc)));
+		uint32_t buffer[16];
+		bool ok = true;
+		for (size_t done = 0; ok && done < hdr.length; done += sizeof(buffer))
+		{
+			const size_t chunk = std::min<size_t>(sizeof(buffer), hdr.length - done);
+			ok = Read(dataAddress + done, buffer, chunk);
+			crc = Crc32::Update(crc, buffer, NumDwords(chunk));
+		}
+		if (!ok || Crc32::Finish(crc) != hdr.crc)
+		{
+			tailClean = false;
+			break;
+		}
+
+		if (recordsChecked == 0)
+		{
+			commitStart = offset;
+			commitBeingChecked = hdr.commitSequence;
+			commitRecords = hdr.numRecords;
+		}
+		offset += sizeof(RecordHeader) + hdr.length;
+		++recordsChecked;
+		if (recordsChecked == hdr.numRecords)
+		{
+			if (!ApplyRecords(sectorAddress + commitStart, sectorAddress + offset))
+			{
+				tailClean = false;
+				break;
+			}
+			haveSnapshot = true;
+			commitSequence = hdr.commitSequence;
+			recordsChecked = 0;
+		}
+	}
+
+	if (recordsChecked != 0)
+	{
+		tailClean = false;										// the last commit was interrupted, so we ignore it
+	}
+	if (haveSnapshot)
+	{
+		currentSector = sector;
+		sectorSequence = sectorHdr.sequence;
+		writeOffset = offset;
+	}
+	return haveSnapshot;
+}
+
+// Copy the data of the records between two flash addresses into the image. The records have already been checked.
+/*static*/ bool CredentialStore::ApplyRecords(uint32_t startAddress, uint32_t endAddress)
+{
+	while (startAddress < endAddress)
+	{
+		RecordHeader hdr;
+		if (!Read(startAddress, &hdr, sizeof(hdr)) || !Read(startAddress + sizeof(hdr), image + hdr.offset/sizeof(uint32_t), hdr.length))
+		{
+			return false;
+		}
+		startAddress += sizeof(hdr) + hdr.length;
+	}
+	return true;
+}
+
+// Append a record of part of the image to the current sector, as one of the records of the next commit. The caller has checked that there is room.
+/*static*/ bool CredentialStore::AppendRecord(size_t offset, size_t length, size_t recordNumber, size_t numRecords)
+{
+	RecordHeader hdr;
+	hdr.offset = (uint16_t)offset;
+	hdr.length = (uint16_t)length;
+	hdr.commitSequence = commitSequence + 1;
+	hdr.recordNumber = (uint16_t)recordNumber;
+	hdr.numRecords = (uint16_t)numRecords;
+	hdr.crc = RecordCrc(hdr, image + offset/sizeof(uint32_t));
+
+	const uint32_t address = SectorAddress(currentSector) + writeOffset;
+	writeOffset += sizeof(RecordHeader) + length;				// even if the writes fail, this part of the sector is no longer erased
+	return Write(address, &hdr, sizeof(hdr)) && Write(address + sizeof(hdr), image + offset/sizeof(uint32_t), length);
+}
+
+// Write a snapshot of the whole image to the next sector that we can erase and write successfully, and make that the current sector
+/*static*/ bool CredentialStore::Compact()
+{
+	for (unsigned int i = 1; i < NumSectors; ++i)				// never erase the current sector, it holds the only good copy
+	{
+		const unsigned int sector = (currentSector + i) % NumSectors;
+		SectorHeader sectorHdr;
+		sectorHdr.magic = Magic;
+		sectorHdr.sequence = sectorSequence + 1;
+		sectorHdr.imageSize = imageSize;
+		sectorHdr.crc = Crc32::Calc(reinterpret_cast<const uint32_t*>(&sectorHdr), NumDwords(offsetof(SectorHeader, crc)));
+
+		RecordHeader hdr;
+		hdr.offset = 0;
+		hdr.length = (uint16_t)imageSize;
+		hdr.commitSequence = commitSequence + 1;
+		hdr.recordNumber = 0;
+		hdr.numRecords = 1;
+		hdr.crc = RecordCrc(hdr, image);
+
+		const uint32_t address = SectorAddress(sector);
+		noInterrupts();
+		const bool erased = spi_flash_erase_sector(firstSector + sector) == SPI_FLASH_RESULT_OK;
+		interrupts();
+		if (   erased
+			&& Write(address, &sectorHdr, sizeof(sectorHdr))
+			&& Write(address + sizeof(sectorHdr), &hdr, sizeof(hdr))
+			&& Write(address + sizeof(sectorHdr) + sizeof(hdr), image, imageSize)
+		   )
+		{
+			currentSector = sector;
+			sectorSequence = sectorHdr.sequence;
+			commitSequence = hdr.commitSequence;
+			writeOffset = sizeof(sectorHdr) + sizeof(hdr) + imageSize;
+			numDirtyRanges = 0;
+			++compactions;
+			return true;
+		}
+	}
+
+	debugPrint("Failed to save settings\n");
+	return false;
+}
+
+/*static*/ uint32_t CredentialStore::RecordCrc(const RecordHeader& hdr, const uint32_t *data)
+{
+	const uint32_t crc = Crc32::Update(Crc32::Initial, reinterpret_cast<const uint32_t*>(&hdr), NumDwords(offsetof(RecordHeader, crc)));
+	return Crc32::Finish(Crc32::Update(crc, data, NumDwords(hdr.length)));
+}
+
+/*static*/ uint32_t CredentialStore::SectorAddress(unsigned int sector)
+{
+	return (firstSector + sector) * SPI_FLASH_SEC_SIZE;
+}
+
+// Read from flash. The address, data and length must all be dword aligned.
+/*static*/ bool CredentialStore::Read(uint32_t address, void *data, size_t length)
+{
+	noInterrupts();
+	const bool ok = spi_flash_read(address, reinterpret_cast<uint32_t*>(data), length) == SPI_FLASH_RESULT_OK;
+	interrupts();
+	return ok;
+}
+
+// Write to erased flash. The address, data and length must all be dword aligned.
+/*static*/ bool CredentialStore::Write(uint32_t address, const void *data, size_t length)
+{
+	noInterrupts();
+	const bool ok = spi_flash_write(address, const_cast<uint32_t*>(reinterpret_cast<const uint32_t*>(data)), length) == SPI_FLASH_RESULT_OK;
+	interrupts();
+	return ok;
+}
+
+// Static data
+uint32_t *CredentialStore::image = nullptr;
+size_t CredentialStore::imageSize = 0;
+CredentialStore::DirtyRange CredentialStore::dirtyRanges[MaxDirtyRanges];
+size_t CredentialStore::numDirtyRanges = 0;
+unsigned int CredentialStore::firstSector = 0;
+unsigned int CredentialStore::currentSector = 0;
+uint32_t CredentialStore::sectorSequence = 0;
+uint32_t CredentialStore::commitSequence = 0;
+size_t CredentialStore::writeOffset = 0;
+uint32_t CredentialStore::compactions = 0;
+
+// End
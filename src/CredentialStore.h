@@ -0,0 +1,99 @@
+/*
+ * CredentialStore.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Storage for the remembered networks and other settings, replacing EEPROM.
+ * The settings are held in RAM. Each commit appends records of the bytes that changed to a journal in flash, so most changes don't need a sector erase.
+ * The records of a commit are applied together or not at all.
+ * When the current journal sector is full, a snapshot of the whole image is written to the next sector, which also spreads the wear over several sectors.
+ */
+
+#ifndef SRC_CREDENTIALSTORE_H_
+#define SRC_CREDENTIALSTORE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+class CredentialStore
+{
+public:
+	static bool Init(size_t size);
+	static bool Commit();
+	static uint32_t GetCompactions() { return compactions; }
+
+	template<class T> static const T *GetPtr(size_t offset)
+	{
+		return (image != nullptr && offset + sizeof(T) <= imageSize) ? reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(image) + offset) : nullptr;
+	}
+
+	template<class T> static void Get(size_t offset, T& val)
+	{
+		const T * const p = GetPtr<T>(offset);
+		if (p != nullptr)
+		{
+			memcpy(&val, p, sizeof(T));
+		}
+	}
+
+	template<class T> static void Put(size_t offset, const T& val)
+	{
+		if (image != nullptr && offset + sizeof(T) <= imageSize)
+		{
+			memcpy(reinterpret_cast<uint8_t*>(image) + offset, &val, sizeof(T));
+			MarkDirty(offset, sizeof(T));
+		}
+	}
+
+private:
+	struct SectorHeader
+	{
+		uint32_t magic;
+		uint32_t sequence;					// incremented each time we start a new sector, so the highest valid one is the newest
+		uint32_t imageSize;
+		uint32_t crc;						// CRC of the preceding fields
+	};
+
+	struct RecordHeader
+	{
+		uint16_t offset;					// where in the image the data goes
+		uint16_t length;					// how many bytes of data follow, always a whole number of dwords
+		uint32_t commitSequence;			// incremented for each commit, and the same in all the records of one commit
+		uint16_t recordNumber;				// which record of the commit this is, counting from zero
+		uint16_t numRecords;				// how many records the commit has
+		uint32_t crc;						// CRC of the preceding fields and the data
+	};
+
+	struct DirtyRange
+	{
+		size_t start, end;					// dword aligned
+	};
+
+	static void MarkDirty(size_t offset, size_t length);
+	static bool LoadSector(unsigned int sector, bool& tailClean);
+	static bool ApplyRecords(uint32_t startAddress, uint32_t endAddress);
+	static bool AppendRecord(size_t offset, size_t length, size_t recordNumber, size_t numRecords);
+	static bool Compact();
+	static uint32_t RecordCrc(const RecordHeader& hdr, const uint32_t *data);
+	static uint32_t SectorAddress(unsigned int sector);
+	static bool Read(uint32_t address, void *data, size_t length);
+	static bool Write(uint32_t address, const void *data, size_t length);
+
+	static const uint32_t Magic = 0x4A445243;				// "CRDJ"
+	static const unsigned int NumSectors = 4;
+	static const size_t MaxDirtyRanges = 4;				// a commit typically changes a network's entry, its fast connect data and the boot settings
+
+	static uint32_t *image;									// the settings, allocated by Init
+	static size_t imageSize;								// the size of the settings, rounded up to a whole number of dwords
+	static DirtyRange dirtyRanges[MaxDirtyRanges];			// the ranges of bytes that have changed since the last commit, not overlapping or touching
+	static size_t numDirtyRanges;
+	static unsigned int firstSector;						// the first flash sector we use
+	static unsigned int currentSector;						// which of our sectors holds the newest snapshot and journal
+	static uint32_t sectorSequence;							// the sequence number of the current sector
+	static uint32_t commitSequence;							// the sequence number of the last commit written
+	static size_t writeOffset;								// where in the current sector the next record goes
+	static uint32_t compactions;							// how many snapshots we have written since we started
+};
+
+#endif /* SRC_CREDENTIALSTORE_H_ */
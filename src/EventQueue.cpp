@@ -0,0 +1,89 @@
+/*
+ * EventQueue.cpp
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#include "EventQueue.h"
+#include <algorithm>			// for std::min
+
+// Add an event to the queue. Events are only added from LWIP callbacks and the main loop, never from an ISR, so we don't need to disable interrupts.
+// If the newest event for this socket is of the same type and only carries a count, update it instead of adding another one.
+/*static*/ void EventQueue::Add(ConnEventType type, uint8_t socketNumber, size_t param)
+{
+	const uint16_t param16 = std::min<size_t>(param, UINT16_MAX);
+	if (type == ConnEventType::dataArrived || type == ConnEventType::writeSpaceAvailable)
+	{
+		for (size_t i = count; i != 0; )
+		{
+			--i;
+			ConnEvent& ev = events[(first + i) % QueueLength];
+			if (ev.socketNumber == socketNumber)
+			{
+				if (ev.type == type)
+				{
+					ev.param = param16;
+					newEvents = true;
+					return;
+				}
+				break;
+			}
+		}
+	}
+
+	if (count == QueueLength)
+	{
+		++lostEvents;
+	}
+	else
+	{
+		ConnEvent& ev = events[(first + count) % QueueLength];
+		ev.type = type;
+		ev.socketNumber = socketNumber;
+		ev.param = param16;
+		++count;
+	}
+	newEvents = true;
+}
+
+// Copy as many events as will fit into the buffer, preceded by an EventsResponseHeader, and remove them from the queue. Return the number of bytes used.
+// Older SAM firmware doesn't know about events, so we don't signal new ones until the SAM has retrieved them at least once.
+/*static*/ size_t EventQueue::Retrieve(uint8_t *buffer, size_t bufferLength)
+{
+	if (bufferLength < sizeof(EventsResponseHeader))
+	{
+		return 0;
+	}
+	samWantsEvents = true;
+
+	EventsResponseHeader * const hdr = reinterpret_cast<EventsResponseHeader*>(buffer);
+	ConnEvent *p = reinterpret_cast<ConnEvent*>(buffer + sizeof(EventsResponseHeader));
+	const size_t numEvents = std::min<size_t>(count, (bufferLength - sizeof(EventsResponseHeader))/sizeof(ConnEvent));
+	for (size_t i = 0; i < numEvents; ++i)
+	{
+		*p++ = events[first];
+		first = (first + 1) % QueueLength;
+	}
+	count -= numEvents;
+	hdr->numEvents = numEvents;
+	hdr->lostEvents = lostEvents;
+	lostEvents = 0;
+	return sizeof(EventsResponseHeader) + numEvents * sizeof(ConnEvent);
+}
+
+/*static*/ void EventQueue::Clear()
+{
+	first = count = 0;
+	lostEvents = 0;
+	newEvents = false;
+}
+
+// Static data
+ConnEvent EventQueue::events[QueueLength];
+size_t EventQueue::first = 0;
+size_t EventQueue::count = 0;
+uint16_t EventQueue::lostEvents = 0;
+bool EventQueue::newEvents = false;
+bool EventQueue::samWantsEvents = false;
+
+// End
@@ -0,0 +1,37 @@
+/*
+ * EventQueue.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Queue of connection events waiting to be collected by the SAM
+ */
+
+#ifndef SRC_EVENTQUEUE_H_
+#define SRC_EVENTQUEUE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include "include/MessageFormats.h"			// for ConnEvent
+
+class EventQueue
+{
+public:
+	static void Add(ConnEventType type, uint8_t socketNumber, size_t param);
+	static size_t Retrieve(uint8_t *buffer, size_t bufferLength);
+	static bool IsEmpty() { return count == 0; }
+	static bool HasNewEvents() { return newEvents && samWantsEvents; }
+	static void ClearNewEvents() { newEvents = false; }
+	static void Clear();
+
+private:
+	static const size_t QueueLength = 32;
+
+	static ConnEvent events[QueueLength];
+	static size_t first;				// index of the oldest event
+	static size_t count;				// how many events are in the queue
+	static uint16_t lostEvents;			// how many events we have discarded since the last retrieval
+	static bool newEvents;				// true if events have been added since we last signalled the SAM
+	static bool samWantsEvents;			// true once the SAM has retrieved events, which tells us that it knows about them and wants them signalled
+};
+
+#endif /* SRC_EVENTQUEUE_H_ */
@@ -21,6 +21,7 @@
 
 #include "HSPI.h"
 #include <cmath>
+#include <algorithm>
 
 typedef union {
         uint32_t regValue;
@@ -33,7 +34,10 @@ typedef union {
         };
 } spiClk_t;
 
-HSPIClass::HSPIClass() {
+HSPIClass::HSPIClass()
+    : asyncOut(nullptr), asyncIn(nullptr), asyncRemainingDwords(0), asyncChunkDwords(0),
+      streamPartialDword(0), streamPartialBytes(0), streamFifoDwords(0), pipelined(false),
+      busyCycles(0), bytesSent(0), bytesReceived(0), transferStartCycles(0) {
 }
 
 void HSPIClass::InitMaster(uint8_t mode, uint32_t clockReg, bool msbFirst)
@@ -78,6 +82,11 @@ void HSPIClass::InitMaster(uint8_t mode, uint32_t clockReg, bool msbFirst)
 	}
 
 	setClockDivider(clockReg);
+
+	// The SPI interrupt is shared with SPI0 and I2S. We only enable the HSPI transfer-done interrupt while a background transfer is in progress.
+	SPI1S &= ~(SPISTRIE | SPISTRIS);
+	ETS_SPI_INTR_ATTACH(transferDoneIsr, this);
+	ETS_SPI_INTR_ENABLE();
 }
 
 void HSPIClass::end() {
@@ -116,7 +125,7 @@ void HSPIClass::setClockDivider(uint32_t clockDiv)
     SPI1CLK = clockDiv;
 }
 
-void HSPIClass::setDataBits(uint16_t bits)
+void ICACHE_RAM_ATTR HSPIClass::setDataBits(uint16_t bits)
 {
     const uint32_t mask = ~((SPIMMOSI << SPILMOSI) | (SPIMMISO << SPILMISO));
     bits--;
@@ -125,6 +134,7 @@ void HSPIClass::setDataBits(uint16_t bits)
 
 uint32_t ICACHE_RAM_ATTR HSPIClass::transfer32(uint32_t data)
 {
+    const uint32_t startCycles = ESP.getCycleCount();
     while(SPI1CMD & SPIBUSY) {}
     // Set to 32Bits transfer
     setDataBits(32);
@@ -132,6 +142,9 @@ uint32_t ICACHE_RAM_ATTR HSPIClass::transfer32(uint32_t data)
 	SPI1W0 = data;
 	SPI1CMD |= SPIBUSY;
     while(SPI1CMD & SPIBUSY) {}
+    bytesSent += sizeof(uint32_t);
+    bytesReceived += sizeof(uint32_t);
+    busyCycles += ESP.getCycleCount() - startCycles;
     return SPI1W0;
 }
 
@@ -141,17 +154,30 @@ uint32_t ICACHE_RAM_ATTR HSPIClass::transfer32(uint32_t data)
  * @param size uint32_t
  */
 void ICACHE_RAM_ATTR HSPIClass::transferDwords(const uint32_t * out, uint32_t * in, uint32_t size) {
-    while(size != 0) {
-        if (size > 16) {
-            transferDwords_(out, in, 16);
-            size -= 16;
-            if(out) out += 16;
-            if(in) in += 16;
-        } else {
-            transferDwords_(out, in, size);
-            size = 0;
+    const uint32_t startCycles = ESP.getCycleCount();
+    if (out != nullptr) {
+        bytesSent += size * sizeof(uint32_t);
+    }
+    if (in != nullptr) {
+        bytesReceived += size * sizeof(uint32_t);
+    }
+
+    if (pipelined && size > 8) {
+        transferDwordsPipelined(out, in, size);
+    } else {
+        while(size != 0) {
+            if (size > 16) {
+                transferDwords_(out, in, 16);
+                size -= 16;
+                if(out) out += 16;
+                if(in) in += 16;
+            } else {
+                transferDwords_(out, in, size);
+                size = 0;
+            }
         }
     }
+    busyCycles += ESP.getCycleCount() - startCycles;
 }
 
 void ICACHE_RAM_ATTR HSPIClass::transferDwords_(const uint32_t * out, uint32_t * in, uint8_t size) {
@@ -163,17 +189,13 @@ void ICACHE_RAM_ATTR HSPIClass::transferDwords_(const uint32_t * out, uint32_t *
     volatile uint32_t * fifoPtr = &SPI1W0;
     uint8_t dataSize = size;
 
+    // If there is no out data then we send whatever the FIFO already holds. Every command that receives data from the SAM
+    // without sending any ignores what we send, so there is no need to spend time filling the FIFO with dummy data.
     if (out != nullptr) {
         while(dataSize != 0) {
             *fifoPtr++ = *out++;
             dataSize--;
         }
-    } else {
-        // no out data, so fill with dummy data
-        while(dataSize != 0) {
-            *fifoPtr++ = 0xFFFFFFFF;
-            dataSize--;
-        }
     }
 
     SPI1CMD |= SPIBUSY;
@@ -188,4 +210,231 @@ void ICACHE_RAM_ATTR HSPIClass::transferDwords_(const uint32_t * out, uint32_t *
     }
 }
 
+/**
+ * Transfer data using the two halves of the FIFO alternately. The MOSI and MISO HIGHPART bits make a transfer use W8..W15 instead of W0..W7,
+ * so we can unload and reload one half while the other half is being shifted. This means the SPI clock only stops for as long as it takes
+ * to start the next transfer, instead of while we copy a whole FIFO load in and out.
+ * @param out uint32_t *
+ * @param in  uint32_t *
+ * @param size uint32_t
+ */
+void ICACHE_RAM_ATTR HSPIClass::transferDwordsPipelined(const uint32_t * out, uint32_t * in, uint32_t size) {
+    const uint32_t HalfFifoDwords = 8;
+    volatile uint32_t * const fifo = &SPI1W0;
+
+    while(SPI1CMD & SPIBUSY) {}
+
+    // Load the low half and start shifting it
+    uint32_t shiftingCount = std::min<uint32_t>(size, HalfFifoDwords);
+    uint32_t remaining = size - shiftingCount;
+    if (out != nullptr) {
+        for (uint32_t i = 0; i < shiftingCount; ++i) {
+            fifo[i] = *out++;
+        }
+    }
+    uint32_t shiftingOffset = 0;
+    SPI1U &= ~(SPIUMOSIH | SPIUMISOH);
+    setDataBits(shiftingCount * 32);
+    SPI1CMD |= SPIBUSY;
+
+    for (;;) {
+        // Load the other half while the current half is being shifted
+        const uint32_t nextOffset = HalfFifoDwords - shiftingOffset;
+        const uint32_t nextCount = std::min<uint32_t>(remaining, HalfFifoDwords);
+        if (out != nullptr) {
+            for (uint32_t i = 0; i < nextCount; ++i) {
+                fifo[nextOffset + i] = *out++;
+            }
+        }
+
+        while(SPI1CMD & SPIBUSY) {}
+
+        // Start the next half straight away, then unload the half that has just finished
+        if (nextCount != 0) {
+            if (nextOffset != 0) {
+                SPI1U |= (SPIUMOSIH | SPIUMISOH);
+            } else {
+                SPI1U &= ~(SPIUMOSIH | SPIUMISOH);
+            }
+            setDataBits(nextCount * 32);
+            SPI1CMD |= SPIBUSY;
+        }
+
+        if (in != nullptr) {
+            for (uint32_t i = 0; i < shiftingCount; ++i) {
+                *in++ = fifo[shiftingOffset + i];
+            }
+        }
+
+        if (nextCount == 0) {
+            break;
+        }
+        remaining -= nextCount;
+        shiftingOffset = nextOffset;
+        shiftingCount = nextCount;
+    }
+
+    SPI1U &= ~(SPIUMOSIH | SPIUMISOH);      // the other transfer functions expect to use the whole FIFO starting at W0
+}
+
+/**
+ * Start a transfer that continues in the background. Each time a FIFO load has been shifted, the transfer-done interrupt
+ * unloads it and loads the next one, so the caller is free to do other work until isTransferring() returns false.
+ * The buffers must remain valid until then.
+ * @param out uint32_t *
+ * @param in  uint32_t *
+ * @param size uint32_t
+ */
+void ICACHE_RAM_ATTR HSPIClass::startTransferDwords(const uint32_t * out, uint32_t * in, uint32_t size) {
+    while(SPI1CMD & SPIBUSY) {}
+    if (size != 0) {
+        transferStartCycles = ESP.getCycleCount();
+        if (out != nullptr) {
+            bytesSent += size * sizeof(uint32_t);
+        }
+        if (in != nullptr) {
+            bytesReceived += size * sizeof(uint32_t);
+        }
+        asyncOut = out;
+        asyncIn = in;
+        asyncRemainingDwords = size;
+        SPI1U &= ~(SPIUMOSIH | SPIUMISOH);
+        SPI1S = (SPI1S & ~SPISTRIS) | SPISTRIE;
+        startAsyncChunk();
+    }
+}
+
+// Load the next chunk of a background transfer into the FIFO and start shifting it
+void ICACHE_RAM_ATTR HSPIClass::startAsyncChunk() {
+    const uint8_t chunk = (asyncRemainingDwords > 16) ? 16 : asyncRemainingDwords;
+    const uint32_t * out = asyncOut;
+    if (out != nullptr) {
+        volatile uint32_t * fifoPtr = &SPI1W0;
+        for (uint8_t i = 0; i < chunk; ++i) {
+            *fifoPtr++ = *out++;
+        }
+        asyncOut = out;
+    }
+    asyncRemainingDwords -= chunk;
+    asyncChunkDwords = chunk;
+    setDataBits(chunk * 32);
+    SPI1CMD |= SPIBUSY;
+}
+
+// Called from the ISR when a chunk of a background transfer has been shifted
+void ICACHE_RAM_ATTR HSPIClass::asyncChunkDone() {
+    uint32_t * in = asyncIn;
+    if (in != nullptr) {
+        volatile uint32_t * fifoPtrRd = &SPI1W0;
+        for (uint8_t i = 0; i < asyncChunkDwords; ++i) {
+            *in++ = *fifoPtrRd++;
+        }
+        asyncIn = in;
+    }
+
+    if (asyncRemainingDwords != 0) {
+        startAsyncChunk();
+    } else {
+        SPI1S &= ~SPISTRIE;
+        busyCycles += ESP.getCycleCount() - transferStartCycles;
+        asyncChunkDwords = 0;               // this tells the main program that the transfer is complete
+    }
+}
+
+void ICACHE_RAM_ATTR HSPIClass::transferDoneIsr(void *arg) {
+    if (SPIIR & (1 << SPII1)) {            // if HSPI caused this interrupt
+        SPI1S &= ~SPISTRIS;
+        if (static_cast<HSPIClass *>(arg)->asyncChunkDwords != 0) {
+            static_cast<HSPIClass *>(arg)->asyncChunkDone();
+        }
+    }
+}
+
+void ICACHE_RAM_ATTR HSPIClass::beginStream() {
+    transferStartCycles = ESP.getCycleCount();
+    while(SPI1CMD & SPIBUSY) {}
+    streamPartialDword = 0;
+    streamPartialBytes = 0;
+    streamFifoDwords = 0;
+}
+
+// Load a dword into the FIFO, starting a transfer if that fills it
+inline void ICACHE_RAM_ATTR HSPIClass::streamDword(uint32_t data) {
+    if (streamFifoDwords == 0) {
+        while(SPI1CMD & SPIBUSY) {}         // the previous FIFO load may still be shifting out
+    }
+    (&SPI1W0)[streamFifoDwords] = data;
+    if (++streamFifoDwords == 16) {
+        setDataBits(16 * 32);
+        SPI1CMD |= SPIBUSY;
+        streamFifoDwords = 0;
+    }
+}
+
+/**
+ * Copy data into the FIFO, starting a transfer each time the FIFO is full.
+ * The source may have any alignment and may be split across several calls at any byte boundary.
+ * @param data uint8_t *
+ * @param length size_t
+ */
+void ICACHE_RAM_ATTR HSPIClass::streamBytes(const uint8_t * data, size_t length) {
+    bytesSent += length;
+
+    // Take single bytes until the source is dword aligned
+    while (length != 0 && ((uint32_t)data & 3) != 0) {
+        streamPartialDword |= (uint32_t)*data++ << (8 * streamPartialBytes);
+        --length;
+        if (++streamPartialBytes == 4) {
+            streamDword(streamPartialDword);
+            streamPartialDword = 0;
+            streamPartialBytes = 0;
+        }
+    }
+
+    // Take whole dwords, merging them with any partial dword left over from a previous call
+    const uint32_t * src = reinterpret_cast<const uint32_t *>(data);
+    if (streamPartialBytes == 0) {
+        while (length >= 4) {
+            streamDword(*src++);
+            length -= 4;
+        }
+    } else {
+        const unsigned int shift = 8 * streamPartialBytes;
+        while (length >= 4) {
+            const uint32_t dw = *src++;
+            streamDword(streamPartialDword | (dw << shift));
+            streamPartialDword = dw >> (32 - shift);
+            length -= 4;
+        }
+    }
+
+    // Take any remaining bytes
+    data = reinterpret_cast<const uint8_t *>(src);
+    while (length != 0) {
+        streamPartialDword |= (uint32_t)*data++ << (8 * streamPartialBytes);
+        --length;
+        if (++streamPartialBytes == 4) {
+            streamDword(streamPartialDword);
+            streamPartialDword = 0;
+            streamPartialBytes = 0;
+        }
+    }
+}
+
+// Send any partial dword padded with zeros, then send whatever is left in the FIFO and wait for it to go
+void ICACHE_RAM_ATTR HSPIClass::endStream() {
+    if (streamPartialBytes != 0) {
+        streamDword(streamPartialDword);
+        streamPartialDword = 0;
+        streamPartialBytes = 0;
+    }
+    if (streamFifoDwords != 0) {
+        setDataBits(streamFifoDwords * 32);
+        SPI1CMD |= SPIBUSY;
+        streamFifoDwords = 0;
+    }
+    while(SPI1CMD & SPIBUSY) {}
+    busyCycles += ESP.getCycleCount() - transferStartCycles;
+}
+
 // End
@@ -36,13 +36,50 @@ public:
   void end();
   void setDataBits(uint16_t bits);
   void setClockDivider(uint32_t clockDiv);
+  void setPipelined(bool on) { pipelined = on; }
+  bool isPipelined() const { return pipelined; }
   void beginTransaction();
   uint32_t transfer32(uint32_t data);
   void transferDwords(const uint32_t * out, uint32_t * in, uint32_t size);
   void endTransaction(void);
 
+  // Transfer data in the background, reloading the FIFO from the transfer-done interrupt
+  void startTransferDwords(const uint32_t * out, uint32_t * in, uint32_t size);
+  bool isTransferring() const { return asyncChunkDwords != 0; }
+
+  // Send data that need not be dword aligned by copying it straight into the FIFO, without receiving anything
+  void beginStream();
+  void streamBytes(const uint8_t * data, size_t length);
+  void endStream();
+
+  // Statistics. The counts include background transfers once they have completed, and wrap around when they overflow.
+  uint32_t getBusyCycles() const { return busyCycles; }
+  uint32_t getBytesSent() const { return bytesSent; }
+  uint32_t getBytesReceived() const { return bytesReceived; }
+
 private:
   void transferDwords_(const uint32_t * out, uint32_t * in, uint8_t size);
+  void transferDwordsPipelined(const uint32_t * out, uint32_t * in, uint32_t size);
+  void streamDword(uint32_t data);
+  void startAsyncChunk();
+  void asyncChunkDone();
+
+  static void transferDoneIsr(void *arg);
+
+  const uint32_t * volatile asyncOut;       // where the rest of the data for the background transfer comes from, or nullptr
+  uint32_t * volatile asyncIn;              // where the rest of the received data goes, or nullptr
+  volatile uint32_t asyncRemainingDwords;   // how many dwords of the background transfer have not yet been loaded into the FIFO
+  volatile uint8_t asyncChunkDwords;        // how many dwords are in the FIFO being transferred, zero if no background transfer is in progress
+
+  uint32_t streamPartialDword;      // bytes waiting to be sent that don't yet make up a whole dword
+  uint8_t streamPartialBytes;       // how many bytes there are in streamPartialDword
+  uint8_t streamFifoDwords;         // how many dwords we have loaded into the FIFO
+  bool pipelined;                   // true to use the two halves of the FIFO alternately for long transfers
+
+  volatile uint32_t busyCycles;     // CPU cycles from starting each transfer to its completion. Only one of the main program and the ISR updates it at a time.
+  uint32_t bytesSent;               // data bytes sent, not counting what we clock out when we have nothing to send
+  uint32_t bytesReceived;           // data bytes received and stored
+  uint32_t transferStartCycles;     // when the current background transfer or stream started
 };
 
 #endif
@@ -7,6 +7,8 @@
 
 #include "Listener.h"
 #include "Connection.h"
+#include "EventQueue.h"
+#include "MemoryGovernor.h"
 #include "Config.h"
 
 #include <HardwareSerial.h>
@@ -45,13 +47,23 @@ int Listener::Accept(tcp_pcb *pcb)
 	{
 		// Allocate a free socket for this connection
 		const uint16_t numConns = Connection::CountConnectionsOnPort(port);
-		if (numConns < maxConnections)
+		if (numConns >= maxConnections)
+		{
+			debugPrintfAlways("refused conn on port %u already %u conns\n", port, numConns);
+		}
+		else if (!MemoryGovernor::CanAccept())
+		{
+			// Accepting another connection could starve the existing ones of memory, so the client will have to try again later
+			debugPrintfAlways("refused conn on port %u low memory\n", port);
+		}
+		else
 		{
 			Connection * const conn = Connection::Allocate();
 			if (conn != nullptr)
 			{
 				tcp_accepted(listeningPcb);		// tell the listening PCB we have accepted the connection
 				const int rslt = conn->Accept(pcb);
+				EventQueue::Add(ConnEventType::accepted, conn->GetNumber(), port);
 				if (protocol == protocolFtpData)
 				{
 					debugPrintf("accept conn, stop listen on port %u\n", port);
@@ -61,10 +73,6 @@ int Listener::Accept(tcp_pcb *pcb)
 			}
 			debugPrintfAlways("refused conn on port %u no free conn\n", port);
 		}
-		else
-		{
-			debugPrintfAlways("refused conn on port %u already %u conns\n", port, numConns);
-		}
 	}
 	else
 	{
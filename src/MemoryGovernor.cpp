@@ -0,0 +1,59 @@
+/*
+ * MemoryGovernor.cpp
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#include "MemoryGovernor.h"
+#include "Config.h"
+
+extern "C"
+{
+	#include "user_interface.h"			// for system_get_free_heap_size()
+	#include "lwip/init.h"				// for version info
+	#include "lwip/stats.h"
+	#include "lwip/memp.h"				// for MEMP_PBUF_POOL
+}
+
+// Return the number of free elements in an LwIP memory pool, or SIZE_MAX if LwIP doesn't keep pool statistics
+/*static*/ size_t MemoryGovernor::FreePoolElements(unsigned int pool)
+{
+#if LWIP_STATS && MEMP_STATS
+	if (pool < MEMP_MAX)
+	{
+# if LWIP_VERSION_MAJOR == 2
+		const struct stats_mem& st = *lwip_stats.memp[pool];
+# else
+		const struct stats_mem& st = lwip_stats.memp[pool];
+# endif
+		return (st.avail > st.used) ? st.avail - st.used : 0;
+	}
+#endif
+	return SIZE_MAX;
+}
+
+// Return true if there is enough memory to accept a new connection without putting existing connections at risk
+/*static*/ bool MemoryGovernor::CanAccept()
+{
+	if (system_get_free_heap_size() >= MinFreeHeapToAccept && FreePoolElements(MEMP_PBUF_POOL) >= MinFreePbufsToAccept && !IsLow())
+	{
+		return true;
+	}
+	++refusedAccepts;
+	return false;
+}
+
+// Return true if memory is so short that we should slow down incoming data
+/*static*/ bool MemoryGovernor::IsLow()
+{
+	const size_t freeHeap = system_get_free_heap_size();
+	low = (low) ? freeHeap < LowFreeHeap + LowFreeHeapHysteresis : freeHeap < LowFreeHeap;
+	return low;
+}
+
+// Static data
+bool MemoryGovernor::low = false;
+uint32_t MemoryGovernor::refusedAccepts = 0;
+uint32_t MemoryGovernor::windowUpdatesHeld = 0;
+
+// End
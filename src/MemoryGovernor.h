@@ -0,0 +1,31 @@
+/*
+ * MemoryGovernor.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Admission control and receive window throttling based on free heap and pbufs
+ */
+
+#ifndef SRC_MEMORYGOVERNOR_H_
+#define SRC_MEMORYGOVERNOR_H_
+
+#include <cstdint>
+#include <cstddef>
+
+class MemoryGovernor
+{
+public:
+	static bool CanAccept();
+	static bool IsLow();
+	static void NoteWindowUpdateHeld() { ++windowUpdatesHeld; }
+	static uint32_t GetRefusedAccepts() { return refusedAccepts; }
+	static uint32_t GetWindowUpdatesHeld() { return windowUpdatesHeld; }
+	static size_t FreePoolElements(unsigned int pool);
+
+private:
+	static bool low;								// true if memory is low, with hysteresis
+	static uint32_t refusedAccepts;					// how many connections we refused because memory was short
+	static uint32_t windowUpdatesHeld;				// how many times we held back a receive window update because memory was short
+};
+
+#endif /* SRC_MEMORYGOVERNOR_H_ */
@@ -14,6 +14,9 @@ extern "C"
 	#include "user_interface.h"     // for struct rst_info
 	#include "lwip/init.h"			// for version info
 	#include "lwip/stats.h"			// for stats_display()
+	#include "lwip/memp.h"			// for MEMP_MAX
+	#include "umm_malloc/umm_malloc.h"	// for umm_info()
+	#include "lwip/dhcp.h"			// for the DHCP lease time
 
 #if LWIP_VERSION_MAJOR == 2
 	#include "lwip/apps/mdns.h"
@@ -26,7 +29,6 @@ extern "C"
 #include <cstdarg>
 #include <ESP8266WiFi.h>
 #include <DNSServer.h>
-#include <EEPROM.h>
 #include "SocketServer.h"
 #include "Config.h"
 #include "PooledStrings.h"
@@ -35,6 +37,12 @@ extern "C"
 #include "include/MessageFormats.h"
 #include "Connection.h"
 #include "Listener.h"
+#include "EventQueue.h"
+#include "Crc32.h"
+#include "Statistics.h"
+#include "MemoryGovernor.h"
+#include "SsidIndex.h"
+#include "CredentialStore.h"
 #include "Misc.h"
 
 const unsigned int ONBOARD_LED = D4;				// GPIO 2
@@ -54,7 +62,13 @@ const unsigned int MdnsTtl = 10 * 60;			// same value as on the Duet 0.6/0.8.5
 #define array _ecv_array
 
 const uint32_t MaxConnectTime = 40 * 1000;		// how long we wait for WiFi to connect in milliseconds
+const uint32_t MaxScanTime = 10 * 1000;			// how long we wait for a network scan to complete in milliseconds
+const uint32_t MaxDirectedConnectTime = 5 * 1000;	// how long we wait for a directed connection before falling back to a full scan
+const uint32_t LeaseUpdateInterval = 10 * 1000;	// how often we update the remaining DHCP lease time in RTC memory, in milliseconds
+const uint32_t MinLeaseToReuse = 30 * 60;		// after a reset we only reuse a DHCP lease that has at least this many seconds left to run
+const uint32_t RtcLeaseRecordOffset = 32;		// where we keep the lease in RTC user memory, in dwords. The first 128 bytes are used by OTA.
 const uint32_t StatusReportMillis = 200;
+const uint32_t MinEventSignalMillis = 10;		// the shortest interval between pulses on EspReqTransferPin to tell the SAM about new connection events
 
 const int DefaultWiFiChannel = 6;
 
@@ -69,6 +83,7 @@ static const char* prevLastError = nullptr;
 static uint32_t whenLastTransactionFinished = 0;
 static bool connectErrorChanged = false;
 static bool transferReadyChanged = false;
+static bool settingsCommitPending = false;		// true if we have changed settings that we couldn't commit to flash because a transfer was running
 
 static char lastConnectError[100];
 
@@ -82,16 +97,128 @@ ADC_MODE(ADC_VCC);          // need this for the ESP.getVcc() call to work
 static HSPIClass hspi;
 static uint32_t connectStartTime;
 static uint32_t lastStatusReportTime;
-static uint32_t transferBuffer[NumDwords(MaxDataLength + 1)];
+static uint32_t lastEventSignalTime;
+static uint32_t baseTransferBuffer[NumDwords(MaxDataLength + 1)];
+static uint32_t *extendedTransferBuffer = nullptr;		// allocated from the heap only if the SAM agrees to a longer data length
+static uint32_t *transferBuffer = baseTransferBuffer;
+static size_t negotiatedDataLength = MaxDataLength;		// the maximum data length we have agreed with the SAM
 
 static const WirelessConfigurationData *ssidData = nullptr;
 
+// State of a transaction whose data phase is running in the background
+static bool transactionInProgress = false;		// true from when we assert CS until we have finished processing the request
+static bool deferCommand = false;				// true if we have a command to execute after the transaction has ended
+static bool writePending = false;				// true if the data being received must be written to connections when the transfer completes
+static size_t pendingWriteLength;				// for connWrite, the amount of data we accepted
+static WriteMultiRequest pendingWriteMultiRequest;		// for connWriteMulti, what the SAM asked to write
+static WriteMultiResponse pendingWriteMultiResponse;	// for connWriteMulti, what we accepted
+
+static bool headerValid;						// true if the header of the current transaction had the right format version and CRC
+static bool framed = false;						// true if the current transaction is framed and protected by CRCs
+static bool samCrcOk;							// false if a CRC sent by the SAM in the current transaction was wrong
+static bool trailerDone;						// true if we have exchanged the CRC trailer of the current transaction
+static uint32_t txCrc, rxCrc;					// CRCs of what we have sent and received since the header in the current framed transaction
+static uint32_t *asyncReceiveBuffer;			// where the background data transfer is putting what it receives, so that we can add it to rxCrc later
+static size_t asyncReceiveDwords;
+static int32_t lastResponseLength = -1;			// how much data from transferBuffer we returned for the last command, or -1 if it can't be retransmitted
+static uint32_t lastLoopStartMicros = 0;		// loop timing since the last networkGetDiagnostics command
+static uint32_t loopCount = 0;
+static uint32_t maxLoopMicros = 0;
+static uint32_t totalLoopMicros = 0;
+
+// Asynchronous network scan
+static bool scanInProgress = false;				// true from when we start a scan until we have acted on its results
+static bool scanCompleted = false;				// set by the scan complete callback
+static bool connectAfterScan = false;			// true if we are auto-connecting and must connect to the strongest known network when the scan completes
+static int scanResult;							// the number of networks found by the last scan, or negative if it failed
+static uint32_t scanStartTime;
+static uint32_t scanCompletedTime;
+static const WirelessConfigurationData *strongestKnownNetwork = nullptr;	// the strongest network found by the last scan that we have details of
+static WiFiScanResponse scanResults;			// the cached results of the last scan
+
+// Fast reconnect data, stored in the credential store after the table of remembered networks. Entry n belongs to WirelessConfigurationData entry n.
+// The DHCP lease is not included, because it may change every time we connect and we don't want that to cost a flash write. It is kept in a LeaseRecord instead.
+struct FastConnectData
+{
+	uint8_t bssid[6];				// the access point we last connected to
+	uint8_t channel;				// the channel it was on
+	uint8_t magic;					// FastConnectMagic if this entry is valid
+};
+
+const uint8_t FastConnectMagic = 0xA5;
+const size_t FastConnectDataOffset = (MaxRememberedNetworks + 1) * sizeof(WirelessConfigurationData);
+
+static int connectIndex = -1;					// the index of the remembered network we are connecting or connected to
+static bool directedConnect = false;			// true if we are trying a directed connection to the remembered access point
+static bool attemptInProgress = false;			// true if currentAttempt is being timed
+static ConnectAttemptRecord currentAttempt;
+static ConnectAttemptRecord connectLog[MaxConnectAttemptRecords];	// circular buffer of the most recent attempts
+static uint32_t totalConnectAttempts = 0;
+
+// Boot settings, stored in the credential store after the fast reconnect data
+struct BootSettings
+{
+	uint8_t magic;					// BootSettingsMagic if the settings are valid
+	uint8_t fastBoot;				// nonzero to connect to lastNetwork as soon as we start
+	uint8_t lastNetwork;			// the index of the remembered network we last connected to
+	uint8_t zero;
+	char hostName[HostNameLength];	// the host name to use until the SAM sets one, not null terminated if it is HostNameLength characters long
+};
+
+const uint8_t BootSettingsMagic = 0x5B;
+const size_t BootSettingsOffset = FastConnectDataOffset + (MaxRememberedNetworks + 1) * sizeof(FastConnectData);
+
+// The DHCP lease we were given, kept in RTC memory so that it survives a reset but not a power cycle
+struct LeaseRecord
+{
+	uint32_t ip;
+	uint32_t gateway;
+	uint32_t netmask;
+	uint32_t dns;
+	uint32_t remainingSeconds;		// how much of the lease was left when the record was last updated
+	uint32_t network;				// the index of the remembered network that the lease belongs to
+	uint32_t crc;					// CRC of the preceding fields
+};
+
+static LeaseRecord lease;
+static bool leaseValid = false;					// true if lease holds the details of a lease that hasn't expired
+static bool leaseReused = false;				// true if we are using a lease from before the reset instead of DHCP
+static uint32_t leaseUpdateTime;				// the value of millis() when lease.remainingSeconds was last correct
+static bool fastBootConnect = false;			// true if we started to connect during setup() and the SAM hasn't taken over the connection yet
+static BootTimesResponse bootTimes;
+static WiFiEventHandler stationConnectedHandler, stationGotIpHandler;
+
+const size_t NumClockCandidates = ARRAY_SIZE(CalibrationClockCandidates);
+static_assert(NumClockCandidates <= MaxClockCandidates, "Too many clock candidates");
+static_assert(NumFastClockCandidates < NumClockCandidates, "Too many fast clock candidates");
+
+static ClockCalibrationResults calibration;		// the error counts from the networkCalibrateClock test runs since the last report
+static bool calibrationFramed = true;			// true if all of those test runs were framed
+
 // Look up a SSID in our remembered network list, return pointer to it if found
 const WirelessConfigurationData *RetrieveSsidData(const char *ssid, int *index = nullptr)
 {
+	// The index tells us which entry the SSID is in, or that we don't have it
+	const int slot = SsidIndex::Find(ssid);
+	if (slot < 0)
+	{
+		return nullptr;
+	}
+
+	const WirelessConfigurationData *wp = CredentialStore::GetPtr<WirelessConfigurationData>(slot * sizeof(WirelessConfigurationData));
+	if (wp != nullptr && strncmp(ssid, wp->ssid, sizeof(wp->ssid)) == 0)
+	{
+		if (index != nullptr)
+		{
+			*index = slot;
+		}
+		return wp;
+	}
+
+	// Another SSID has the same hash, so search the whole table
 	for (size_t i = 1; i <= MaxRememberedNetworks; ++i)
 	{
-		const WirelessConfigurationData *wp = EEPROM.getPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
+		wp = CredentialStore::GetPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
 		if (wp != nullptr && strncmp(ssid, wp->ssid, sizeof(wp->ssid)) == 0)
 		{
 			if (index != nullptr)
@@ -107,16 +234,276 @@ const WirelessConfigurationData *RetrieveSsidData(const char *ssid, int *index =
 // Find an empty entry in the table of known networks
 bool FindEmptySsidEntry(int *index)
 {
+	const int slot = SsidIndex::FindFree();
+	if (slot < 0)
+	{
+		return false;
+	}
+	*index = slot;
+	return true;
+}
+
+// Build the index of the table of known networks
+void BuildSsidIndex()
+{
+	SsidIndex::Init();
 	for (size_t i = 1; i <= MaxRememberedNetworks; ++i)
 	{
-		const WirelessConfigurationData *wp = EEPROM.getPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
-		if (wp != nullptr && wp->ssid[0] == 0xFF)
+		const WirelessConfigurationData *wp = CredentialStore::GetPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
+		if (wp != nullptr && wp->ssid[0] != 0xFF)
 		{
-			*index = i;
-			return true;
+			SsidIndex::Set(i, wp->ssid);
 		}
 	}
-	return false;
+}
+
+// Get the fast reconnect data for a remembered network, or nullptr if there is none
+const FastConnectData *GetFastConnectData(int index)
+{
+	if (index > 0 && (size_t)index <= MaxRememberedNetworks)
+	{
+		const FastConnectData *fp = CredentialStore::GetPtr<FastConnectData>(FastConnectDataOffset + index * sizeof(FastConnectData));
+		if (fp != nullptr && fp->magic == FastConnectMagic && fp->channel != 0)
+		{
+			return fp;
+		}
+	}
+	return nullptr;
+}
+
+// Forget the fast reconnect data for an entry in the table of remembered networks. The caller must commit the credential store.
+void ForgetFastConnectData(int index)
+{
+	FastConnectData temp;
+	memset(&temp, 0xFF, sizeof(temp));
+	CredentialStore::Put(FastConnectDataOffset + index * sizeof(FastConnectData), temp);
+	if (index == connectIndex)
+	{
+		connectIndex = -1;										// don't save new data for this entry when we reconnect
+	}
+}
+
+// Get the boot settings, or nullptr if they have never been saved
+const BootSettings *GetBootSettings()
+{
+	const BootSettings *bp = CredentialStore::GetPtr<BootSettings>(BootSettingsOffset);
+	return (bp != nullptr && bp->magic == BootSettingsMagic) ? bp : nullptr;
+}
+
+// Set the maximum data length we have agreed with the SAM. The buffer for the longer data length is only allocated when it is needed, so that a SAM
+// that doesn't negotiate doesn't cost us the heap. We don't agree to the longer length unless the heap will still be above the level at which we
+// stop accepting connections afterwards.
+void SetDataLength(size_t length)
+{
+	if (extendedTransferBuffer != nullptr)
+	{
+		transferBuffer = baseTransferBuffer;
+		delete[] extendedTransferBuffer;
+		extendedTransferBuffer = nullptr;
+	}
+	lastResponseLength = -1;								// transferBuffer may have changed, so we can't send the last response again
+	negotiatedDataLength = MaxDataLength;
+
+	if (length > MaxDataLength)
+	{
+		const size_t bufferBytes = NumDwords(length + 1) * sizeof(uint32_t);
+		if (system_get_free_heap_size() >= bufferBytes + MinFreeHeapToAccept)
+		{
+			extendedTransferBuffer = new uint32_t[NumDwords(length + 1)];
+			if (extendedTransferBuffer != nullptr)
+			{
+				transferBuffer = extendedTransferBuffer;
+				negotiatedDataLength = length;
+			}
+		}
+	}
+}
+
+// Commit changed settings to flash. Erasing and writing flash disables interrupts, which would hold up the HSPI transfer done interrupt
+// and stall a background data phase, so if one is running we leave the commit to loop().
+void CommitSettings()
+{
+	if (hspi.isTransferring())
+	{
+		settingsCommitPending = true;
+	}
+	else
+	{
+		settingsCommitPending = false;
+		CredentialStore::Commit();
+	}
+}
+
+// Save the boot settings if they have changed. If fast boot isn't enabled then we only save them when it is being turned off, to save flash wear.
+void SaveBootSettings(bool fastBoot)
+{
+	const BootSettings * const bp = GetBootSettings();
+	if (!fastBoot && (bp == nullptr || bp->fastBoot == 0))
+	{
+		return;
+	}
+
+	BootSettings settings;
+	memset(&settings, 0, sizeof(settings));
+	settings.magic = BootSettingsMagic;
+	settings.fastBoot = (fastBoot) ? 1 : 0;
+	settings.lastNetwork = (connectIndex > 0) ? (uint8_t)connectIndex : (bp != nullptr) ? bp->lastNetwork : 0;
+	memcpy(settings.hostName, webHostName, strnlen(webHostName, sizeof(settings.hostName)));
+	if (bp == nullptr || memcmp(bp, &settings, sizeof(settings)) != 0)
+	{
+		CredentialStore::Put(BootSettingsOffset, settings);
+		CommitSettings();
+	}
+}
+
+// Save the lease record in RTC memory
+void SaveLease()
+{
+	lease.crc = Crc32::Calc(reinterpret_cast<const uint32_t*>(&lease), NumDwords(offsetof(LeaseRecord, crc)));
+	ESP.rtcUserMemoryWrite(RtcLeaseRecordOffset, reinterpret_cast<uint32_t*>(&lease), sizeof(lease));
+}
+
+// Retrieve the lease record from RTC memory and return true if it is for the specified network and has enough time left to be worth reusing
+bool LoadLease(int network)
+{
+	leaseValid = ESP.rtcUserMemoryRead(RtcLeaseRecordOffset, reinterpret_cast<uint32_t*>(&lease), sizeof(lease))
+				&& lease.crc == Crc32::Calc(reinterpret_cast<const uint32_t*>(&lease), NumDwords(offsetof(LeaseRecord, crc)))
+				&& lease.network == (uint32_t)network
+				&& lease.remainingSeconds >= MinLeaseToReuse
+				&& lease.ip != 0;
+	leaseUpdateTime = millis();
+	return leaseValid;
+}
+
+// Record the lease that DHCP has just given us
+void NoteLease()
+{
+#if LWIP_VERSION_MAJOR == 2
+	const struct dhcp * const dhcp = netif_dhcp_data(netif_list);	// STA is on first interface
+#else
+	const struct dhcp * const dhcp = netif_list->dhcp;
+#endif
+	if (dhcp == nullptr || connectIndex <= 0)
+	{
+		leaseValid = false;
+		return;
+	}
+
+	lease.ip = WiFi.localIP();
+	lease.gateway = WiFi.gatewayIP();
+	lease.netmask = WiFi.subnetMask();
+	lease.dns = WiFi.dnsIP(0);
+	lease.remainingSeconds = dhcp->offered_t0_lease;
+	lease.network = (uint32_t)connectIndex;
+	leaseUpdateTime = millis();
+	leaseValid = true;
+	SaveLease();
+}
+
+// Count down the time left on the lease. We don't take account of renewals, so we may underestimate the time left but never overestimate it.
+// If we are using a lease from before the reset and it is about to expire, go back to using DHCP.
+void UpdateLease()
+{
+	if (leaseValid && millis() - leaseUpdateTime >= LeaseUpdateInterval)
+	{
+		const uint32_t elapsedSeconds = (millis() - leaseUpdateTime)/1000;
+		leaseUpdateTime += elapsedSeconds * 1000;
+		lease.remainingSeconds = (lease.remainingSeconds > elapsedSeconds) ? lease.remainingSeconds - elapsedSeconds : 0;
+		if (leaseReused && lease.remainingSeconds < MinLeaseToReuse)
+		{
+			debugPrint("Reused lease expiring, starting DHCP\n");
+			leaseReused = false;
+			leaseValid = false;								// NoteLease will be called when DHCP gives us a new one
+			lease.remainingSeconds = 0;
+			WiFi.config(IPAddress(), IPAddress(), IPAddress());
+		}
+		else if (lease.remainingSeconds == 0)
+		{
+			leaseValid = false;
+		}
+		SaveLease();
+	}
+}
+
+// WiFi event handlers
+void OnStationConnected(const WiFiEventStationModeConnected&)
+{
+	if (bootTimes.associatedMillis == 0)
+	{
+		bootTimes.associatedMillis = millis();
+	}
+}
+
+void OnStationGotIp(const WiFiEventStationModeGotIP&)
+{
+	if (bootTimes.gotIpMillis == 0)
+	{
+		bootTimes.gotIpMillis = millis();
+	}
+	if (wifi_station_dhcpc_status() == DHCP_STARTED)
+	{
+		NoteLease();
+	}
+}
+
+// Remember how we connected to the current network, if it has changed since last time
+void SaveFastConnectData()
+{
+	if (connectIndex <= 0)
+	{
+		return;
+	}
+
+	FastConnectData data;
+	memset(&data, 0, sizeof(data));
+	memcpy(data.bssid, WiFi.BSSID(), sizeof(data.bssid));
+	data.channel = (uint8_t)WiFi.channel();
+	data.magic = FastConnectMagic;
+
+	const FastConnectData *fp = CredentialStore::GetPtr<FastConnectData>(FastConnectDataOffset + connectIndex * sizeof(FastConnectData));
+	if (fp == nullptr || memcmp(fp, &data, sizeof(data)) != 0)
+	{
+		CredentialStore::Put(FastConnectDataOffset + connectIndex * sizeof(FastConnectData), data);
+		CommitSettings();
+	}
+
+	const BootSettings * const bp = GetBootSettings();
+	if (bp != nullptr && bp->fastBoot != 0)
+	{
+		SaveBootSettings(true);								// remember which network to connect to next time we start
+	}
+}
+
+// Record the outcome of the current connection attempt
+void EndConnectAttempt(uint8_t status)
+{
+	if (attemptInProgress)
+	{
+		attemptInProgress = false;
+		currentAttempt.durationMillis = millis() - currentAttempt.startMillis;
+		currentAttempt.status = status;
+		if (status == STATION_GOT_IP)
+		{
+			currentAttempt.channel = (uint8_t)WiFi.channel();
+		}
+		connectLog[totalConnectAttempts % MaxConnectAttemptRecords] = currentAttempt;
+		++totalConnectAttempts;
+		debugPrintf("Connect attempt type %u ended with status %u after %ums\n", (unsigned int)currentAttempt.type, status, currentAttempt.durationMillis);
+	}
+}
+
+// Start timing an attempt to connect. If the previous attempt hasn't finished, record it as abandoned.
+void StartConnectAttempt(ConnectAttemptType type, uint8_t channel)
+{
+	if (attemptInProgress)
+	{
+		EndConnectAttempt(wifi_station_get_connect_status());
+	}
+	currentAttempt.startMillis = millis();
+	currentAttempt.type = type;
+	currentAttempt.channel = channel;
+	currentAttempt.zero = 0;
+	attemptInProgress = true;
 }
 
 // Check socket number in range, returning true if yes. Otherwise, set lastError and return false;
@@ -137,9 +524,11 @@ void FactoryReset()
 	memset(&temp, 0xFF, sizeof(temp));
 	for (size_t i = 0; i <= MaxRememberedNetworks; ++i)
 	{
-		EEPROM.put(i * sizeof(WirelessConfigurationData), temp);
+		CredentialStore::Put(i * sizeof(WirelessConfigurationData), temp);
+		ForgetFastConnectData(i);
 	}
-	EEPROM.commit();
+	CommitSettings();
+	SsidIndex::Init();
 }
 
 // Try to connect using the specified SSID and password
@@ -158,9 +547,39 @@ pre(currentState == NetworkState::idle)
 #else
 	wifi_set_sleep_type(MODEM_SLEEP_T);
 #endif
-	WiFi.config(IPAddress(apData.ip), IPAddress(apData.gateway), IPAddress(apData.netmask), IPAddress(), IPAddress());
+	connectIndex = -1;
+	(void)RetrieveSsidData(apData.ssid, &connectIndex);
+	if (leaseReused && (!leaseValid || lease.network != (uint32_t)connectIndex || apData.ip != 0))
+	{
+		leaseReused = false;
+	}
+	if (leaseReused)
+	{
+		WiFi.config(IPAddress(lease.ip), IPAddress(lease.gateway), IPAddress(lease.netmask), IPAddress(lease.dns), IPAddress());
+	}
+	else
+	{
+		WiFi.config(IPAddress(apData.ip), IPAddress(apData.gateway), IPAddress(apData.netmask), IPAddress(), IPAddress());
+	}
 	debugPrintf("Trying to connect to ssid \"%s\" with password \"%s\"\n", apData.ssid, apData.password);
-	WiFi.begin(apData.ssid, apData.password);
+	if (bootTimes.connectStartMillis == 0)
+	{
+		bootTimes.connectStartMillis = millis();
+	}
+
+	// If we have connected to this network before, try to connect to the same access point on the same channel, which avoids scanning all the channels
+	const FastConnectData * const fp = GetFastConnectData(connectIndex);
+	directedConnect = (fp != nullptr);
+	if (directedConnect)
+	{
+		WiFi.begin(apData.ssid, apData.password, fp->channel, fp->bssid);
+		StartConnectAttempt(ConnectAttemptType::directed, fp->channel);
+	}
+	else
+	{
+		WiFi.begin(apData.ssid, apData.password);
+		StartConnectAttempt(ConnectAttemptType::fullScan, 0);
+	}
 
 	if (isRetry)
 	{
@@ -173,8 +592,139 @@ pre(currentState == NetworkState::idle)
 	}
 }
 
+// Called by the WiFi library when a scan has finished. Cache the results for the networkScan command and find the strongest network that we know about.
+// We don't try to connect here because we are called from the SDK's context, so we leave that to ScanPoll.
+// For the same reason we read the SDK's scan records directly instead of using the library calls that return a String, so we don't allocate memory here.
+void ScanComplete(int numNetworks)
+{
+	scanResult = numNetworks;
+	strongestKnownNetwork = nullptr;
+	scanResults.valid = 0;
+	scanResults.numNetworks = 0;
+	scanResults.totalNetworks = 0;
+
+	if (numNetworks >= 0)
+	{
+		scanResults.valid = 1;
+		scanResults.totalNetworks = (uint8_t)std::min<int>(numNetworks, 255);
+		int8_t strongestRssi = 0;
+		for (int i = 0; i < numNetworks; ++i)
+		{
+			const bss_info * const it = static_cast<const bss_info*>(WiFi.getScanInfoByIndex(i));
+			if (it == nullptr)
+			{
+				continue;
+			}
+
+			char ssid[SsidLength + 1];
+			const size_t ssidLength = std::min<size_t>(it->ssid_len, std::min<size_t>(sizeof(it->ssid), SsidLength));
+			memcpy(ssid, it->ssid, ssidLength);
+			ssid[ssidLength] = 0;
+			const int8_t rssi = it->rssi;
+			debugPrintf("found network %s\n", ssid);
+
+			const WirelessConfigurationData *wp = RetrieveSsidData(ssid, nullptr);
+			if (wp != nullptr && (strongestKnownNetwork == nullptr || rssi > strongestRssi))
+			{
+				strongestKnownNetwork = wp;
+				strongestRssi = rssi;
+			}
+
+			// Insert this network into the cached results, strongest first, dropping the weakest if there is no room
+			size_t pos = scanResults.numNetworks;
+			while (pos != 0 && scanResults.networks[pos - 1].rssi < rssi)
+			{
+				--pos;
+			}
+			if (pos < MaxScanResults)
+			{
+				const size_t numToMove = std::min<size_t>(scanResults.numNetworks, MaxScanResults - 1) - pos;
+				memmove(&scanResults.networks[pos + 1], &scanResults.networks[pos], numToMove * sizeof(WiFiScanEntry));
+				WiFiScanEntry& entry = scanResults.networks[pos];
+				memset(&entry, 0, sizeof(entry));
+				memcpy(entry.ssid, ssid, ssidLength);
+				memcpy(entry.bssid, it->bssid, sizeof(entry.bssid));
+				entry.rssi = rssi;
+				entry.channel = it->channel;
+				entry.authMode = (uint8_t)it->authmode;
+				entry.hidden = (it->is_hidden) ? 1 : 0;
+				if (scanResults.numNetworks < MaxScanResults)
+				{
+					++scanResults.numNetworks;
+				}
+			}
+		}
+		WiFi.scanDelete();
+	}
+
+	scanCompletedTime = millis();
+	scanCompleted = true;
+}
+
+// Start an asynchronous network scan. ScanComplete will be called when it has finished.
+void StartScan()
+{
+	scanInProgress = true;
+	scanCompleted = false;
+	scanStartTime = millis();
+	WiFi.scanNetworksAsync(ScanComplete, true);
+}
+
+// Check whether a network scan has completed or timed out, and if we are auto-connecting then connect to the strongest known network
+void ScanPoll()
+{
+	if (!scanInProgress)
+	{
+		return;
+	}
+
+	const char *error = nullptr;
+	if (scanCompleted)
+	{
+		if (scanResult < 0)
+		{
+			error = "network scan failed";
+		}
+		else if (strongestKnownNetwork == nullptr)
+		{
+			error = "no known networks found";
+		}
+	}
+	else if (millis() - scanStartTime >= MaxScanTime)
+	{
+		error = "network scan timed out";
+		scanResults.valid = 0;
+	}
+	else
+	{
+		return;											// still scanning
+	}
+
+	scanInProgress = false;
+	if (connectAfterScan)
+	{
+		connectAfterScan = false;
+		if (error == nullptr)
+		{
+			ssidData = strongestKnownNetwork;
+			ConnectToAccessPoint(*ssidData, false);
+		}
+		else
+		{
+			lastError = error;
+			currentState = WiFiState::idle;
+			digitalWrite(ONBOARD_LED, !ONBOARD_LED_ON);
+		}
+	}
+}
+
 void ConnectPoll()
 {
+	if (connectAfterScan)
+	{
+		return;											// we are waiting for the scan to complete before we start connecting
+	}
+
 	// The Arduino WiFi.status() call is fairly useless here because it discards too much information, so use the SDK API call instead
 	const uint8_t status = wifi_station_get_connect_status();
 	const char *error = nullptr;
@@ -184,6 +734,22 @@ void ConnectPoll()
 	{
 	case WiFiState::connecting:
 	case WiFiState::reconnecting:
+		if (directedConnect
+			&& (   status == STATION_NO_AP_FOUND || status == STATION_CONNECT_FAIL
+				|| (status == STATION_CONNECTING && millis() - currentAttempt.startMillis >= MaxDirectedConnectTime)
+			   )
+		   )
+		{
+			// The directed connection failed, perhaps because the access point has changed channel or been replaced, so fall back to a full scan
+			debugPrint("Directed connection failed, scanning\n");
+			EndConnectAttempt(status);
+			directedConnect = false;
+			wifi_station_disconnect();
+			WiFi.begin(ssidData->ssid, ssidData->password);
+			StartConnectAttempt(ConnectAttemptType::fullScan, 0);
+			break;
+		}
+
 		// We are trying to connect or reconnect, so check for success or failure
 		switch (status)
 		{
@@ -227,6 +793,8 @@ void ConnectPoll()
 			}
 
 			debugPrint("Connected to AP\n");
+			EndConnectAttempt(status);
+			SaveFastConnectData();
 			currentState = WiFiState::connected;
 			digitalWrite(ONBOARD_LED, ONBOARD_LED_ON);
 			break;
@@ -244,6 +812,7 @@ void ConnectPoll()
 			lastError = lastConnectError;
 			connectErrorChanged = true;
 			debugPrint("Failed to connect to AP\n");
+			EndConnectAttempt(status);
 
 			if (!retry)
 			{
@@ -265,6 +834,7 @@ void ConnectPoll()
 			case STATION_CONNECTING:							// auto reconnecting
 				error = "auto reconnecting";
 				currentState = WiFiState::autoReconnecting;
+				StartConnectAttempt(ConnectAttemptType::autoReconnect, 0);
 				break;
 
 			case STATION_IDLE:
@@ -308,17 +878,21 @@ void ConnectPoll()
 		if (status == STATION_GOT_IP)
 		{
 			lastError = "Auto reconnect succeeded";
+			EndConnectAttempt(status);
+			SaveFastConnectData();
 			currentState = WiFiState::connected;
 		}
 		else if (status != STATION_CONNECTING && lastError == nullptr)
 		{
 			lastError = "Auto reconnect failed, trying manual reconnect";
+			EndConnectAttempt(status);
 			connectStartTime = millis();						// start the manual reconnect timer
 			retry = true;
 		}
 		else if (millis() - connectStartTime >= MaxConnectTime)
 		{
 			lastError = "Timed out trying to auto-reconnect";
+			EndConnectAttempt(status);
 			retry = true;
 		}
 		break;
@@ -340,48 +914,27 @@ pre(currentState == WiFiState::idle)
 
 	if (ssid == nullptr || ssid[0] == 0)
 	{
-		// Auto scan for strongest known network, then try to connect to it
-		const int8_t num_ssids = WiFi.scanNetworks(false, true);
-		if (num_ssids < 0)
-		{
-			lastError = "network scan failed";
-			currentState = WiFiState::idle;
-			digitalWrite(ONBOARD_LED, !ONBOARD_LED_ON);
-			return;
-		}
-
-		// Find the strongest network that we know about
-		int8_t strongestNetwork = -1;
-		for (int8_t i = 0; i < num_ssids; ++i)
-		{
-			debugPrintfAlways("found network %s\n", WiFi.SSID(i).c_str());
-			if (strongestNetwork < 0 || WiFi.RSSI(i) > WiFi.RSSI(strongestNetwork))
-			{
-				const WirelessConfigurationData *wp = RetrieveSsidData(WiFi.SSID(i).c_str(), nullptr);
-				if (wp != nullptr)
-				{
-					strongestNetwork = i;
-					ssidData = wp;
-				}
-			}
-		}
-		if (strongestNetwork < 0)
+		// Scan for the strongest known network in the background, then ScanPoll will try to connect to it.
+		// If a scan requested by the SAM is already running then we use its results.
+		currentSsid[0] = 0;
+		currentState = WiFiState::connecting;
+		connectStartTime = millis();
+		connectAfterScan = true;
+		if (!scanInProgress)
 		{
-			lastError = "no known networks found";
-			return;
+			StartScan();
 		}
+		return;
 	}
-	else
+
+	ssidData = RetrieveSsidData(ssid, nullptr);
+	if (ssidData == nullptr)
 	{
-		ssidData = RetrieveSsidData(ssid, nullptr);
-		if (ssidData == nullptr)
-		{
-			lastError = "no data found for requested SSID";
-			return;
-		}
+		lastError = "no data found for requested SSID";
+		return;
 	}
 
-	// ssidData contains the details of the strongest known access point
+	// ssidData contains the details of the requested access point
 	ConnectToAccessPoint(*ssidData, false);
 }
 
@@ -444,7 +997,7 @@ bool ValidApData(const WirelessConfigurationData &apData)
 void StartAccessPoint()
 {
 	WirelessConfigurationData apData;
-	EEPROM.get(0, apData);
+	CredentialStore::Get(0, apData);
 
 	if (ValidApData(apData))
 	{
@@ -608,61 +1161,294 @@ void RebuildServices()
 
 #endif
 
-// Send a response.
-// 'response' is the number of byes of response if positive, or the error code if negative.
-// Use only to respond to commands which don't include a data block, or when we don't want to read the data block.
-void ICACHE_RAM_ATTR SendResponse(int32_t response)
+// Send the response dword and receive param32 from the SAM
+void ICACHE_RAM_ATTR ExchangeResponse(int32_t response)
 {
-	(void)hspi.transfer32(response);
-	if (response > 0)
+	messageHeaderIn.hdr.param32 = hspi.transfer32(response);
+	if (framed)
 	{
-		hspi.transferDwords(transferBuffer, nullptr, NumDwords((size_t)response));
+		const uint32_t responseDword = (uint32_t)response;
+		txCrc = Crc32::Update(Crc32::Initial, &responseDword, 1);
+		rxCrc = Crc32::Update(Crc32::Initial, &messageHeaderIn.hdr.param32, 1);
 	}
 }
 
-// This is called when the SAM is asking to transfer data
-void ICACHE_RAM_ATTR ProcessRequest()
+// Exchange data with the SAM, keeping track of the CRCs if the transaction is framed
+void ICACHE_RAM_ATTR TransferData(const uint32_t *txData, uint32_t *rxData, size_t numDwords)
 {
-	// Set up our own headers
-	messageHeaderIn.hdr.formatVersion = InvalidFormatVersion;
-	messageHeaderOut.hdr.formatVersion = MyFormatVersion;
-	messageHeaderOut.hdr.state = currentState;
-	bool deferCommand = false;
-
-	// Begin the transaction
-	digitalWrite(SamSSPin, LOW);            // assert CS to SAM
-	hspi.beginTransaction();
-
-	// Exchange headers, except for the last dword which will contain our response
-	hspi.transferDwords(messageHeaderOut.asDwords, messageHeaderIn.asDwords, headerDwords - 1);
-
-	if (messageHeaderIn.hdr.formatVersion != MyFormatVersion)
+	hspi.transferDwords(txData, rxData, numDwords);
+	if (framed)
 	{
-		SendResponse(ResponseBadRequestFormatVersion);
+		if (txData != nullptr)
+		{
+			txCrc = Crc32::Update(txCrc, txData, numDwords);
+		}
+		if (rxData != nullptr)
+		{
+			rxCrc = Crc32::Update(rxCrc, rxData, numDwords);
+		}
 	}
-	else if (messageHeaderIn.hdr.dataLength > MaxDataLength)
+}
+
+// Start the last data transfer of the transaction, which runs in the background. The CRC of the received data is calculated when it has finished.
+void ICACHE_RAM_ATTR StartTransferData(const uint32_t *txData, uint32_t *rxData, size_t numDwords)
+{
+	if (framed && txData != nullptr)
 	{
-		SendResponse(ResponseBadDataLength);
+		txCrc = Crc32::Update(txCrc, txData, numDwords);
 	}
-	else
-	{
-		const size_t dataBufferAvailable = std::min<size_t>(messageHeaderIn.hdr.dataBufferAvailable, MaxDataLength);
+	asyncReceiveBuffer = rxData;
+	asyncReceiveDwords = numDwords;
+	hspi.startTransferDwords(txData, rxData, numDwords);
+}
 
-		// See what command we have received and take appropriate action
-		switch (messageHeaderIn.hdr.command)
+// If this is a framed transaction, exchange the CRC trailer unless we have already done so.
+// Return true if the SAM's CRCs were correct, so that we can act on the data it sent. Must not be called while a background transfer is in progress.
+bool ICACHE_RAM_ATTR ExchangeTrailer()
+{
+	if (framed && !trailerDone)
+	{
+		if (asyncReceiveBuffer != nullptr)
 		{
-		case NetworkCommand::nullCommand:					// no command being sent, SAM just wants the network status
-			SendResponse(ResponseEmpty);
-			break;
-
-		case NetworkCommand::networkStartClient:			// connect to an access point
-			if (currentState == WiFiState::idle)
+			rxCrc = Crc32::Update(rxCrc, asyncReceiveBuffer, asyncReceiveDwords);
+			asyncReceiveBuffer = nullptr;
+		}
+		const uint32_t samCrc = hspi.transfer32(Crc32::Finish(txCrc));
+		samCrcOk = samCrcOk && samCrc == Crc32::Finish(rxCrc);
+		(void)hspi.transfer32((samCrcOk) ? ResponseEmpty : ResponseBadCrc);
+		trailerDone = true;
+	}
+	return samCrcOk;
+}
+
+// Send a response.
+// 'response' is the number of byes of response if positive, or the error code if negative.
+// Use only to respond to commands which don't include a data block, or when we don't want to read the data block.
+// Any data is sent from transferBuffer in the background, so the caller must not change transferBuffer before the transaction has finished.
+void ICACHE_RAM_ATTR SendResponse(int32_t response)
+{
+	ExchangeResponse(response);
+	if (response >= 0)
+	{
+		lastResponseLength = response;					// remember it in case the SAM asks us to send it again
+		if (response > 0)
+		{
+			StartTransferData(transferBuffer, nullptr, NumDwords((size_t)response));
+		}
+	}
+}
+
+// Pass the data we received for a connWrite command to the connection
+void CompleteConnWrite()
+{
+	Connection& conn = Connection::Get(messageHeaderIn.hdr.socketNumber);
+	const size_t requestedlength = messageHeaderIn.hdr.dataLength;
+	const bool closeAfterSending = (pendingWriteLength == requestedlength) && (messageHeaderIn.hdr.flags & MessageHeaderSamToEsp::FlagCloseAfterWrite) != 0;
+	const bool push = (pendingWriteLength == requestedlength) && (messageHeaderIn.hdr.flags & MessageHeaderSamToEsp::FlagPush) != 0;
+	const size_t written = conn.Write(reinterpret_cast<uint8_t *>(transferBuffer), pendingWriteLength, push, closeAfterSending);
+	if (written != pendingWriteLength)
+	{
+		lastError = "incomplete write";
+	}
+}
+
+// Pass the data we received for a connWriteMulti command to the connections
+void CompleteConnWriteMulti()
+{
+	const uint8_t *segment = reinterpret_cast<const uint8_t *>(transferBuffer);
+	for (size_t i = 0; i < MaxConnections; ++i)
+	{
+		const size_t requestedLength = pendingWriteMultiRequest.length[i];
+		const uint8_t flags = pendingWriteMultiRequest.flags[i];
+		if (requestedLength != 0 || flags != 0)
+		{
+			const size_t acceptedLength = pendingWriteMultiResponse.acceptedLength[i];
+			const bool closeAfterSending = (acceptedLength == requestedLength) && (flags & MessageHeaderSamToEsp::FlagCloseAfterWrite) != 0;
+			const bool push = (acceptedLength == requestedLength) && (flags & MessageHeaderSamToEsp::FlagPush) != 0;
+			const size_t written = Connection::Get(i).Write(segment, acceptedLength, push, closeAfterSending);
+			if (written != acceptedLength)
+			{
+				lastError = "incomplete write";
+			}
+			segment += NumDwords(requestedLength) * sizeof(uint32_t);
+		}
+	}
+}
+
+// Choose a clock speed from the calibration error counts: one step slower than the fastest candidate at which neither side saw an error, provided that it
+// was clean too. The candidates that are faster than the default are only considered if the SAM uses framed transactions, so that it can recover from
+// the occasional error that a short test misses.
+uint8_t SelectClockCandidate(bool allowFast)
+{
+	for (size_t candidate = (allowFast) ? 0 : NumFastClockCandidates; candidate + 1 < NumClockCandidates; ++candidate)
+	{
+		if (calibration.entries[candidate].bitErrors == 0 && calibration.entries[candidate].samBitErrors == 0)
+		{
+			const ClockCalibrationEntry& slower = calibration.entries[candidate + 1];
+			return (slower.bitErrors == 0 && slower.samBitErrors == 0) ? (uint8_t)(candidate + 1) : 0xFF;
+		}
+	}
+	return 0xFF;
+}
+
+// Exchange the test pattern with the SAM at each candidate clock speed, adding up the errors, then restore the original clock speed and start sending the results.
+// We don't change the clock speed until the SAM has reported what it received.
+void CalibrateClock(size_t patternLength)
+{
+	const size_t patternDwords = NumDwords(patternLength);
+	uint32_t * const pattern = transferBuffer;
+	uint32_t * const received = transferBuffer + patternDwords;
+	for (size_t i = 0; i < patternDwords; ++i)
+	{
+		pattern[i] = CalibrationPatternDword(i);
+	}
+
+	if (calibration.numRuns == 0)
+	{
+		memset(&calibration, 0, sizeof(calibration));
+		calibration.numCandidates = NumClockCandidates;
+		calibrationFramed = true;
+	}
+	calibration.previousClockReg = SPI1CLK;
+	for (size_t candidate = 0; candidate < NumClockCandidates; ++candidate)
+	{
+		hspi.setClockDivider(CalibrationClockCandidates[candidate]);
+		hspi.transferDwords(pattern, received, patternDwords);		// not included in the CRCs, because we expect some errors
+		uint32_t bitErrors = 0;
+		for (size_t i = 0; i < patternDwords; ++i)
+		{
+			bitErrors += __builtin_popcount(received[i] ^ pattern[i]);
+		}
+		calibration.entries[candidate].clockReg = CalibrationClockCandidates[candidate];
+		calibration.entries[candidate].bitErrors += bitErrors;
+	}
+	hspi.setClockDivider(calibration.previousClockReg);
+
+	if (calibration.numRuns < UINT16_MAX)
+	{
+		++calibration.numRuns;
+	}
+	calibrationFramed = calibrationFramed && framed;
+	calibration.selected = SelectClockCandidate(calibrationFramed);
+	memcpy(transferBuffer, &calibration, sizeof(calibration));
+	StartTransferData(transferBuffer, nullptr, NumDwords(sizeof(calibration)));
+}
+
+// Collect the diagnostics for a networkGetDiagnostics command and reset the loop timing
+void GetDiagnostics(DiagnosticsResponse& resp)
+{
+	const size_t UmmBlockSize = 8;					// the heap allocation unit used by umm_malloc
+
+	resp.uptimeMillis = millis();
+	resp.freeHeap = system_get_free_heap_size();
+	umm_info(nullptr, 0);							// this updates ummHeapInfo without printing anything
+	resp.maxFreeBlock = ummHeapInfo.maxFreeContiguousBlocks * UmmBlockSize;
+	resp.heapFragmentation = (resp.freeHeap == 0 || resp.maxFreeBlock >= resp.freeHeap) ? 0 : 100 - (resp.maxFreeBlock * 100)/resp.freeHeap;
+	resp.numConnections = MaxConnections;
+	resp.loopCount = loopCount;
+	resp.maxLoopMicros = maxLoopMicros;
+	resp.averageLoopMicros = (loopCount == 0) ? 0 : totalLoopMicros/loopCount;
+	loopCount = maxLoopMicros = totalLoopMicros = 0;
+	resp.refusedAccepts = MemoryGovernor::GetRefusedAccepts();
+	resp.windowUpdatesHeld = MemoryGovernor::GetWindowUpdatesHeld();
+	resp.writesAttempted = Connection::GetWritesAttempted();
+	resp.writeEstimateFailures = Connection::GetWriteEstimateFailures();
+	resp.writesRounded = Connection::GetWritesRounded();
+	resp.bytesDeferredByRounding = Connection::GetBytesDeferredByRounding();
+	resp.settingsSnapshots = CredentialStore::GetCompactions();
+
+	Connection::GetAllDiagnostics(resp.connections);
+
+	memset(resp.pools, 0, sizeof(resp.pools));
+#if LWIP_STATS && MEMP_STATS
+	resp.numPools = std::min<size_t>(MEMP_MAX, MaxMempPools);
+	resp.pbufPoolIndex = (MEMP_PBUF_POOL < MaxMempPools) ? MEMP_PBUF_POOL : 0xFF;
+	for (size_t i = 0; i < resp.numPools; ++i)
+	{
+# if LWIP_VERSION_MAJOR == 2
+		const struct stats_mem& st = *lwip_stats.memp[i];
+# else
+		const struct stats_mem& st = lwip_stats.memp[i];
+# endif
+		resp.pools[i].avail = std::min<uint32_t>(st.avail, UINT16_MAX);
+		resp.pools[i].used = std::min<uint32_t>(st.used, UINT16_MAX);
+		resp.pools[i].max = std::min<uint32_t>(st.max, UINT16_MAX);
+		resp.pools[i].err = std::min<uint32_t>(st.err, UINT16_MAX);
+	}
+#else
+	resp.numPools = 0;
+	resp.pbufPoolIndex = 0xFF;
+#endif
+}
+
+void FinishRequest();
+
+// This is called when the SAM is asking to transfer data
+void ICACHE_RAM_ATTR ProcessRequest()
+{
+	// Set up our own headers
+	messageHeaderIn.hdr.formatVersion = InvalidFormatVersion;
+	messageHeaderOut.hdr.formatVersion = MyFormatVersion;
+	messageHeaderOut.hdr.state = currentState;
+	deferCommand = false;
+	writePending = false;
+	samCrcOk = true;
+	trailerDone = false;
+	asyncReceiveBuffer = nullptr;
+
+	// Begin the transaction
+	Statistics::BeginTransaction(hspi);
+	transactionInProgress = true;
+	digitalWrite(SamSSPin, LOW);            // assert CS to SAM
+	hspi.beginTransaction();
+
+	// Exchange headers, except for the last dword which will contain our response
+	hspi.transferDwords(messageHeaderOut.asDwords, messageHeaderIn.asDwords, headerDwords - 1);
+
+	// If the transaction is framed, exchange the CRCs of the headers
+	framed = (messageHeaderIn.hdr.formatVersion == MyFramedFormatVersion);
+	if (framed)
+	{
+		const uint32_t samHeaderCrc = hspi.transfer32(Crc32::Calc(messageHeaderOut.asDwords, headerDwords - 1));
+		samCrcOk = (samHeaderCrc == Crc32::Calc(messageHeaderIn.asDwords, headerDwords - 1));
+	}
+	headerValid = (messageHeaderIn.hdr.formatVersion == MyFormatVersion || framed) && samCrcOk;
+
+	if (messageHeaderIn.hdr.formatVersion != MyFormatVersion && !framed)
+	{
+		SendResponse(ResponseBadRequestFormatVersion);
+	}
+	else if (!samCrcOk)
+	{
+		SendResponse(ResponseBadCrc);
+	}
+	else if (messageHeaderIn.hdr.dataLength > negotiatedDataLength)
+	{
+		SendResponse(ResponseBadDataLength);
+	}
+	else
+	{
+		const size_t dataBufferAvailable = std::min<size_t>(messageHeaderIn.hdr.dataBufferAvailable, negotiatedDataLength);
+		if (messageHeaderIn.hdr.command != NetworkCommand::networkRetransmit)
+		{
+			lastResponseLength = -1;						// this command may overwrite transferBuffer
+		}
+
+		// See what command we have received and take appropriate action
+		switch (messageHeaderIn.hdr.command)
+		{
+		case NetworkCommand::nullCommand:					// no command being sent, SAM just wants the network status
+			SendResponse(ResponseEmpty);
+			break;
+
+		case NetworkCommand::networkStartClient:			// connect to an access point
+			if (currentState == WiFiState::idle || (fastBootConnect && currentState != WiFiState::runningAsAccessPoint))
 			{
 				deferCommand = true;
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+				ExchangeResponse(ResponseEmpty);
 				if (messageHeaderIn.hdr.dataLength != 0 && messageHeaderIn.hdr.dataLength <= SsidLength + 1)
 				{
-					hspi.transferDwords(nullptr, transferBuffer, NumDwords(messageHeaderIn.hdr.dataLength));
+					TransferData(nullptr, transferBuffer, NumDwords(messageHeaderIn.hdr.dataLength));
 					reinterpret_cast<char *>(transferBuffer)[messageHeaderIn.hdr.dataLength] = 0;
 				}
 			}
@@ -676,7 +1462,7 @@ void ICACHE_RAM_ATTR ProcessRequest()
 			if (currentState == WiFiState::idle)
 			{
 				deferCommand = true;
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+				ExchangeResponse(ResponseEmpty);
 			}
 			else
 			{
@@ -686,12 +1472,12 @@ void ICACHE_RAM_ATTR ProcessRequest()
 
 		case NetworkCommand::networkFactoryReset:			// clear remembered list, reset factory defaults
 			deferCommand = true;
-			messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+			ExchangeResponse(ResponseEmpty);
 			break;
 
 		case NetworkCommand::networkStop:					// disconnect from an access point, or close down our own access point
 			deferCommand = true;
-			messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+			ExchangeResponse(ResponseEmpty);
 			break;
 
 		case NetworkCommand::networkGetStatus:				// get the network connection status
@@ -727,32 +1513,37 @@ void ICACHE_RAM_ATTR ProcessRequest()
 		case NetworkCommand::networkConfigureAccessPoint:	// configure our own access point details
 			if (messageHeaderIn.hdr.dataLength == sizeof(WirelessConfigurationData))
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
-				hspi.transferDwords(nullptr, transferBuffer, NumDwords(sizeof(WirelessConfigurationData)));
-				const WirelessConfigurationData * const receivedClientData = reinterpret_cast<const WirelessConfigurationData *>(transferBuffer);
-				int index;
-				if (messageHeaderIn.hdr.command == NetworkCommand::networkConfigureAccessPoint)
-				{
-					index = 0;
-				}
-				else
+				ExchangeResponse(ResponseEmpty);
+				TransferData(nullptr, transferBuffer, NumDwords(sizeof(WirelessConfigurationData)));
+				if (ExchangeTrailer())
 				{
-					index = -1;
-					(void)RetrieveSsidData(receivedClientData->ssid, &index);
-					if (index < 0)
+					const WirelessConfigurationData * const receivedClientData = reinterpret_cast<const WirelessConfigurationData *>(transferBuffer);
+					int index;
+					if (messageHeaderIn.hdr.command == NetworkCommand::networkConfigureAccessPoint)
 					{
-						(void)FindEmptySsidEntry(&index);
+						index = 0;
+					}
+					else
+					{
+						index = -1;
+						(void)RetrieveSsidData(receivedClientData->ssid, &index);
+						if (index < 0)
+						{
+							(void)FindEmptySsidEntry(&index);
+						}
 					}
-				}
 
-				if (index >= 0)
-				{
-					EEPROM.put(index * sizeof(WirelessConfigurationData), *receivedClientData);
-					EEPROM.commit();
-				}
-				else
-				{
-					lastError = "SSID table full";
+					if (index >= 0)
+					{
+						CredentialStore::Put(index * sizeof(WirelessConfigurationData), *receivedClientData);
+						ForgetFastConnectData(index);		// the details may have changed, so don't try a directed connection next time
+						CommitSettings();
+						SsidIndex::Set(index, receivedClientData->ssid);
+					}
+					else
+					{
+						lastError = "SSID table full";
+					}
 				}
 			}
 			else
@@ -764,20 +1555,25 @@ void ICACHE_RAM_ATTR ProcessRequest()
 		case NetworkCommand::networkDeleteSsid:				// delete a network from our access point list
 			if (messageHeaderIn.hdr.dataLength == SsidLength)
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
-				hspi.transferDwords(nullptr, transferBuffer, NumDwords(SsidLength));
+				ExchangeResponse(ResponseEmpty);
+				TransferData(nullptr, transferBuffer, NumDwords(SsidLength));
 
-				int index;
-				if (RetrieveSsidData(reinterpret_cast<char*>(transferBuffer), &index) != nullptr)
-				{
-					WirelessConfigurationData localSsidData;
-					memset(&localSsidData, 0xFF, sizeof(localSsidData));
-					EEPROM.put(index * sizeof(WirelessConfigurationData), localSsidData);
-					EEPROM.commit();
-				}
-				else
+				if (ExchangeTrailer())
 				{
-					lastError = "SSID not found";
+					int index;
+					if (RetrieveSsidData(reinterpret_cast<char*>(transferBuffer), &index) != nullptr)
+					{
+						WirelessConfigurationData localSsidData;
+						memset(&localSsidData, 0xFF, sizeof(localSsidData));
+						CredentialStore::Put(index * sizeof(WirelessConfigurationData), localSsidData);
+						ForgetFastConnectData(index);
+						CommitSettings();
+						SsidIndex::Clear(index);
+					}
+					else
+					{
+						lastError = "SSID not found";
+					}
 				}
 			}
 			else
@@ -796,7 +1592,7 @@ void ICACHE_RAM_ATTR ProcessRequest()
 				char *p = reinterpret_cast<char*>(transferBuffer);
 				for (size_t i = 0; i <= MaxRememberedNetworks && (i + 1) * ReducedWirelessConfigurationDataSize <= dataBufferAvailable; ++i)
 				{
-					const WirelessConfigurationData * const tempData = EEPROM.getPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
+					const WirelessConfigurationData * const tempData = CredentialStore::GetPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
 					if (tempData->ssid[0] != 0xFF)
 					{
 						memcpy(p, tempData, ReducedWirelessConfigurationDataSize);
@@ -818,7 +1614,7 @@ void ICACHE_RAM_ATTR ProcessRequest()
 				char *p = reinterpret_cast<char*>(transferBuffer);
 				for (size_t i = 0; i <= MaxRememberedNetworks; ++i)
 				{
-					const WirelessConfigurationData * const tempData = EEPROM.getPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
+					const WirelessConfigurationData * const tempData = CredentialStore::GetPtr<WirelessConfigurationData>(i * sizeof(WirelessConfigurationData));
 					if (tempData->ssid[0] != 0xFF)
 					{
 						for (size_t j = 0; j < SsidLength && tempData->ssid[j] != 0; ++j)
@@ -849,13 +1645,21 @@ void ICACHE_RAM_ATTR ProcessRequest()
 		case NetworkCommand::networkSetHostName:			// set the host name
 			if (messageHeaderIn.hdr.dataLength == HostNameLength)
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
-				hspi.transferDwords(nullptr, transferBuffer, NumDwords(HostNameLength));
-				memcpy(webHostName, transferBuffer, HostNameLength);
-				webHostName[HostNameLength] = 0;			// ensure null terminator
+				ExchangeResponse(ResponseEmpty);
+				TransferData(nullptr, transferBuffer, NumDwords(HostNameLength));
+				if (ExchangeTrailer())
+				{
+					memcpy(webHostName, transferBuffer, HostNameLength);
+					webHostName[HostNameLength] = 0;			// ensure null terminator
 #if LWIP_VERSION_MAJOR == 2
-				netbiosns_set_name(webHostName);
+					netbiosns_set_name(webHostName);
 #endif
+					const BootSettings * const bp = GetBootSettings();
+					if (bp != nullptr && bp->fastBoot != 0)
+					{
+						SaveBootSettings(true);				// use the new name next time we start
+					}
+				}
 			}
 			else
 			{
@@ -888,22 +1692,29 @@ void ICACHE_RAM_ATTR ProcessRequest()
 		case NetworkCommand::networkListen:				// listen for incoming connections
 			if (messageHeaderIn.hdr.dataLength == sizeof(ListenOrConnectData))
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+				ExchangeResponse(ResponseEmpty);
 				ListenOrConnectData lcData;
-				hspi.transferDwords(nullptr, reinterpret_cast<uint32_t*>(&lcData), NumDwords(sizeof(lcData)));
-				const bool ok = Listener::Listen(lcData.remoteIp, lcData.port, lcData.protocol, lcData.maxConnections);
-				if (ok)
+				TransferData(nullptr, reinterpret_cast<uint32_t*>(&lcData), NumDwords(sizeof(lcData)));
+				if (ExchangeTrailer())
 				{
-					if (lcData.protocol < 3)			// if it's FTP, HTTP or Telnet protocol
+					const bool ok = Listener::Listen(lcData.remoteIp, lcData.port, lcData.protocol, lcData.maxConnections);
+					if (ok)
 					{
-						RebuildServices();				// update the MDNS services
+						if (lcData.maxConnections != 0 && bootTimes.firstListenerMillis == 0)
+						{
+							bootTimes.firstListenerMillis = millis();
+						}
+						if (lcData.protocol < 3)			// if it's FTP, HTTP or Telnet protocol
+						{
+							RebuildServices();				// update the MDNS services
+						}
+						debugPrintf("%sListening on port %u\n", (lcData.maxConnections == 0) ? "Stopped " : "", lcData.port);
+					}
+					else
+					{
+						lastError = "Listen failed";
+						debugPrint("Listen failed\n");
 					}
-					debugPrintf("%sListening on port %u\n", (lcData.maxConnections == 0) ? "Stopped " : "", lcData.port);
-				}
-				else
-				{
-					lastError = "Listen failed";
-					debugPrint("Listen failed\n");
 				}
 			}
 			break;
@@ -912,9 +1723,9 @@ void ICACHE_RAM_ATTR ProcessRequest()
 		case NetworkCommand::unused_networkStopListening:
 			if (messageHeaderIn.hdr.dataLength == sizeof(ListenOrConnectData))
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+				ExchangeResponse(ResponseEmpty);
 				ListenOrConnectData lcData;
-				hspi.transferDwords(nullptr, reinterpret_cast<uint32_t*>(&lcData), NumDwords(sizeof(lcData)));
+				TransferData(nullptr, reinterpret_cast<uint32_t*>(&lcData), NumDwords(sizeof(lcData)));
 				Listener::StopListening(lcData.port);
 				RebuildServices();						// update the MDNS services
 				debugPrintf("Stopped listening on port %u\n", lcData.port);
@@ -925,24 +1736,24 @@ void ICACHE_RAM_ATTR ProcessRequest()
 		case NetworkCommand::connAbort:					// terminate a socket rudely
 			if (ValidSocketNumber(messageHeaderIn.hdr.socketNumber))
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+				ExchangeResponse(ResponseEmpty);
 				Connection::Get(messageHeaderIn.hdr.socketNumber).Terminate(true);
 			}
 			else
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseBadParameter);
+				ExchangeResponse(ResponseBadParameter);
 			}
 			break;
 
 		case NetworkCommand::connClose:					// close a socket gracefully
 			if (ValidSocketNumber(messageHeaderIn.hdr.socketNumber))
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+				ExchangeResponse(ResponseEmpty);
 				Connection::Get(messageHeaderIn.hdr.socketNumber).Close();
 			}
 			else
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseBadParameter);
+				ExchangeResponse(ResponseBadParameter);
 			}
 			break;
 
@@ -950,51 +1761,191 @@ void ICACHE_RAM_ATTR ProcessRequest()
 			if (ValidSocketNumber(messageHeaderIn.hdr.socketNumber))
 			{
 				Connection& conn = Connection::Get(messageHeaderIn.hdr.socketNumber);
-				const size_t amount = conn.Read(reinterpret_cast<uint8_t *>(transferBuffer), std::min<size_t>(messageHeaderIn.hdr.dataBufferAvailable, MaxDataLength));
-				messageHeaderIn.hdr.param32 = hspi.transfer32(amount);
-				hspi.transferDwords(transferBuffer, nullptr, NumDwords(amount));
+				const size_t amount = std::min<size_t>(conn.CanRead(), dataBufferAvailable);
+				if (framed)
+				{
+					// Copy the data to transferBuffer so that we can calculate the CRC and send it again if the SAM asks us to
+					SendResponse(conn.Read(reinterpret_cast<uint8_t *>(transferBuffer), amount));
+				}
+				else
+				{
+					// Send the data straight from the pbufs instead of copying it to transferBuffer first
+					ExchangeResponse(amount);
+					hspi.beginStream();
+					(void)conn.ReadTo(hspi, amount);
+					hspi.endStream();
+				}
+			}
+			else
+			{
+				ExchangeResponse(ResponseBadParameter);
+			}
+			break;
+
+		case NetworkCommand::connReadMulti:				// read data from several connections
+			if (messageHeaderIn.hdr.dataLength != sizeof(ReadMultiRequest))
+			{
+				SendResponse(ResponseBadDataLength);
+			}
+			else if (dataBufferAvailable < sizeof(ReadMultiSummary) + sizeof(ReadMultiRecord))
+			{
+				SendResponse(ResponseBufferTooSmall);
 			}
 			else
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseBadParameter);
+				// We have to commit to the response length before we receive the per-socket limits, so use the most we could possibly send
+				ReadMultiSummary * const summary = reinterpret_cast<ReadMultiSummary*>(transferBuffer);
+				size_t responseLength = sizeof(ReadMultiSummary) + sizeof(ReadMultiRecord);		// allow for the end marker
+				for (size_t i = 0; i < MaxConnections; ++i)
+				{
+					const size_t available = Connection::Get(i).CanRead();
+					summary->bytesAvailable[i] = std::min<size_t>(available, UINT16_MAX);
+					if (available != 0)
+					{
+						responseLength += sizeof(ReadMultiRecord) + NumDwords(available) * sizeof(uint32_t);
+					}
+				}
+				responseLength = std::min<size_t>(responseLength, dataBufferAvailable & ~(sizeof(uint32_t) - 1));
+				ExchangeResponse(responseLength);
+
+				ReadMultiRequest request;
+				TransferData(transferBuffer, reinterpret_cast<uint32_t*>(&request), NumDwords(sizeof(ReadMultiRequest)));
+
+				// Build the records after the summary, so that the whole response is in transferBuffer in case the SAM asks us to send it again
+				uint8_t * const records = reinterpret_cast<uint8_t *>(transferBuffer + NumDwords(sizeof(ReadMultiSummary)));
+				const size_t recordsLength = responseLength - sizeof(ReadMultiSummary);
+				size_t used = 0;
+				for (size_t i = 0; i < MaxConnections && used + sizeof(ReadMultiRecord) < recordsLength; ++i)
+				{
+					if (request.maxLength[i] != 0)
+					{
+						Connection& conn = Connection::Get(i);
+						const size_t room = recordsLength - used - sizeof(ReadMultiRecord);
+						const size_t amount = conn.Read(records + used + sizeof(ReadMultiRecord), std::min<size_t>(request.maxLength[i], room));
+						if (amount != 0)
+						{
+							ReadMultiRecord * const record = reinterpret_cast<ReadMultiRecord*>(records + used);
+							record->socketNumber = i;
+							record->state = conn.GetState();
+							record->length = amount;
+							used += sizeof(ReadMultiRecord) + NumDwords(amount) * sizeof(uint32_t);
+						}
+					}
+				}
+				if (used < recordsLength)
+				{
+					memset(records + used, ReadMultiEndMarker, recordsLength - used);		// end marker followed by padding
+				}
+				StartTransferData(transferBuffer + NumDwords(sizeof(ReadMultiSummary)), nullptr, NumDwords(recordsLength));
+				lastResponseLength = responseLength;
 			}
 			break;
 
 		case NetworkCommand::connWrite:					// write data to a connection
 			if (ValidSocketNumber(messageHeaderIn.hdr.socketNumber))
 			{
+				// Receive the data in the background and write it to the connection when the transfer is complete
 				Connection& conn = Connection::Get(messageHeaderIn.hdr.socketNumber);
 				const size_t requestedlength = messageHeaderIn.hdr.dataLength;
-				const size_t acceptedLength = std::min<size_t>(conn.CanWrite(), std::min<size_t>(requestedlength, MaxDataLength));
-				const bool closeAfterSending = (acceptedLength == requestedlength) && (messageHeaderIn.hdr.flags & MessageHeaderSamToEsp::FlagCloseAfterWrite) != 0;
-				const bool push = (acceptedLength == requestedlength) && (messageHeaderIn.hdr.flags & MessageHeaderSamToEsp::FlagPush) != 0;
-				messageHeaderIn.hdr.param32 = hspi.transfer32(acceptedLength);
-				hspi.transferDwords(nullptr, transferBuffer, NumDwords(acceptedLength));
-				const size_t written = conn.Write(reinterpret_cast<uint8_t *>(transferBuffer), acceptedLength, push, closeAfterSending);
-				if (written != acceptedLength)
-				{
-					lastError = "incomplete write";
-				}
+				Connection::WriteBudget budget;
+				Connection::GetWriteBudget(budget);
+				pendingWriteLength = conn.AcceptWriteLength(std::min<size_t>(requestedlength, negotiatedDataLength), budget);
+				ExchangeResponse(pendingWriteLength);
+				StartTransferData(nullptr, transferBuffer, NumDwords(pendingWriteLength));
+				writePending = true;
 			}
 			else
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseBadParameter);
+				ExchangeResponse(ResponseBadParameter);
+			}
+			break;
+
+		case NetworkCommand::connWriteMulti:			// write data to several connections
+			if (messageHeaderIn.hdr.dataLength < sizeof(WriteMultiRequest))
+			{
+				SendResponse(ResponseBadDataLength);
+			}
+			else
+			{
+				// We send the accepted lengths after we have received the request, so we may need to transfer more data than the SAM is sending
+				const size_t transferLength = std::max<size_t>(NumDwords(messageHeaderIn.hdr.dataLength) * sizeof(uint32_t), sizeof(WriteMultiRequest) + sizeof(WriteMultiResponse));
+				ExchangeResponse(transferLength);
+
+				TransferData(nullptr, reinterpret_cast<uint32_t*>(&pendingWriteMultiRequest), NumDwords(sizeof(WriteMultiRequest)));
+				size_t segmentsLength = 0;
+				for (size_t i = 0; i < MaxConnections; ++i)
+				{
+					segmentsLength += NumDwords(pendingWriteMultiRequest.length[i]) * sizeof(uint32_t);
+				}
+				// transferLength may include the space for the response, so check the segments against what the SAM actually sent
+				const bool requestOk = (sizeof(WriteMultiRequest) + segmentsLength <= NumDwords(messageHeaderIn.hdr.dataLength) * sizeof(uint32_t));
+
+				// The connections share the free memory, so each one is offered what the ones before it didn't take
+				Connection::WriteBudget budget;
+				Connection::GetWriteBudget(budget);
+				for (size_t i = 0; i < MaxConnections; ++i)
+				{
+					pendingWriteMultiResponse.acceptedLength[i] = (requestOk) ? Connection::Get(i).AcceptWriteLength(pendingWriteMultiRequest.length[i], budget) : 0;
+				}
+				const size_t remainingDwords = NumDwords(transferLength - sizeof(WriteMultiRequest));
+				TransferData(reinterpret_cast<const uint32_t*>(&pendingWriteMultiResponse), transferBuffer, NumDwords(sizeof(WriteMultiResponse)));
+
+				// Receive the segment data in the background and write it to the connections when the transfer is complete
+				StartTransferData(nullptr, transferBuffer + NumDwords(sizeof(WriteMultiResponse)), remainingDwords - NumDwords(sizeof(WriteMultiResponse)));
+				if (requestOk)
+				{
+					writePending = true;
+				}
+				else
+				{
+					lastError = "bad connWriteMulti data";
+				}
 			}
 			break;
 
 		case NetworkCommand::connGetStatus:				// get the status of a socket, and summary status for all sockets
 			if (ValidSocketNumber(messageHeaderIn.hdr.socketNumber))
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(sizeof(ConnStatusResponse));
+				// Older SAM firmware doesn't set any flags, so it only gets the basic response
+				const bool extended = (messageHeaderIn.hdr.flags & FlagExtendedStatus) != 0 && dataBufferAvailable >= sizeof(ExtendedConnStatusResponse);
+				ExchangeResponse((extended) ? sizeof(ExtendedConnStatusResponse) : sizeof(ConnStatusResponse));
 				Connection& conn = Connection::Get(messageHeaderIn.hdr.socketNumber);
-				ConnStatusResponse resp;
-				conn.GetStatus(resp);
-				Connection::GetSummarySocketStatus(resp.connectedSockets, resp.otherEndClosedSockets);
-				hspi.transferDwords(reinterpret_cast<const uint32_t *>(&resp), nullptr, NumDwords(sizeof(resp)));
+				ExtendedConnStatusResponse resp;
+				conn.GetStatus(resp.status);
+				Connection::GetSummarySocketStatus(resp.status.connectedSockets, resp.status.otherEndClosedSockets);
+				if (extended)
+				{
+					conn.GetTraffic(resp.traffic);
+				}
+				TransferData(reinterpret_cast<const uint32_t *>(&resp), nullptr, NumDwords((extended) ? sizeof(ExtendedConnStatusResponse) : sizeof(ConnStatusResponse)));
+			}
+			else
+			{
+				ExchangeResponse(ResponseBadParameter);
+			}
+			break;
+
+		case NetworkCommand::connGetAllStatus:				// get the summary status of all sockets
+			if (dataBufferAvailable < sizeof(AllConnStatusResponse))
+			{
+				SendResponse(ResponseBufferTooSmall);
+			}
+			else
+			{
+				AllConnStatusResponse * const resp = reinterpret_cast<AllConnStatusResponse*>(transferBuffer);
+				Connection::GetAllStatus(*resp);
+				SendResponse(sizeof(AllConnStatusResponse));
+			}
+			break;
+
+		case NetworkCommand::networkGetEvents:				// retrieve queued connection events
+			if (dataBufferAvailable < sizeof(EventsResponseHeader))
+			{
+				SendResponse(ResponseBufferTooSmall);
 			}
 			else
 			{
-				messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseBadParameter);
+				SendResponse(EventQueue::Retrieve(reinterpret_cast<uint8_t *>(transferBuffer), dataBufferAvailable));
 			}
 			break;
 
@@ -1019,10 +1970,230 @@ void ICACHE_RAM_ATTR ProcessRequest()
 			break;
 
 		case NetworkCommand::networkSetClockControl:
-			messageHeaderIn.hdr.param32 = hspi.transfer32(ResponseEmpty);
+			ExchangeResponse(ResponseEmpty);
 			deferCommand = true;
 			break;
 
+		case NetworkCommand::networkNegotiateBlockSize:		// exchange maximum data lengths with the SAM
+			if (messageHeaderIn.hdr.dataLength == sizeof(BlockSizeData) && dataBufferAvailable >= sizeof(BlockSizeData))
+			{
+				ExchangeResponse(sizeof(BlockSizeData));
+				BlockSizeData ourData, samData;
+				ourData.maxDataLength = MaxExtendedDataLength;
+				TransferData(reinterpret_cast<const uint32_t*>(&ourData), reinterpret_cast<uint32_t*>(&samData), NumDwords(sizeof(BlockSizeData)));
+				if (ExchangeTrailer())
+				{
+					const size_t samMaxDataLength = samData.maxDataLength & ~(sizeof(uint32_t) - 1);
+					SetDataLength(std::max<size_t>(std::min<size_t>(samMaxDataLength, MaxExtendedDataLength), MaxDataLength));
+				}
+			}
+			else
+			{
+				SendResponse(ResponseBadDataLength);
+			}
+			break;
+
+		case NetworkCommand::networkGetCapabilities:		// report what we support
+			if (dataBufferAvailable < sizeof(CapabilitiesResponse))
+			{
+				SendResponse(ResponseBufferTooSmall);
+			}
+			else
+			{
+				CapabilitiesResponse * const response = reinterpret_cast<CapabilitiesResponse*>(transferBuffer);
+				response->features = FeatureReadMulti | FeatureWriteMulti | FeatureNegotiableBlockSize | FeatureAllConnStatus | FeatureEventQueue
+									| FeatureCrcFraming | FeatureClockCalibration | FeatureStatistics | FeatureBinaryDiagnostics
+									| FeatureTrafficCounters | FeatureNetworkScan | FeatureFastReconnect | FeatureFastBoot;
+				if (hspi.isPipelined())
+				{
+					response->features |= FeaturePipelinedSpi;
+				}
+				response->maxDataLength = MaxExtendedDataLength;
+				response->negotiatedDataLength = negotiatedDataLength;
+				response->numSockets = MaxConnections;
+				response->maxBatchSockets = MaxConnections;
+				response->formatVersion = MyFormatVersion;
+				response->zero = 0;
+				response->clockReg = SPI1CLK;
+				response->defaultClockReg = defaultClockControl;
+				response->transferReadyTimeout = TransferReadyTimeout;
+				response->statusReportInterval = StatusReportMillis;
+				response->maxConnectTime = MaxConnectTime;
+				SendResponse(sizeof(CapabilitiesResponse));
+			}
+			break;
+
+		case NetworkCommand::networkRetransmit:				// send the data returned by the last command again
+			if (lastResponseLength < 0)
+			{
+				SendResponse(ResponseWrongState);
+			}
+			else if ((size_t)lastResponseLength > dataBufferAvailable)
+			{
+				SendResponse(ResponseBufferTooSmall);
+			}
+			else
+			{
+				SendResponse(lastResponseLength);
+			}
+			break;
+
+		case NetworkCommand::networkCalibrateClock:			// test the candidate SPI clock speeds, or select one when the SAM reports its errors
+			if ((messageHeaderIn.hdr.flags & FlagCalibrationReport) != 0)
+			{
+				if (messageHeaderIn.hdr.dataLength != sizeof(ClockCalibrationReport))
+				{
+					SendResponse(ResponseBadDataLength);
+				}
+				else if (dataBufferAvailable < sizeof(ClockCalibrationReport) + sizeof(ClockCalibrationResults))
+				{
+					SendResponse(ResponseBufferTooSmall);
+				}
+				else if (calibration.numRuns == 0)
+				{
+					SendResponse(ResponseWrongState);
+				}
+				else
+				{
+					// As for connWriteMulti, we send the results after we have received the report
+					ExchangeResponse(sizeof(ClockCalibrationReport) + sizeof(ClockCalibrationResults));
+					ClockCalibrationReport report;
+					TransferData(nullptr, reinterpret_cast<uint32_t*>(&report), NumDwords(sizeof(report)));
+					for (size_t candidate = 0; candidate < NumClockCandidates; ++candidate)
+					{
+						calibration.entries[candidate].samBitErrors = report.samBitErrors[candidate];
+					}
+					calibration.selected = SelectClockCandidate(calibrationFramed && framed);
+					memcpy(transferBuffer, &calibration, sizeof(calibration));
+					StartTransferData(transferBuffer, nullptr, NumDwords(sizeof(calibration)));
+					deferCommand = true;						// switch speed when the transaction has finished
+				}
+			}
+			else
+			{
+				const size_t patternLength = messageHeaderIn.hdr.dataLength/MaxClockCandidates;
+				if (patternLength == 0 || messageHeaderIn.hdr.dataLength != MaxClockCandidates * patternLength || patternLength % CalibrationPatternLength != 0)
+				{
+					SendResponse(ResponseBadDataLength);
+				}
+				else if (dataBufferAvailable < NumClockCandidates * patternLength + sizeof(ClockCalibrationResults))
+				{
+					SendResponse(ResponseBufferTooSmall);
+				}
+				else
+				{
+					ExchangeResponse(NumClockCandidates * patternLength + sizeof(ClockCalibrationResults));
+					CalibrateClock(patternLength);
+				}
+			}
+			break;
+
+		case NetworkCommand::networkGetStatistics:			// get the per-command timing statistics
+			{
+				const size_t length = Statistics::Retrieve(reinterpret_cast<uint8_t *>(transferBuffer), dataBufferAvailable, messageHeaderIn.hdr.socketNumber, SPI1CLK);
+				if (length == 0)
+				{
+					SendResponse(ResponseBufferTooSmall);
+				}
+				else
+				{
+					if ((messageHeaderIn.hdr.flags & FlagResetStatistics) != 0)
+					{
+						Statistics::Reset();
+					}
+					SendResponse(length);
+				}
+			}
+			break;
+
+		case NetworkCommand::networkGetDiagnostics:			// get diagnostics in binary form
+			if (dataBufferAvailable < sizeof(DiagnosticsResponse))
+			{
+				SendResponse(ResponseBufferTooSmall);
+			}
+			else
+			{
+				GetDiagnostics(*reinterpret_cast<DiagnosticsResponse*>(transferBuffer));
+				SendResponse(sizeof(DiagnosticsResponse));
+			}
+			break;
+
+		case NetworkCommand::networkScan:					// get the results of the last network scan, optionally starting a new one
+			if (scanInProgress)
+			{
+				SendResponse(ResponseBusy);
+			}
+			else if ((messageHeaderIn.hdr.flags & FlagStartScan) != 0)
+			{
+				if (currentState == WiFiState::idle || currentState == WiFiState::connected)
+				{
+					deferCommand = true;
+					SendResponse(ResponseEmpty);
+				}
+				else
+				{
+					SendResponse(ResponseWrongState);
+				}
+			}
+			else
+			{
+				const size_t length = sizeof(WiFiScanResponse) - (MaxScanResults - scanResults.numNetworks) * sizeof(WiFiScanEntry);
+				if (dataBufferAvailable < length)
+				{
+					SendResponse(ResponseBufferTooSmall);
+				}
+				else
+				{
+					scanResults.ageMillis = millis() - scanCompletedTime;
+					memcpy(transferBuffer, &scanResults, length);
+					SendResponse(length);
+				}
+			}
+			break;
+
+		case NetworkCommand::networkGetConnectLog:			// get the timings of recent connection attempts
+			{
+				const size_t numRecords = std::min<size_t>(totalConnectAttempts, MaxConnectAttemptRecords);
+				const size_t length = sizeof(ConnectLogResponse) - (MaxConnectAttemptRecords - numRecords) * sizeof(ConnectAttemptRecord);
+				if (dataBufferAvailable < length)
+				{
+					SendResponse(ResponseBufferTooSmall);
+				}
+				else
+				{
+					ConnectLogResponse * const response = reinterpret_cast<ConnectLogResponse*>(transferBuffer);
+					response->totalAttempts = totalConnectAttempts;
+					response->numRecords = (uint8_t)numRecords;
+					memset(response->zero, 0, sizeof(response->zero));
+					for (size_t i = 0; i < numRecords; ++i)
+					{
+						response->records[i] = connectLog[(totalConnectAttempts - numRecords + i) % MaxConnectAttemptRecords];
+					}
+					SendResponse(length);
+				}
+			}
+			break;
+
+		case NetworkCommand::networkSetFastBoot:			// enable or disable fast boot
+			SaveBootSettings((messageHeaderIn.hdr.flags & FlagFastBoot) != 0);
+			SendResponse(ResponseEmpty);
+			break;
+
+		case NetworkCommand::networkGetBootTimes:			// get the startup timings
+			if (dataBufferAvailable < sizeof(BootTimesResponse))
+			{
+				SendResponse(ResponseBufferTooSmall);
+			}
+			else
+			{
+				const BootSettings * const bp = GetBootSettings();
+				bootTimes.fastBoot = (bp != nullptr && bp->fastBoot != 0) ? 1 : 0;
+				bootTimes.leaseReused = (leaseReused) ? 1 : 0;
+				memcpy(transferBuffer, &bootTimes, sizeof(BootTimesResponse));
+				SendResponse(sizeof(BootTimesResponse));
+			}
+			break;
+
 		case NetworkCommand::connCreate:					// create a connection
 			// Not implemented yet
 		default:
@@ -1031,17 +2202,70 @@ void ICACHE_RAM_ATTR ProcessRequest()
 		}
 	}
 
+	// If the data phase is still running in the background then loop() will finish the transaction when it has completed
+	if (!hspi.isTransferring())
+	{
+		FinishRequest();
+	}
+}
+
+// This is called when the data phase of a transaction has completed
+void FinishRequest()
+{
+	// If the transaction is framed, we mustn't act on what the SAM sent us unless its CRC was correct
+	const bool samDataOk = ExchangeTrailer();
+
 	digitalWrite(SamSSPin, HIGH);     						// de-assert CS to SAM to end the transaction and tell SAM the transfer is complete
 	hspi.endTransaction();
+	transactionInProgress = false;
+
+	// If we received data to be written, pass it to the connections now
+	if (writePending)
+	{
+		writePending = false;
+		if (samDataOk)										// if the CRC was wrong then the SAM will send the data again
+		{
+			if (messageHeaderIn.hdr.command == NetworkCommand::connWriteMulti)
+			{
+				CompleteConnWriteMulti();
+			}
+			else
+			{
+				CompleteConnWrite();
+			}
+		}
+	}
 
 	// If we deferred the command until after sending the response (e.g. because it may take some time to execute), complete it now
-	if (deferCommand)
+	if (deferCommand && samDataOk)
 	{
 		// The following functions must set up lastError if an error occurs
 		lastError = nullptr;								// assume no error
 		switch (messageHeaderIn.hdr.command)
 		{
 		case NetworkCommand::networkStartClient:			// connect to an access point
+			if (fastBootConnect)
+			{
+				// We started to connect when we started up. If that attempt is still going and the SAM wants the same network or doesn't mind which,
+				// carry on with that connection. If it has already failed then we are idle again, so connect normally.
+				fastBootConnect = false;
+				if (   currentState != WiFiState::idle
+					&& (   messageHeaderIn.hdr.dataLength == 0
+						|| reinterpret_cast<const char*>(transferBuffer)[0] == 0
+						|| strncmp(reinterpret_cast<const char*>(transferBuffer), currentSsid, SsidLength) == 0
+					   )
+				   )
+				{
+					break;
+				}
+				if (currentState != WiFiState::idle)
+				{
+					WiFi.disconnect(true);
+					delay(20);
+					currentState = WiFiState::idle;
+					leaseReused = false;
+				}
+			}
 			if (messageHeaderIn.hdr.dataLength == 0 || reinterpret_cast<const char*>(transferBuffer)[0] == 0)
 			{
 				StartClient(nullptr);						// connect to strongest known access point
@@ -1056,10 +2280,18 @@ void ICACHE_RAM_ATTR ProcessRequest()
 			StartAccessPoint();
 			break;
 
+		case NetworkCommand::networkScan:					// start a network scan
+			StartScan();
+			break;
+
 		case NetworkCommand::networkStop:					// disconnect from an access point, or close down our own access point
 			Connection::TerminateAll();						// terminate all connections
 			Listener::StopListening(0);						// stop listening on all ports
+			EventQueue::Clear();							// the SAM isn't interested in events for connections that no longer exist
 			RebuildServices();								// remove the MDNS services
+			connectAfterScan = false;						// if we are still scanning for a network to connect to, don't connect when the scan completes
+			fastBootConnect = false;
+			leaseReused = false;
 			switch (currentState)
 			{
 			case WiFiState::connected:
@@ -1103,11 +2335,25 @@ void ICACHE_RAM_ATTR ProcessRequest()
 			hspi.setClockDivider(messageHeaderIn.hdr.param32);
 			break;
 
+		case NetworkCommand::networkCalibrateClock:
+			if (calibration.selected < NumClockCandidates)
+			{
+				hspi.setClockDivider(calibration.entries[calibration.selected].clockReg);
+			}
+			else
+			{
+				lastError = "no SPI clock speed passed calibration";
+			}
+			calibration.numRuns = 0;						// the next test run starts a new calibration
+			break;
+
 		default:
 			lastError = "bad deferred command";
 			break;
 		}
 	}
+
+	Statistics::EndTransaction(messageHeaderIn.hdr.command, headerValid, hspi);
 }
 
 void ICACHE_RAM_ATTR TransferReadyIsr()
@@ -1117,6 +2363,8 @@ void ICACHE_RAM_ATTR TransferReadyIsr()
 
 void setup()
 {
+	bootTimes.setupStartMillis = millis();
+
 	// Enable serial port for debugging
 	Serial.begin(WiFiBaudRate);
 	Serial.setDebugOutput(true);
@@ -1130,16 +2378,41 @@ void setup()
 
 	// If we started abnormally, send the exception details to the serial port
 	const rst_info *resetInfo = system_get_rst_info();
+	bootTimes.resetReason = resetInfo->reason;
 	if (resetInfo->reason != 0 && resetInfo->reason != 6)	// if not power up or external reset
 	{
 		debugPrintfAlways("Restart after exception:%d flag:%d epc1:0x%08x epc2:0x%08x epc3:0x%08x excvaddr:0x%08x depc:0x%08x\n",
 			resetInfo->exccause, resetInfo->reason, resetInfo->epc1, resetInfo->epc2, resetInfo->epc3, resetInfo->excvaddr, resetInfo->depc);
 	}
 
-	// Reserve some flash space for use as EEPROM. The maximum EEPROM supported by the core is SPI_FLASH_SEC_SIZE (4Kb).
-	const size_t eepromSizeNeeded = (MaxRememberedNetworks + 1) * sizeof(WirelessConfigurationData);
-	static_assert(eepromSizeNeeded <= SPI_FLASH_SEC_SIZE, "Insufficient EEPROM");
-	EEPROM.begin(eepromSizeNeeded);
+	// Load the remembered networks and other settings. The first time we run, they are migrated from EEPROM.
+	// A snapshot of them and its headers must fit in one flash sector.
+	const size_t settingsSize = (MaxRememberedNetworks + 1) * (sizeof(WirelessConfigurationData) + sizeof(FastConnectData)) + sizeof(BootSettings);
+	static_assert(settingsSize + 64 <= SPI_FLASH_SEC_SIZE, "Settings too large");
+	Crc32::Init();
+	CredentialStore::Init(settingsSize);
+	BuildSsidIndex();
+
+	stationConnectedHandler = WiFi.onStationModeConnected(OnStationConnected);
+	stationGotIpHandler = WiFi.onStationModeGotIP(OnStationGotIp);
+
+	// In fast boot mode, start connecting to the network we used last time before we do anything else, so that the SDK can associate with
+	// the access point while we initialise. After a reset other than a power up, reuse the DHCP lease we had if it hasn't nearly expired.
+	const BootSettings * const bootSettings = GetBootSettings();
+	if (bootSettings != nullptr && bootSettings->fastBoot != 0 && bootSettings->lastNetwork != 0 && bootSettings->lastNetwork <= MaxRememberedNetworks)
+	{
+		memcpy(webHostName, bootSettings->hostName, HostNameLength);
+		webHostName[HostNameLength] = 0;				// ensure null terminator
+		const WirelessConfigurationData *wp = CredentialStore::GetPtr<WirelessConfigurationData>(bootSettings->lastNetwork * sizeof(WirelessConfigurationData));
+		if (wp != nullptr && wp->ssid[0] != 0 && (uint8_t)wp->ssid[0] != 0xFF)
+		{
+			ssidData = wp;
+			leaseReused = resetInfo->reason != 0 && LoadLease(bootSettings->lastNetwork);	// if not power up
+			ConnectToAccessPoint(*ssidData, false);
+			fastBootConnect = true;
+			bootTimes.fastBootConnect = 1;
+		}
+	}
 
 	// Set up the SPI subsystem
     pinMode(SamTfrReadyPin, INPUT);
@@ -1150,6 +2423,7 @@ void setup()
 
     // Set up the fast SPI channel
     hspi.InitMaster(SPI_MODE1, defaultClockControl, true);
+    hspi.setPipelined(defaultPipelinedSpi);
 
     Connection::Init();
     Listener::Init();
@@ -1169,6 +2443,7 @@ void setup()
 	whenLastTransactionFinished = millis();
 	lastStatusReportTime = millis();
 	digitalWrite(EspReqTransferPin, HIGH);				// tell the SAM we are ready to receive a command
+	bootTimes.spiReadyMillis = millis();
 }
 
 void loop()
@@ -1176,8 +2451,24 @@ void loop()
 	digitalWrite(EspReqTransferPin, HIGH);				// tell the SAM we are ready to receive a command
 	system_soft_wdt_feed();								// kick the watchdog
 
-	if (   (lastError != prevLastError || connectErrorChanged || currentState != prevCurrentState)
-		|| ((lastError != nullptr || currentState != lastReportedState) && millis() - lastStatusReportTime > StatusReportMillis)
+	// Keep track of how long the loop takes, for the diagnostics
+	const uint32_t loopStartMicros = micros();
+	if (lastLoopStartMicros != 0)
+	{
+		const uint32_t loopMicros = loopStartMicros - lastLoopStartMicros;
+		maxLoopMicros = std::max<uint32_t>(maxLoopMicros, loopMicros);
+		totalLoopMicros += loopMicros;
+		++loopCount;
+	}
+	lastLoopStartMicros = loopStartMicros;
+
+	// New connection events are signalled no more often than every MinEventSignalMillis, so that a busy connection doesn't keep interrupting the SAM.
+	// If the SAM misses a pulse, it collects the events the next time it polls or another event is signalled.
+	if (   !transactionInProgress
+		&& (   (lastError != prevLastError || connectErrorChanged || currentState != prevCurrentState)
+			|| (EventQueue::HasNewEvents() && millis() - lastEventSignalTime >= MinEventSignalMillis)
+			|| ((lastError != nullptr || currentState != lastReportedState) && millis() - lastStatusReportTime > StatusReportMillis)
+		   )
 	   )
 	{
 		delayMicroseconds(2);							// make sure the pin stays high for long enough for the SAM to see it
@@ -1187,20 +2478,40 @@ void loop()
 		prevLastError = lastError;
 		prevCurrentState = currentState;
 		connectErrorChanged = false;
-		lastStatusReportTime = millis();
+		EventQueue::ClearNewEvents();
+		lastStatusReportTime = lastEventSignalTime = millis();
 	}
 
 	// See whether there is a request from the SAM.
 	// Duet WiFi 1.04 and earlier have hardware to ensure that TransferReady goes low when a transaction starts.
 	// Duet 3 Mini doesn't, so we need to see TransferReady go low and then high again. In case that happens so fast that we dn't get the interrupt, we have a timeout.
-	if (digitalRead(SamTfrReadyPin) == HIGH && (transferReadyChanged || millis() - whenLastTransactionFinished > TransferReadyTimeout))
+	// While the data phase of a transaction runs in the background we carry on polling connections and the network.
+	if (transactionInProgress)
+	{
+		if (!hspi.isTransferring())
+		{
+			FinishRequest();
+			whenLastTransactionFinished = millis();
+		}
+	}
+	else if (digitalRead(SamTfrReadyPin) == HIGH && (transferReadyChanged || millis() - whenLastTransactionFinished > TransferReadyTimeout))
 	{
 		transferReadyChanged = false;
 		ProcessRequest();
-		whenLastTransactionFinished = millis();
+		if (!transactionInProgress)
+		{
+			whenLastTransactionFinished = millis();
+		}
+	}
+
+	if (settingsCommitPending && !hspi.isTransferring())
+	{
+		CommitSettings();
 	}
 
+	ScanPoll();
 	ConnectPoll();
+	UpdateLease();
 	Connection::PollOne();
 
 	if (currentState == WiFiState::runningAsAccessPoint)
@@ -0,0 +1,113 @@
+/*
+ * SsidIndex.cpp
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#include "SsidIndex.h"
+#include <cstring>
+
+static_assert(MaxRememberedNetworks < 32, "freeSlots bitmap too small");
+static_assert(MaxRememberedNetworks < 256, "bucket type too small");
+
+// Mark all slots as free. Slot 0 holds our own access point details, so it is never free.
+/*static*/ void SsidIndex::Init()
+{
+	freeSlots = ((1u << (MaxRememberedNetworks + 1)) - 1) & ~1u;
+	memset(buckets, 0, sizeof(buckets));
+}
+
+// Record that a slot now holds the specified SSID
+/*static*/ void SsidIndex::Set(size_t slot, const char *ssid)
+{
+	if (slot != 0 && slot <= MaxRememberedNetworks)
+	{
+		const bool wasFree = (freeSlots & (1u << slot)) != 0;
+		slotHashes[slot] = Hash(ssid);
+		freeSlots &= ~(1u << slot);
+		if (wasFree)
+		{
+			Insert(slot);
+		}
+		else
+		{
+			Rebuild();						// the hash may have changed, so the slot may need to move
+		}
+	}
+}
+
+// Record that a slot is now free
+/*static*/ void SsidIndex::Clear(size_t slot)
+{
+	if (slot != 0 && slot <= MaxRememberedNetworks && (freeSlots & (1u << slot)) == 0)
+	{
+		freeSlots |= 1u << slot;
+		Rebuild();							// removing an entry from an open addressing table may break the probe sequence of others, so rebuild it
+	}
+}
+
+// Return the slot that may hold the specified SSID, or -1 if it is definitely not in the table.
+// Different SSIDs may have the same hash, so the caller must check that the slot really does hold the SSID.
+/*static*/ int SsidIndex::Find(const char *ssid)
+{
+	const uint32_t hash = Hash(ssid);
+	for (size_t i = 0; i < NumBuckets; ++i)
+	{
+		const uint8_t slot = buckets[(hash + i) & (NumBuckets - 1)];
+		if (slot == 0)
+		{
+			break;
+		}
+		if (slotHashes[slot] == hash)
+		{
+			return slot;
+		}
+	}
+	return -1;
+}
+
+// Return a free slot, or -1 if the table is full
+/*static*/ int SsidIndex::FindFree()
+{
+	return (freeSlots == 0) ? -1 : __builtin_ctz(freeSlots);
+}
+
+// FNV-1a hash of a SSID, which is not null terminated if it is SsidLength characters long
+/*static*/ uint32_t SsidIndex::Hash(const char *ssid)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < SsidLength && ssid[i] != 0; ++i)
+	{
+		hash = (hash ^ (uint8_t)ssid[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/*static*/ void SsidIndex::Insert(size_t slot)
+{
+	size_t bucket = slotHashes[slot] & (NumBuckets - 1);
+	while (buckets[bucket] != 0)
+	{
+		bucket = (bucket + 1) & (NumBuckets - 1);
+	}
+	buckets[bucket] = (uint8_t)slot;
+}
+
+/*static*/ void SsidIndex::Rebuild()
+{
+	memset(buckets, 0, sizeof(buckets));
+	for (size_t slot = 1; slot <= MaxRememberedNetworks; ++slot)
+	{
+		if ((freeSlots & (1u << slot)) == 0)
+		{
+			Insert(slot);
+		}
+	}
+}
+
+// Static data
+uint32_t SsidIndex::slotHashes[MaxRememberedNetworks + 1];
+uint32_t SsidIndex::freeSlots = 0;
+uint8_t SsidIndex::buckets[NumBuckets];
+
+// End
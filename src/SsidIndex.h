@@ -0,0 +1,37 @@
+/*
+ * SsidIndex.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * In-RAM index of the remembered SSID table, so that we can find a network or a free entry without reading every entry
+ */
+
+#ifndef SRC_SSIDINDEX_H_
+#define SRC_SSIDINDEX_H_
+
+#include <cstdint>
+#include <cstddef>
+#include "include/MessageFormats.h"
+
+class SsidIndex
+{
+public:
+	static void Init();
+	static void Set(size_t slot, const char *ssid);
+	static void Clear(size_t slot);
+	static int Find(const char *ssid);
+	static int FindFree();
+
+private:
+	static uint32_t Hash(const char *ssid);
+	static void Insert(size_t slot);
+	static void Rebuild();
+
+	static const size_t NumBuckets = 32;						// must be a power of 2 and more than MaxRememberedNetworks
+
+	static uint32_t slotHashes[MaxRememberedNetworks + 1];		// the hash of the SSID in each slot of the table, slot 0 is not used
+	static uint32_t freeSlots;									// bitmap of the slots that are free
+	static uint8_t buckets[NumBuckets];							// open addressing hash table of slot numbers, 0 means empty
+};
+
+#endif /* SRC_SSIDINDEX_H_ */
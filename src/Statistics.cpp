@@ -0,0 +1,81 @@
+/*
+ * Statistics.cpp
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#include "Statistics.h"
+#include "HSPI.h"
+#include <algorithm>			// for std::min
+
+// Record the state of the counters at the start of a transaction
+/*static*/ void Statistics::BeginTransaction(const HSPIClass& hspi)
+{
+	startCycles = ESP.getCycleCount();
+	startSpiCycles = hspi.getBusyCycles();
+	startBytesSent = hspi.getBytesSent();
+	startBytesReceived = hspi.getBytesReceived();
+}
+
+// Add the transaction that has just finished to the statistics for its command
+/*static*/ void Statistics::EndTransaction(NetworkCommand command, bool validHeader, const HSPIClass& hspi)
+{
+	const uint32_t cycles = ESP.getCycleCount() - startCycles;
+	const size_t slot = (validHeader) ? std::min<size_t>((size_t)command, NumCommandSlots - 1) : NumCommandSlots - 1;
+	CommandStatistics& st = commands[slot];
+
+	++st.count;
+	st.totalCycles += cycles;
+	st.spiCycles += hspi.getBusyCycles() - startSpiCycles;
+	st.maxCycles = std::max<uint32_t>(st.maxCycles, cycles);
+	st.bytesIn += hspi.getBytesReceived() - startBytesReceived;
+	st.bytesOut += hspi.getBytesSent() - startBytesSent;
+
+	const unsigned int log2Cycles = (cycles == 0) ? 0 : 31 - __builtin_clz(cycles);
+	const size_t bucket = (log2Cycles <= FirstLatencyBucketLog2) ? 0 : std::min<size_t>(log2Cycles - FirstLatencyBucketLog2, NumLatencyBuckets - 1);
+	if (st.latency[bucket] != UINT16_MAX)
+	{
+		++st.latency[bucket];
+	}
+}
+
+// Copy the statistics header and as many command records starting at firstCommand as will fit to the buffer, returning the number of bytes used.
+// Return 0 if there isn't room for at least one record.
+/*static*/ size_t Statistics::Retrieve(uint8_t *buffer, size_t bufferLength, size_t firstCommand, uint32_t clockReg)
+{
+	if (bufferLength < sizeof(StatisticsHeader) + sizeof(CommandStatistics))
+	{
+		return 0;
+	}
+
+	StatisticsHeader * const hdr = reinterpret_cast<StatisticsHeader *>(buffer);
+	const size_t first = std::min<size_t>(firstCommand, NumCommandSlots);
+	const size_t num = std::min<size_t>((bufferLength - sizeof(StatisticsHeader))/sizeof(CommandStatistics), NumCommandSlots - first);
+	hdr->sinceResetMillis = millis() - whenReset;
+	hdr->clockReg = clockReg;
+	hdr->cpuFreqMHz = ESP.getCpuFreqMHz();
+	hdr->firstCommand = first;
+	hdr->numCommands = num;
+	hdr->totalCommands = NumCommandSlots;
+	hdr->numBuckets = NumLatencyBuckets;
+	hdr->firstBucketLog2 = FirstLatencyBucketLog2;
+	hdr->zero = 0;
+	memcpy(buffer + sizeof(StatisticsHeader), &commands[first], num * sizeof(CommandStatistics));
+	return sizeof(StatisticsHeader) + num * sizeof(CommandStatistics);
+}
+
+/*static*/ void Statistics::Reset()
+{
+	memset(commands, 0, sizeof(commands));
+	whenReset = millis();
+}
+
+// Static data
+CommandStatistics Statistics::commands[NumCommandSlots];
+uint32_t Statistics::whenReset = 0;
+uint32_t Statistics::startCycles = 0;
+uint32_t Statistics::startSpiCycles = 0;
+uint32_t Statistics::startBytesSent = 0;
+uint32_t Statistics::startBytesReceived = 0;
+
+// End
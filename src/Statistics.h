@@ -0,0 +1,37 @@
+/*
+ * Statistics.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Per-command timing and throughput statistics for SPI transactions
+ */
+
+#ifndef SRC_STATISTICS_H_
+#define SRC_STATISTICS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include "include/MessageFormats.h"			// for CommandStatistics
+
+class HSPIClass;
+
+class Statistics
+{
+public:
+	static void BeginTransaction(const HSPIClass& hspi);
+	static void EndTransaction(NetworkCommand command, bool validHeader, const HSPIClass& hspi);
+	static size_t Retrieve(uint8_t *buffer, size_t bufferLength, size_t firstCommand, uint32_t clockReg);
+	static void Reset();
+
+private:
+	static const size_t NumCommandSlots = 40;		// the last slot is also used for higher command numbers and for bad headers
+
+	static CommandStatistics commands[NumCommandSlots];
+	static uint32_t whenReset;
+	static uint32_t startCycles;					// the cycle counter and HSPI counters when the current transaction started
+	static uint32_t startSpiCycles;
+	static uint32_t startBytesSent;
+	static uint32_t startBytesReceived;
+};
+
+#endif /* SRC_STATISTICS_H_ */
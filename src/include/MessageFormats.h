@@ -13,18 +13,33 @@
 // The SAM and the ESP first exchange headers. Then the ESP looks at the header, decodes the command from the SAM, and exchanges a response dword.
 // If the ESP accepted the command, it then does an appropriate data transfer.
 // The SAM uses DMA to transfer the whole message, so it can only transfer the entire message.
+//
+// If the SAM sends MyFramedFormatVersion instead of MyFormatVersion, the transaction is framed and protected by CRC-32 (see Crc32.h):
+//  1. The headers are exchanged as usual, except for the last dword.
+//  2. Each side sends the CRC of the header dwords it has just sent. If the SAM's header CRC is wrong, the ESP responds with ResponseBadCrc.
+//  3. The response dword and param32 are exchanged, followed by the data phase, as usual.
+//  4. Each side sends the CRC of the data it sent since step 2, i.e. the ESP's CRC covers the response dword and the data that the response
+//     told the SAM to expect, and the SAM's CRC covers param32 and all the data it clocked out. Each CRC covers whole dwords.
+//  5. The ESP sends ResponseEmpty if the SAM's CRC was correct, or ResponseBadCrc if not. The SAM sends a dummy dword.
+// The ESP doesn't act on param32 or data sent by the SAM until it has verified the SAM's CRC, so the SAM can safely repeat such a command if the ESP reports ResponseBadCrc.
+// The exception is the ReadMultiRequest of a connReadMulti command, which the ESP must use before the trailer. So the SAM should treat a record longer than it asked for as a CRC error.
+// If the ESP's CRC is wrong and the command returned data that can't be requested again (e.g. connRead), the SAM sends networkRetransmit.
 
 // First the message header formats
 const size_t SsidLength = 32;
 const size_t PasswordLength = 64;
 const size_t HostNameLength = 64;
 const size_t MaxDataLength = 2048;						// maximum length of the data part of an SPI exchange
+const size_t MaxExtendedDataLength = 8192;				// maximum length of the data part of an SPI exchange after a networkNegotiateBlockSize command
 const size_t MaxConnections = 8;						// the number of simultaneous connections we support
 const unsigned int NumWiFiTcpSockets = MaxConnections;	// the number of concurrent TCP/IP connections supported
 
 static_assert(MaxDataLength % sizeof(uint32_t) == 0, "MaxDataLength must be a whole number of dwords");
+static_assert(MaxExtendedDataLength % sizeof(uint32_t) == 0, "MaxExtendedDataLength must be a whole number of dwords");
+static_assert(MaxExtendedDataLength >= MaxDataLength && MaxExtendedDataLength <= 0xFFFF, "MaxExtendedDataLength out of range");
 
 const uint8_t MyFormatVersion = 0x3E;
+const uint8_t MyFramedFormatVersion = 0xA1;				// differs from MyFormatVersion in 6 bits, so corruption is unlikely to turn one into the other
 const uint8_t InvalidFormatVersion = 0xC9;				// must be different from any format version we have ever used
 
 const uint32_t AnyIp = 0;
@@ -66,7 +81,23 @@ enum class NetworkCommand : uint8_t
 
 	// Added at version 1.24
 	networkSetTxPower,			// set transmitter power in units of 0.25db, max 82 = 20.5db
-	networkSetClockControl		// set clock control word - only provided because the ESP8266 documentation is not only crap but seriously wrong
+	networkSetClockControl,		// set clock control word - only provided because the ESP8266 documentation is not only crap but seriously wrong
+
+	// Added at version 1.27
+	connReadMulti,				// read data from several connections in one transaction
+	connWriteMulti,				// write data to several connections in one transaction
+	networkNegotiateBlockSize,	// exchange the maximum data lengths that the SAM and the ESP support
+	networkGetCapabilities,		// get the features, limits and timing that this ESP firmware supports
+	connGetAllStatus,			// get a summary of the status of all sockets
+	networkGetEvents,			// retrieve queued connection events
+	networkRetransmit,			// send the data returned by the previous command again
+	networkCalibrateClock,		// exchange test patterns at each candidate SPI clock speed, or report the SAM's errors and select a speed with some margin
+	networkGetStatistics,		// get the per-command timing statistics, optionally resetting them
+	networkGetDiagnostics,		// get connection, memory and timing diagnostics in binary form
+	networkScan,				// get the results of the last network scan, optionally starting a new one
+	networkGetConnectLog,		// get the timings of recent attempts to connect to an access point
+	networkSetFastBoot,			// enable or disable connecting to the last network as soon as the ESP starts
+	networkGetBootTimes			// get the times at which the ESP reached each stage of starting up
 };
 
 // Message header sent from the SAM to the ESP
@@ -103,6 +134,135 @@ const uint8_t protocolFTP = 1;
 const uint8_t protocolTelnet = 2;
 const uint8_t protocolFtpData = 3;
 
+// Message data exchanged for a networkNegotiateBlockSize command. The SAM and the ESP each send their own maximum data length.
+// Both then use the smaller of the two values, or MaxDataLength if that is larger, as the maximum data length for all subsequent transactions.
+struct BlockSizeData
+{
+	uint32_t maxDataLength;
+};
+
+// Data exchanged for a networkCalibrateClock command. Calibration takes one or more test runs followed by a report.
+// In a test run (no flags) the SAM sends MaxClockCandidates copies of the test pattern, each patternLength bytes long, so dataLength is MaxClockCandidates * patternLength.
+// patternLength may be any multiple of CalibrationPatternLength that keeps dataLength within the negotiated data length, so a SAM that has negotiated
+// a longer block size can test with longer bursts. The ESP exchanges one copy of the pattern at each of its candidate clock speeds, fastest first, sending
+// the same pattern back, then restores the original speed and sends a ClockCalibrationResults. So the data the SAM receives is the pattern repeated
+// numCandidates times followed by the results, and the response is the total length. The test patterns are not included in the CRCs of a framed transaction.
+// The ESP adds up the bit errors it received at each candidate over all the test runs, and the SAM should do the same with what it received.
+// In the report (FlagCalibrationReport) the SAM sends a ClockCalibrationReport and the ESP returns the final ClockCalibrationResults. As for connWriteMulti,
+// the ESP sends the results after it has received the report, so they start at offset sizeof(ClockCalibrationReport) and the response is the total length.
+// The ESP selects the candidate one step slower than the fastest one at which neither side saw an error in any run, provided that it too was clean,
+// so that there is some margin. Candidates faster than defaultClockControl are only considered if all the test runs and the report were framed.
+// After the report the ESP switches to the selected candidate, or stays at the previous speed if none qualified, and starts counting again.
+const size_t MaxClockCandidates = 8;
+const size_t CalibrationPatternLength = 256;
+const uint8_t FlagCalibrationReport = 0x01;
+
+struct ClockCalibrationEntry
+{
+	uint32_t clockReg;					// the value of the SPI clock register
+	uint32_t bitErrors;					// the number of bits that the ESP received incorrectly
+	uint32_t samBitErrors;				// the number of bits that the SAM received incorrectly, from its report
+};
+
+struct ClockCalibrationResults
+{
+	uint8_t numCandidates;				// the number of candidate clock speeds tested
+	uint8_t selected;					// the index of the candidate selected, or 0xFF if none of them qualified. Provisional until the SAM reports.
+	uint16_t numRuns;					// the number of test runs that the error counts cover
+	uint32_t previousClockReg;			// the clock register that was in use before the calibration, which remains in use if no candidate qualified
+	ClockCalibrationEntry entries[MaxClockCandidates];
+};
+
+struct ClockCalibrationReport
+{
+	uint32_t samBitErrors[MaxClockCandidates];	// the number of bits that the SAM received incorrectly at each candidate, over all the test runs
+};
+
+// Return dword 'index' of the clock calibration test pattern. This includes walking ones and zeros, alternating bits and pseudo-random data.
+static inline uint32_t CalibrationPatternDword(size_t index)
+{
+	switch (index & 3)
+	{
+	case 0:		return 1u << ((index >> 2) & 31);
+	case 1:		return 0xAAAAAAAA;
+	case 2:		return ~(1u << ((index >> 2) & 31));
+	default:	return index * 0x9E3779B9;
+	}
+}
+
+// Data returned for a networkGetStatistics command. The socketNumber field of the request is the index of the first command to report,
+// and the ESP returns as many CommandStatistics records as will fit in the SAM's buffer. If the FlagResetStatistics flag is set then the ESP
+// resets the statistics after retrieving them.
+// Each transaction is timed from when the ESP asserts CS until it has finished acting on the command, including any deferred work.
+// Latency bucket 0 counts transactions that took fewer than 2^(firstBucketLog2 + 1) CPU cycles, bucket n > 0 counts those that took
+// from 2^(firstBucketLog2 + n) up to 2^(firstBucketLog2 + n + 1) cycles, and the last bucket also counts everything slower.
+// Transactions with a bad header are counted against the last command index.
+const size_t NumLatencyBuckets = 12;
+const unsigned int FirstLatencyBucketLog2 = 10;
+const uint8_t FlagResetStatistics = 0x01;
+
+struct StatisticsHeader
+{
+	uint32_t sinceResetMillis;			// how long the statistics have been collected for
+	uint32_t clockReg;					// the SPI clock register now in use
+	uint16_t cpuFreqMHz;				// CPU cycles per microsecond
+	uint8_t firstCommand;				// the command index of the first record returned
+	uint8_t numCommands;				// the number of CommandStatistics records that follow
+	uint8_t totalCommands;				// the number of command indices we keep statistics for
+	uint8_t numBuckets;					// NumLatencyBuckets
+	uint8_t firstBucketLog2;			// FirstLatencyBucketLog2
+	uint8_t zero;						// unused, set to zero
+};
+
+struct CommandStatistics
+{
+	uint64_t totalCycles;				// CPU cycles spent on all transactions with this command
+	uint64_t spiCycles;					// how many of those cycles were spent waiting for SPI transfers
+	uint32_t count;						// the number of transactions
+	uint32_t maxCycles;					// CPU cycles taken by the slowest transaction
+	uint32_t bytesIn;					// data bytes received from the SAM, including the header
+	uint32_t bytesOut;					// data bytes sent to the SAM, including the header
+	uint16_t latency[NumLatencyBuckets]; // histogram of transaction times, saturating at 65535
+};
+
+static_assert(sizeof(StatisticsHeader) % sizeof(uint64_t) == 0, "StatisticsHeader must be a whole number of uint64s");
+static_assert(sizeof(CommandStatistics) % sizeof(uint64_t) == 0, "CommandStatistics must be a whole number of uint64s");
+
+// Feature bits returned in the capabilities response
+const uint32_t FeatureReadMulti = 1u << 0;				// connReadMulti is supported
+const uint32_t FeatureWriteMulti = 1u << 1;				// connWriteMulti is supported
+const uint32_t FeatureNegotiableBlockSize = 1u << 2;	// networkNegotiateBlockSize is supported
+const uint32_t FeaturePipelinedSpi = 1u << 3;			// long SPI transfers are pipelined, so the SAM may see less clock idle time between FIFO loads
+const uint32_t FeatureAllConnStatus = 1u << 4;			// connGetAllStatus is supported
+const uint32_t FeatureEventQueue = 1u << 5;				// networkGetEvents is supported, and once the SAM has used it new events are signalled on EspReqTransferPin
+const uint32_t FeatureCrcFraming = 1u << 6;				// framed transactions using MyFramedFormatVersion and networkRetransmit are supported
+const uint32_t FeatureClockCalibration = 1u << 7;		// networkCalibrateClock is supported
+const uint32_t FeatureStatistics = 1u << 8;				// networkGetStatistics is supported
+const uint32_t FeatureBinaryDiagnostics = 1u << 9;		// networkGetDiagnostics is supported
+const uint32_t FeatureTrafficCounters = 1u << 10;		// connGetStatus returns an ExtendedConnStatusResponse if FlagExtendedStatus is set
+const uint32_t FeatureNetworkScan = 1u << 11;			// networkScan is supported and networkStartClient scans in the background
+const uint32_t FeatureFastReconnect = 1u << 12;			// the ESP remembers the access point and channel of each network, and networkGetConnectLog is supported
+const uint32_t FeatureFastBoot = 1u << 13;				// networkSetFastBoot and networkGetBootTimes are supported
+
+// Response to a networkGetCapabilities command. New fields may be added at the end, so the SAM should accept a longer response.
+struct CapabilitiesResponse
+{
+	uint32_t features;					// the Feature... bits that apply to this firmware
+	uint16_t maxDataLength;				// the largest data length we can negotiate
+	uint16_t negotiatedDataLength;		// the data length currently in use
+	uint8_t numSockets;					// the number of sockets we support
+	uint8_t maxBatchSockets;			// the number of sockets that connReadMulti and connWriteMulti can serve in one transaction
+	uint8_t formatVersion;				// the message format version, same as in the header
+	uint8_t zero;						// unused, set to zero
+
+	// Timing profile
+	uint32_t clockReg;					// the SPI clock register now in use
+	uint32_t defaultClockReg;			// the SPI clock register we use after a reset
+	uint16_t transferReadyTimeout;		// how long in milliseconds we wait for TransferReady to go low after a transaction before assuming we missed it
+	uint16_t statusReportInterval;		// the minimum interval in milliseconds between repeated status change signals
+	uint32_t maxConnectTime;			// how long in milliseconds we wait for a connection to an access point
+};
+
 // Message data sent from SAM to ESP to add an SSID or set the access point configuration. This is also the format of a remembered SSID entry.
 struct WirelessConfigurationData
 {
@@ -210,6 +370,247 @@ struct ConnStatusResponse
 	uint16_t otherEndClosedSockets;		// bitmap of sockets that are in state 'otherEndClosed'
 };
 
+// Traffic counters for one socket, which are reset when a connection is accepted
+struct ConnTrafficCounters
+{
+	uint32_t bytesReceived;				// data received from the remote end
+	uint32_t bytesRead;					// data read by the SAM
+	uint32_t bytesWritten;				// data written by the SAM and accepted by LwIP
+	uint32_t bytesAcked;				// data acknowledged by the remote end
+	uint16_t writeFailures;				// how many times LwIP refused data that the SAM wrote
+	uint16_t peakUnAcked;				// the most data that has been sent but not acknowledged at once, saturating at 65535
+	uint16_t srttMillis;				// the smoothed round trip time calculated by LwIP, which has a resolution of TCP_SLOW_INTERVAL
+	uint16_t retransmissions;			// how many times LwIP has retransmitted the oldest unacknowledged segment
+};
+
+// Response to a connGetStatus command with the FlagExtendedStatus flag set, if the SAM has room for it
+const uint8_t FlagExtendedStatus = 0x01;
+
+struct ExtendedConnStatusResponse
+{
+	ConnStatusResponse status;
+	ConnTrafficCounters traffic;
+};
+
+// Summary status of one socket, returned for each socket in response to a connGetAllStatus command
+struct ConnSummary
+{
+	ConnState state;
+	uint8_t changeCount;				// incremented whenever the state changes, data arrives or sent data is acknowledged
+	uint16_t bytesAvailable;
+	uint16_t writeBufferSpace;
+	uint16_t localPort;
+	uint16_t remotePort;
+	uint16_t zero;						// unused, set to zero
+};
+
+struct AllConnStatusResponse
+{
+	ConnSummary sockets[MaxConnections];
+};
+
+// Diagnostic information about one socket, returned in response to a networkGetDiagnostics command
+struct ConnDiagnostics
+{
+	ConnState state;
+	uint8_t changeCount;
+	uint16_t localPort;
+	uint16_t remotePort;
+	uint16_t unAcked;					// data sent but not yet acknowledged, saturating at 65535
+	uint32_t remoteIp;
+	uint16_t bytesAvailable;
+	uint16_t writeBufferSpace;
+};
+
+// Usage of one LwIP memory pool. The pools are in the order of LwIP's memp_t enumeration.
+struct MempDiagnostics
+{
+	uint16_t avail;						// the size of the pool
+	uint16_t used;						// how many elements are in use now
+	uint16_t max;						// the most elements that have been in use at once
+	uint16_t err;						// how many times an allocation failed
+};
+
+const size_t MaxMempPools = 16;
+
+// Response to a networkGetDiagnostics command. This replaces the text that the diagnostics command prints on the UART.
+// The loop timing covers the time since the previous networkGetDiagnostics command.
+struct DiagnosticsResponse
+{
+	uint32_t uptimeMillis;
+	uint32_t freeHeap;
+	uint32_t maxFreeBlock;				// the largest block that can be allocated from the heap
+	uint8_t heapFragmentation;			// percentage of the free heap that is not in the largest free block
+	uint8_t numConnections;				// MaxConnections
+	uint8_t numPools;					// how many entries of pools[] are valid, 0 if LwIP was built without memory pool statistics
+	uint8_t pbufPoolIndex;				// which entry of pools[] is the pbuf pool, or 0xFF if none
+	uint32_t loopCount;					// how many times the main loop has run
+	uint32_t maxLoopMicros;				// the longest time between starts of the main loop
+	uint32_t averageLoopMicros;
+	uint32_t refusedAccepts;			// how many connections have been refused because memory was short
+	uint32_t windowUpdatesHeld;			// how many receive window updates have been held back because memory was short
+	uint32_t writesAttempted;			// how many writes from the SAM we have passed to LwIP
+	uint32_t writeEstimateFailures;		// how many of those failed for lack of memory even though we had said there was room for them
+	uint32_t writesRounded;				// how many writes we accepted only up to a segment boundary because memory was tight
+	uint32_t bytesDeferredByRounding;	// how many bytes the SAM had to send later because of that
+	uint32_t settingsSnapshots;			// how many times the settings journal has been compacted into a new flash sector since the ESP was reset
+	ConnDiagnostics connections[MaxConnections];
+	MempDiagnostics pools[MaxMempPools];
+};
+
+// Response to a networkScan command. The ESP keeps the results of the most recent scan, whether it was started by a networkScan command
+// or by networkStartClient with no SSID. If the FlagStartScan flag is set then the ESP returns no data and starts a new scan in the background;
+// the SAM should then send networkScan without the flag until it stops getting ResponseBusy.
+// A scan can only be started when the ESP is idle or connected to an access point.
+// Only the valid entries of networks[] are returned, so the response length is variable. Networks are sorted strongest first.
+const uint8_t FlagStartScan = 0x01;
+const size_t MaxScanResults = 16;
+
+struct WiFiScanEntry
+{
+	char ssid[SsidLength];				// not null terminated if it is SsidLength characters long
+	uint8_t bssid[6];
+	int8_t rssi;						// signal strength in dBm
+	uint8_t channel;
+	uint8_t authMode;					// the SDK's AUTH_MODE value
+	uint8_t hidden;						// nonzero if the network doesn't broadcast its SSID
+	uint16_t zero;						// unused, set to zero
+};
+
+struct WiFiScanResponse
+{
+	uint32_t ageMillis;					// how long ago the scan finished
+	uint8_t valid;						// zero if no scan has completed successfully yet
+	uint8_t numNetworks;				// how many entries follow
+	uint8_t totalNetworks;				// how many networks the scan found, which may be more than MaxScanResults
+	uint8_t zero;						// unused, set to zero
+	WiFiScanEntry networks[MaxScanResults];
+};
+
+static_assert(sizeof(WiFiScanEntry) % sizeof(uint32_t) == 0, "WiFiScanEntry must be a whole number of dwords");
+
+// Response to a networkGetConnectLog command. The ESP records each attempt to connect to an access point, including reconnections after the
+// connection was lost. A directed attempt uses the BSSID and channel remembered from the last successful connection to that network; if it fails
+// then the ESP immediately makes a full scan attempt. Only the valid entries of records[] are returned, oldest first.
+enum class ConnectAttemptType : uint8_t
+{
+	directed = 0,						// connect to the remembered access point on the remembered channel
+	fullScan = 1,						// scan all channels for the network
+	autoReconnect = 2					// the SDK is reconnecting by itself after the connection was lost
+};
+
+struct ConnectAttemptRecord
+{
+	uint32_t startMillis;				// when the attempt started, in milliseconds since the ESP was reset
+	uint32_t durationMillis;			// how long it took to get an IP address, or to fail
+	ConnectAttemptType type;
+	uint8_t status;						// the SDK's station status at the end of the attempt, STATION_GOT_IP (5) if it succeeded
+	uint8_t channel;					// the channel we were connected to or directed to, 0 if not known
+	uint8_t zero;						// unused, set to zero
+};
+
+const size_t MaxConnectAttemptRecords = 16;
+
+struct ConnectLogResponse
+{
+	uint32_t totalAttempts;				// how many attempts have finished since the ESP was reset
+	uint8_t numRecords;					// how many records follow
+	uint8_t zero[3];					// unused, set to zero
+	ConnectAttemptRecord records[MaxConnectAttemptRecords];
+};
+
+static_assert(sizeof(ConnectAttemptRecord) % sizeof(uint32_t) == 0, "ConnectAttemptRecord must be a whole number of dwords");
+
+// Fast boot. If the networkSetFastBoot command is sent with the FlagFastBoot flag set, then whenever the ESP starts it connects to the network
+// it was last connected to without waiting for the SAM, using the host name that the SAM last set. After a reset other than a power up, if the
+// DHCP lease it had before the reset has plenty of time left to run then it reuses it instead of waiting for DHCP. If the SAM then sends
+// networkStartClient for the same network, or with no SSID, the ESP carries on with the connection it has already started.
+const uint8_t FlagFastBoot = 0x01;
+
+// Response to a networkGetBootTimes command. Times are in milliseconds since the ESP was reset, or 0 if that stage hasn't been reached yet.
+struct BootTimesResponse
+{
+	uint32_t resetReason;				// the SDK's reset reason
+	uint32_t setupStartMillis;			// when we started to initialise
+	uint32_t spiReadyMillis;			// when we told the SAM that we were ready to receive commands
+	uint32_t connectStartMillis;		// when we first started to connect to an access point
+	uint32_t associatedMillis;			// when we first associated with an access point
+	uint32_t gotIpMillis;				// when we first had an IP address
+	uint32_t firstListenerMillis;		// when the SAM first asked us to listen on a port
+	uint8_t fastBoot;					// nonzero if fast boot is enabled
+	uint8_t fastBootConnect;			// nonzero if we started to connect during startup
+	uint8_t leaseReused;				// nonzero if we reused the DHCP lease that we had before the reset
+	uint8_t zero;						// unused, set to zero
+};
+
+// Connection events reported in response to a networkGetEvents command
+enum class ConnEventType : uint8_t
+{
+	none = 0,
+	accepted,							// a connection has been accepted, param is the local port
+	dataArrived,						// data has arrived, param is the total amount now available
+	otherEndClosed,						// the remote end has closed the connection
+	aborted,							// the connection has failed
+	writeSpaceAvailable					// sent data has been acknowledged, param is the write buffer space now available
+};
+
+struct ConnEvent
+{
+	ConnEventType type;
+	uint8_t socketNumber;
+	uint16_t param;
+};
+
+// The response to a networkGetEvents command is an EventsResponseHeader followed by numEvents ConnEvent records, oldest first
+struct EventsResponseHeader
+{
+	uint16_t numEvents;
+	uint16_t lostEvents;				// how many events were discarded because the queue was full. If nonzero the SAM should poll all sockets.
+};
+
+// Message data sent from SAM to ESP for a connReadMulti command
+struct ReadMultiRequest
+{
+	uint16_t maxLength[MaxConnections];	// the maximum amount of data the SAM wants from each socket, 0 means don't read from that socket
+};
+
+// The data returned for a connReadMulti command starts with a ReadMultiSummary, which the ESP sends while it receives the ReadMultiRequest.
+// This is followed by a sequence of records, each comprising a ReadMultiRecord and then the data padded to a whole number of dwords.
+// The sequence ends at the end of the returned data or at a record whose socket number is ReadMultiEndMarker, whichever comes first.
+struct ReadMultiSummary
+{
+	uint16_t bytesAvailable[MaxConnections];	// how much data each socket had available before any was read
+};
+
+struct ReadMultiRecord
+{
+	uint8_t socketNumber;
+	ConnState state;					// the state of the connection after reading the data
+	uint16_t length;					// the number of bytes of data that follow, not including padding
+};
+
+const uint8_t ReadMultiEndMarker = 0xFF;
+
+static_assert(sizeof(ReadMultiRequest) == sizeof(ReadMultiSummary), "ReadMulti request and summary sizes don't match");
+static_assert(sizeof(ReadMultiRecord) == sizeof(uint32_t), "ReadMultiRecord must be one dword");
+
+// Message data sent from SAM to ESP for a connWriteMulti command. This is followed by the data for each socket in socket number order, each padded to a whole number of dwords.
+struct WriteMultiRequest
+{
+	uint16_t length[MaxConnections];	// how much data there is for each socket
+	uint8_t flags[MaxConnections];		// FlagPush and FlagCloseAfterWrite for each socket, only acted on if all the data for that socket is accepted
+};
+
+// Data returned by the ESP for a connWriteMulti command. The ESP sends this immediately after it has received the WriteMultiRequest, so it starts at offset sizeof(WriteMultiRequest) in the returned data.
+// Data for a socket beyond the accepted length is discarded. The ESP always transfers at least sizeof(WriteMultiRequest) + sizeof(WriteMultiResponse) bytes.
+struct WriteMultiResponse
+{
+	uint16_t acceptedLength[MaxConnections];
+};
+
+static_assert(sizeof(WriteMultiRequest) % sizeof(uint32_t) == 0, "WriteMultiRequest must be a whole number of dwords");
+static_assert(sizeof(WriteMultiResponse) % sizeof(uint32_t) == 0, "WriteMultiResponse must be a whole number of dwords");
+
 // Response error codes. A non-negative code is the number of bytes of returned data.
 const int32_t ResponseEmpty = 0;				// used when there is no error and no data to return
 const int32_t ResponseUnknownCommand = -1;
@@ -224,6 +625,7 @@ const int32_t ResponseBufferTooSmall = -9;
 const int32_t ResponseBadReplyFormatVersion = -10;
 const int32_t ResponseBadParameter = -11;
 const int32_t ResponseUnknownError = -12;
+const int32_t ResponseBadCrc = -13;				// a framed transaction failed the CRC check, so the command was not executed
 
 const size_t MaxRememberedNetworks = 20;
 static_assert((MaxRememberedNetworks + 1) * ReducedWirelessConfigurationDataSize <= MaxDataLength, "Too many remembered networks");